@@ -0,0 +1,295 @@
+"""
+pyperf benchmarks of cstring against str and bytes.
+
+Every case is run for each input size, kind of text (ASCII or multibyte)
+and, for searches, a needle that occurs once at the end of the text ("hit")
+or not at all ("miss"). Benchmarks are named
+
+    method/kind/size/pattern/impl
+
+where impl is cstring, str or bytes (the baselines), so runs can be compared
+with `python -m pyperf compare_to`, and bench/report.py can compare the
+implementations within a run.
+
+Usage (from the repository root, after `python setup.py build_ext --inplace`):
+
+    python bench/bench_cstring.py --fast -o bench.json
+    python bench/bench_cstring.py --methods 'find,count,split*' --sizes 8,1M -o bench.json
+    python -m pyperf compare_to before.json after.json --table
+    python bench/report.py bench.json
+"""
+
+import fnmatch
+import functools
+import mmap
+import os
+import pickle
+import sys
+import tempfile
+import time
+
+import pyperf
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+import cstring as module  # noqa: E402
+from cstring import cstring  # noqa: E402
+
+
+SIZES = {'8': 8, '1K': 1 << 10, '64K': 64 << 10, '1M': 1 << 20, '100M': 100 << 20}
+DEFAULT_SIZES = '8,1K,64K,1M,100M'
+
+TEXT = {
+    'ascii': 'The quick brown fox jumps over the lazy dog, again and again; ',
+    'multibyte': 'Größe naïve café, 字符串 ☃ — ǅemal 𝄞; ',
+}
+NEEDLE = {'ascii': ('XYZ', 'XYQ'), 'multibyte': ('ΩЖ', 'ΩQ')}    # (hit, miss)
+SEP = ','
+
+IMPLS = ('cstring', 'str', 'bytes')
+
+
+@functools.lru_cache(maxsize=2)
+def make_text(kind, size):
+    """About `size` bytes of text of `kind`, ending with the hit needle."""
+    base = TEXT[kind]
+    end = NEEDLE[kind][0]
+    reps = size // len(base.encode()) + 1
+    data = (base * reps).encode()[:max(size - len(end.encode()), 0)]
+    return data.decode('utf-8', 'ignore') + end
+
+
+def convert(impl, text):
+    if impl == 'str':
+        return text
+    if impl == 'bytes':
+        return text.encode()
+    return cstring(text)
+
+
+def text_file(kind, size):
+    """A file holding make_text(kind, size), kept in the temporary directory between runs."""
+    data = make_text(kind, size).encode()
+    path = os.path.join(tempfile.gettempdir(), 'cstring-bench-%s-%d.txt' % (kind, size))
+    if not os.path.exists(path) or os.path.getsize(path) != len(data):
+        with open(path, 'wb') as f:
+            f.write(data)
+    return path
+
+
+@functools.lru_cache(maxsize=2)
+def text_mapping(kind, size):
+    with open(text_file(kind, size), 'rb') as f:
+        return mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+
+
+def read_text(path):
+    with open(path, encoding='utf-8') as f:
+        return f.read()
+
+
+def read_bytes(path):
+    with open(path, 'rb') as f:
+        return f.read()
+
+
+class Case:
+    """
+    op(obj, *args) is timed; prepare(impl, obj, text, kind, pattern)
+    returns args (by default, none). ops maps impl to op, for impls
+    whose call differs from cstring's; impls without an op are skipped.
+    """
+
+    def __init__(self, name, op, prepare=None, patterns=('-',), impls=IMPLS, **ops):
+        self.name = name
+        self.ops = {impl: ops.get(impl, op) for impl in impls}
+        self.prepare = prepare or (lambda impl, obj, text, kind, pattern: ())
+        self.patterns = patterns
+
+
+def needle(impl, obj, text, kind, pattern):
+    return (convert(impl, NEEDLE[kind][0 if pattern == 'hit' else 1]),)
+
+
+def separator(impl, obj, text, kind, pattern):
+    return (convert(impl, SEP if pattern == 'hit' else '|'),)
+
+
+def middle(impl, obj, text, kind, pattern):
+    return (len(obj) // 2,)
+
+
+def pieces(impl, obj, text, kind, pattern):
+    return (convert(impl, SEP), [convert(impl, piece) for piece in text.split(SEP)])
+
+
+def replacement(impl, obj, text, kind, pattern):
+    return needle(impl, obj, text, kind, pattern) + (convert(impl, '-'),)
+
+
+def byte_replacement(impl, obj, text, kind, pattern):
+    return separator(impl, obj, text, kind, pattern) + (convert(impl, ';'),)
+
+
+def copy(impl, obj, text, kind, pattern):
+    return (drop_hash(obj),)
+
+
+def translation(impl, obj, text, kind, pattern):
+    if impl == 'cstring':
+        return (cstring.maketrans(',;', '  ', '\t'),)
+    if impl == 'str':
+        return (str.maketrans(',;', '  ', '\t'),)
+    return (bytes.maketrans(b',;', b'  '), b'\t')
+
+
+def consume(iterable):
+    for _ in iterable:
+        pass
+
+
+def drop_hash(obj):
+    # a new object with the same contents, so nothing is cached
+    return obj[:-1] + obj[-1:]
+
+
+SEARCH = ('hit', 'miss')
+
+CASES = [
+    Case('capitalize', lambda s: s.capitalize()),
+    Case('casefold', lambda s: s.casefold(), impls=('cstring', 'str')),
+    Case('char_at', lambda s, i: s.char_at(i), middle,
+         str=lambda s, i: s[i], impls=('cstring', 'str')),
+    Case('char_len', lambda s: s.char_len(),
+         str=len, impls=('cstring', 'str')),
+    Case('char_slice', lambda s, i: s.char_slice(i // 2, i),
+         middle, str=lambda s, i: s[i // 2:i], impls=('cstring', 'str')),
+    Case('count', lambda s, sub: s.count(sub), needle, SEARCH),
+    Case('endswith', lambda s, sub: s.endswith(sub), needle, SEARCH),
+    Case('find', lambda s, sub: s.find(sub), needle, SEARCH),
+    Case('from_file', lambda s, path: cstring.from_file(path, errors='trust'),
+         lambda impl, obj, text, kind, pattern: (text_file(kind, len(text.encode())),),
+         str=lambda s, path: read_text(path), bytes=lambda s, path: read_bytes(path)),
+    Case('from_mmap', lambda s, mapping: cstring.from_mmap(mapping, errors='trust'),
+         lambda impl, obj, text, kind, pattern: (text_mapping(kind, len(text.encode())),),
+         str=lambda s, mapping: mapping[:].decode(), bytes=lambda s, mapping: mapping[:]),
+    Case('index', lambda s, sub: s.index(sub), needle, ('hit',)),
+    Case('intern', lambda s: s.intern(), str=sys.intern, impls=('cstring', 'str')),
+    Case('isalnum', lambda s: s.isalnum()),
+    Case('isalpha', lambda s: s.isalpha()),
+    Case('isascii', lambda s: s.isascii()),
+    Case('isdigit', lambda s: s.isdigit()),
+    Case('islower', lambda s: s.islower()),
+    Case('isprintable', lambda s: s.isprintable(), impls=('cstring', 'str')),
+    Case('isspace', lambda s: s.isspace()),
+    Case('isupper', lambda s: s.isupper()),
+    Case('itersplit', lambda s, sep: consume(s.itersplit(sep)), separator, SEARCH,
+         str=lambda s, sep: consume(s.split(sep)), bytes=lambda s, sep: consume(s.split(sep))),
+    Case('itersplitlines', lambda s: consume(s.itersplitlines()),
+         str=lambda s: consume(s.splitlines()), bytes=lambda s: consume(s.splitlines())),
+    Case('join', lambda s, sep, items: sep.join(items), pieces),
+    Case('lower', lambda s: s.lower()),
+    Case('lstrip', lambda s: s.lstrip()),
+    Case('maketrans', lambda s: cstring.maketrans(',;', '  ', '\t'),
+         str=lambda s: str.maketrans(',;', '  ', '\t'), bytes=lambda s: bytes.maketrans(b',;', b'  ')),
+    Case('materialize', lambda s: s.view(1).materialize(),
+         bytes=lambda s: bytes(memoryview(s)[1:]), impls=('cstring', 'bytes')),
+    Case('partition', lambda s, sep: s.partition(sep), separator, SEARCH),
+    Case('reduce_ex', lambda s: pickle.dumps(s, 5)),
+    Case('replace', lambda s, old, new: s.replace(old, new), replacement, SEARCH),
+    Case('replace_byte', lambda s, old, new: s.replace(old, new), byte_replacement, SEARCH),
+    Case('rfind', lambda s, sub: s.rfind(sub), needle, SEARCH),
+    Case('rindex', lambda s, sub: s.rindex(sub), needle, ('hit',)),
+    Case('rpartition', lambda s, sep: s.rpartition(sep), separator, SEARCH),
+    Case('rsplit', lambda s, sep: s.rsplit(sep), separator, SEARCH),
+    Case('rstrip', lambda s: s.rstrip()),
+    Case('sizeof', lambda s: s.__sizeof__()),
+    Case('split', lambda s, sep: s.split(sep), separator, SEARCH),
+    Case('split_whitespace', lambda s: s.split()),
+    Case('splitlines', lambda s: s.splitlines()),
+    Case('startswith', lambda s, sub: s.startswith(sub), needle, SEARCH),
+    Case('strip', lambda s: s.strip()),
+    Case('swapcase', lambda s: s.swapcase()),
+    Case('title', lambda s: s.title()),
+    Case('translate', lambda s, table, *delete: s.translate(table, *delete), translation),
+    Case('upper', lambda s: s.upper()),
+    Case('view', lambda s, i: s.view(i // 2, i), middle,
+         bytes=lambda s, i: memoryview(s)[i // 2:i], impls=('cstring', 'bytes')),
+
+    # protocols
+    Case('construct', lambda s, src: cstring(src),
+         lambda impl, obj, text, kind, pattern: (text,), impls=('cstring',)),
+    Case('construct_bytes', lambda s, src: cstring(src),
+         lambda impl, obj, text, kind, pattern: (text.encode(),), impls=('cstring',)),
+    Case('len', len),
+    Case('getitem', lambda s, i: s[i], middle),
+    Case('slice', lambda s, i: s[i // 2:i], middle),
+    Case('slice_step', lambda s: s[::3]),
+    Case('hash', hash),
+    Case('hash_uncached', hash),
+    Case('eq', lambda s, other: s == other, copy),
+    Case('lt', lambda s, other: s < other,
+         lambda impl, obj, text, kind, pattern: (convert(impl, text[:-1] + '~'),)),
+    Case('contains', lambda s, sub: sub in s, needle, SEARCH),
+    Case('concat', lambda s, other: s + other,
+         lambda impl, obj, text, kind, pattern: (obj,)),
+    Case('iter', lambda s: consume(s), impls=('cstring', 'str')),
+]
+
+
+def time_case(loops, case, impl, kind, size, pattern):
+    text = make_text(kind, size)
+    obj = convert(impl, text)
+    args = case.prepare(impl, obj, text, kind, pattern)
+    op = case.ops[impl]
+    if case.name == 'hash_uncached':
+        # only the hashing is timed; the copies are made outside of it
+        elapsed = 0.0
+        for _ in range(loops):
+            copy = drop_hash(obj)
+            t0 = time.perf_counter()
+            hash(copy)
+            elapsed += time.perf_counter() - t0
+        return elapsed
+    t0 = time.perf_counter()
+    for _ in range(loops):
+        op(obj, *args)
+    return time.perf_counter() - t0
+
+
+def add_cmdline_args(cmd, args):
+    cmd.extend(('--sizes', args.sizes, '--kinds', args.kinds, '--methods', args.methods, '--impls', args.impls))
+    cmd.extend(('--threads', str(args.threads)))
+
+
+def main():
+    runner = pyperf.Runner(add_cmdline_args=add_cmdline_args)
+    runner.metadata['description'] = 'cstring methods against str and bytes'
+    parser = runner.argparser
+    parser.add_argument('--sizes', default=DEFAULT_SIZES,
+                        help='comma-separated input sizes (default: %s)' % DEFAULT_SIZES)
+    parser.add_argument('--kinds', default=','.join(TEXT), help='comma-separated kinds of text')
+    parser.add_argument('--methods', default='*', help='comma-separated glob patterns of case names')
+    parser.add_argument('--impls', default=','.join(IMPLS), help='comma-separated implementations')
+    parser.add_argument('--threads', type=int, default=0,
+                        help='worker threads for large inputs (cstring.set_threads; default: one per CPU)')
+    args = runner.parse_args()
+    if args.threads:
+        module.set_threads(args.threads)
+
+    methods = args.methods.split(',')
+    impls = args.impls.split(',')
+    for case in CASES:
+        if not any(fnmatch.fnmatch(case.name, m) for m in methods):
+            continue
+        for kind in args.kinds.split(','):
+            for size_name in args.sizes.split(','):
+                for pattern in case.patterns:
+                    for impl in impls:
+                        if impl not in case.ops:
+                            continue
+                        name = '/'.join((case.name, kind, size_name, pattern, impl))
+                        runner.bench_time_func(name, time_case, case, impl, kind, SIZES[size_name], pattern)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,46 @@
+"""
+Compares cstring with the str and bytes baselines in a result file of
+bench/bench_cstring.py:
+
+    python bench/report.py bench.json
+
+Each row is one case (method/kind/size/pattern), with the mean time of
+cstring and its speedup over str and bytes (above 1.00 is faster).
+"""
+
+import sys
+
+import pyperf
+
+
+def format_time(seconds):
+    for unit, scale in (('s', 1), ('ms', 1e-3), ('us', 1e-6)):
+        if seconds >= scale:
+            return '%.2f %s' % (seconds / scale, unit)
+    return '%.0f ns' % (seconds / 1e-9)
+
+
+def main(path):
+    means = {}
+    for bench in pyperf.BenchmarkSuite.load(path).get_benchmarks():
+        case, _, impl = bench.get_name().rpartition('/')
+        means.setdefault(case, {})[impl] = bench.mean()
+
+    rows = [('case', 'cstring', 'vs str', 'vs bytes')]
+    for case, impls in means.items():
+        if 'cstring' not in impls:
+            continue
+        mean = impls['cstring']
+        rows.append((case, format_time(mean)) + tuple(
+            '%.2fx' % (impls[base] / mean) if base in impls else '-' for base in ('str', 'bytes')))
+
+    widths = [max(len(row[i]) for row in rows) for i in range(4)]
+    for row in rows:
+        print('  '.join(cell.ljust(width) if i == 0 else cell.rjust(width)
+                        for i, (cell, width) in enumerate(zip(row, widths))))
+
+
+if __name__ == '__main__':
+    if len(sys.argv) != 2:
+        sys.exit('usage: %s RESULTS.json' % sys.argv[0])
+    main(sys.argv[1])
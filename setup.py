@@ -1,6 +1,12 @@
+import os
+
 from setuptools import setup, Extension
 
 
+# CSTRING_STATS=1 builds in the cstring._stats() counters
+macros = [('CSTRING_STATS', '1')] if os.environ.get('CSTRING_STATS') else []
+
+
 setup(
     name='cstring',
     version='0.1.0',
@@ -10,9 +16,9 @@ setup(
     long_description=open('README.md').read(),
     long_description_content_type='text/markdown',
     url='https://github.com/atpalmer-python/python-cstring',
-    ext_modules=[Extension('cstring', sources=['src/cstring.c'])],
+    ext_modules=[Extension('cstring', sources=['src/cstring.c'], define_macros=macros)],
     classifiers=[
     ],
-    python_requires='>=3.6',
+    python_requires='>=3.9',
 )
 
@@ -1,949 +1,6499 @@
 #include <Python.h>
+#include <structmember.h>
+#include <stddef.h>
+#include <stdint.h>
+#if defined(HAVE_FORK) && defined(HAVE_PTHREAD_H)
+#include <pthread.h>
+#define POOL_AT_FORK
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CSTRING_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(CSTRING_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define CSTRING_AVX2
+#include <immintrin.h>
+#define CSTRING_TARGET(t)   __attribute__((target(t)))
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+static inline int _ctz(unsigned int x) {
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return (int)i;
+}
+static inline int _bsr(unsigned int x) {
+    unsigned long i;
+    _BitScanReverse(&i, x);
+    return (int)i;
+}
+#else
+static inline int _ctz(unsigned int x) {
+    return __builtin_ctz(x);
+}
+static inline int _bsr(unsigned int x) {
+    return 31 - __builtin_clz(x);
+}
+#endif
 
 #define WHITESPACE_CHARS    " \t\n\v\f\r"
 
-/* memrchr not available on some systems, so reimplement. */
-const char *_memrchr(const char *s, int c, size_t n) {
-    for(const char *p = s + n - 1; p >= s; --p) {
-        if(*p == c)
-            return p;
+/* AVX2 kernels are chosen at runtime; SSE2 is baseline on x86-64 */
+#ifdef CSTRING_AVX2
+static int _cpu_avx2 = 0;
+#endif
+
+static void _cpu_init_dispatch(void) {
+#ifdef CSTRING_AVX2
+    __builtin_cpu_init();
+    _cpu_avx2 = __builtin_cpu_supports("avx2");
+#endif
+}
+
+/*
+ * Argument parsing for METH_FASTCALL functions and vectorcall, which get
+ * the positional arguments as a C array and, with METH_KEYWORDS, a tuple
+ * of keyword names whose values follow the positionals. No tuple or dict
+ * is built for a call.
+ */
+static int _check_nargs(const char *name, Py_ssize_t nargs, Py_ssize_t min, Py_ssize_t max) {
+    if(nargs < min) {
+        PyErr_Format(PyExc_TypeError, "%s expected %s%zd argument%s, got %zd",
+            name, min == max ? "" : "at least ", min, min == 1 ? "" : "s", nargs);
+        return -1;
+    }
+    if(nargs > max) {
+        PyErr_Format(PyExc_TypeError, "%s expected %s%zd argument%s, got %zd",
+            name, min == max ? "" : "at most ", max, max == 1 ? "" : "s", nargs);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Matches arguments against the NULL-terminated kwlist into out[], which
+ * is left NULL for arguments not given. As for PyArg_ParseTupleAndKeywords,
+ * empty names are positional-only and the first `required` are required.
+ */
+static int _parse_args(const char *name, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames,
+                       const char *const *kwlist, int required, PyObject **out) {
+    int count = 0;
+    while(kwlist[count])
+        out[count++] = NULL;
+    if(nargs > count) {
+        PyErr_Format(PyExc_TypeError, "%s() takes at most %d argument%s (%zd given)",
+            name, count, count == 1 ? "" : "s", nargs);
+        return -1;
+    }
+    for(Py_ssize_t i = 0; i < nargs; ++i)
+        out[i] = args[i];
+
+    Py_ssize_t nkwargs = kwnames ? PyTuple_GET_SIZE(kwnames) : 0;
+    for(Py_ssize_t k = 0; k < nkwargs; ++k) {
+        PyObject *kw = PyTuple_GET_ITEM(kwnames, k);
+        int i = 0;
+        while(i < count && !(kwlist[i][0] && PyUnicode_CompareWithASCIIString(kw, kwlist[i]) == 0))
+            ++i;
+        if(i == count) {
+            PyErr_Format(PyExc_TypeError, "'%U' is an invalid keyword argument for %s()", kw, name);
+            return -1;
+        }
+        if(out[i]) {
+            PyErr_Format(PyExc_TypeError, "argument for %s() given by name ('%s') and position (%d)",
+                name, kwlist[i], i + 1);
+            return -1;
+        }
+        out[i] = args[nargs + k];
+    }
+
+    for(int i = 0; i < required; ++i) {
+        if(out[i])
+            continue;
+        if(kwlist[i][0])
+            PyErr_Format(PyExc_TypeError, "%s() missing required argument '%s' (pos %d)", name, kwlist[i], i + 1);
+        else
+            PyErr_Format(PyExc_TypeError, "%s() takes at least %d positional argument%s (%zd given)",
+                name, required, required == 1 ? "" : "s", nargs);
+        return -1;
+    }
+    return 0;
+}
+
+/* Converters for parsed arguments, as the "n", "i", "p" and "s" formats. */
+static int _arg_ssize(PyObject *o, Py_ssize_t *n) {
+    *n = PyNumber_AsSsize_t(o, PyExc_OverflowError);
+    return (*n == -1 && PyErr_Occurred()) ? -1 : 0;
+}
+
+static int _arg_int(PyObject *o, int *n) {
+    Py_ssize_t value;
+    if(_arg_ssize(o, &value) < 0)
+        return -1;
+    if(value < INT_MIN || value > INT_MAX) {
+        PyErr_SetString(PyExc_OverflowError, "signed integer is out of range");
+        return -1;
+    }
+    *n = (int)value;
+    return 0;
+}
+
+static int _arg_bool(PyObject *o, int *b) {
+    *b = PyObject_IsTrue(o);
+    return *b < 0 ? -1 : 0;
+}
+
+static int _arg_str(PyObject *o, const char *name, const char **s) {
+    if(!PyUnicode_Check(o)) {
+        PyErr_Format(PyExc_TypeError, "%s must be str, not %.50s", name, Py_TYPE(o)->tp_name);
+        return -1;
+    }
+    Py_ssize_t len;
+    *s = PyUnicode_AsUTF8AndSize(o, &len);
+    if(!*s)
+        return -1;
+    if(strlen(*s) != (size_t)len) {
+        PyErr_SetString(PyExc_ValueError, "embedded null character");
+        return -1;
+    }
+    return 0;
+}
+
+/* memrchr not available on some systems, so reimplement. */
+const char *_memrchr(const char *s, int c, size_t n) {
+    const char *p = s + n;
+#ifdef CSTRING_SSE2
+    const __m128i needle = _mm_set1_epi8((char)c);
+    while(p - s >= 16) {
+        p -= 16;
+        __m128i block = _mm_loadu_si128((const __m128i *)p);
+        unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+        if(mask)
+            return p + _bsr(mask);
+    }
+#endif
+    while(p > s) {
+        if(*--p == (char)c)
+            return p;
+    }
+    return NULL;
+}
+
+static Py_ssize_t _count_byte(const char *s, Py_ssize_t n, char c) {
+    Py_ssize_t count = 0;
+    Py_ssize_t i = 0;
+#ifdef CSTRING_SSE2
+    const __m128i needle = _mm_set1_epi8(c);
+    while(n - i >= 16) {
+        /* per-lane byte counters, flushed before they can overflow */
+        __m128i acc = _mm_setzero_si128();
+        Py_ssize_t blocks = Py_MIN((n - i) / 16, 255);
+        for(Py_ssize_t b = 0; b < blocks; ++b, i += 16) {
+            __m128i block = _mm_loadu_si128((const __m128i *)(s + i));
+            acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(block, needle));
+        }
+        __m128i sums = _mm_sad_epu8(acc, _mm_setzero_si128());
+        count += _mm_cvtsi128_si32(sums) + _mm_extract_epi16(sums, 4);
+    }
+#endif
+    for(; i < n; ++i)
+        count += (s[i] == c);
+    return count;
+}
+
+
+/*
+ * ASCII kernels
+ */
+
+#ifdef CSTRING_AVX2
+CSTRING_TARGET("avx2")
+static Py_ssize_t _find_non_ascii_avx2(const char *s, Py_ssize_t n) {
+    Py_ssize_t i = 0;
+    for(; i + 32 <= n; i += 32) {
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)(s + i)));
+        if(mask)
+            return i + _ctz(mask);
+    }
+    for(; i < n; ++i) {
+        if((unsigned char)s[i] >= 0x80)
+            break;
+    }
+    return i;
+}
+#endif
+
+/* Index of the first byte >= 0x80 in s[0:n], or n. */
+static Py_ssize_t _find_non_ascii(const char *s, Py_ssize_t n) {
+    Py_ssize_t i = 0;
+#ifdef CSTRING_AVX2
+    if(_cpu_avx2)
+        return _find_non_ascii_avx2(s, n);
+#endif
+#ifdef CSTRING_SSE2
+    for(; i + 16 <= n; i += 16) {
+        unsigned int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(s + i)));
+        if(mask)
+            return i + _ctz(mask);
+    }
+#endif
+    for(; i < n; ++i) {
+        if((unsigned char)s[i] >= 0x80)
+            break;
+    }
+    return i;
+}
+/*
+ * Line boundaries, as str.splitlines: \n, \r, \r\n, \v, \f, \x1c, \x1d,
+ * \x1e, and the UTF-8 encodings of U+0085, U+2028 and U+2029. Returns the
+ * length of the boundary at s[0:n], or 0.
+ */
+static inline Py_ssize_t _line_break_at(const char *s, Py_ssize_t n) {
+    switch((unsigned char)s[0]) {
+    case '\n': case '\v': case '\f': case 0x1c: case 0x1d: case 0x1e:
+        return 1;
+    case '\r':
+        return (n > 1 && s[1] == '\n') ? 2 : 1;
+    case 0xC2:
+        return (n > 1 && (unsigned char)s[1] == 0x85) ? 2 : 0;
+    case 0xE2:
+        return (n > 2 && (unsigned char)s[1] == 0x80
+            && ((unsigned char)s[2] == 0xA8 || (unsigned char)s[2] == 0xA9)) ? 3 : 0;
+    default:
+        return 0;
+    }
+}
+
+/* Index of the first line boundary in s[0:n] (setting *brklen), or n. */
+static Py_ssize_t _find_line_break(const char *s, Py_ssize_t n, Py_ssize_t *brklen) {
+    Py_ssize_t i = 0;
+#ifdef CSTRING_SSE2
+    /* candidates: 0x0a..0x1e (biased into the lowest signed values), or a
+     * lead byte of the multibyte boundaries */
+    const __m128i bias = _mm_set1_epi8(0x80 - 0x0a);
+    const __m128i limit = _mm_set1_epi8((char)(0x80 + 0x1f - 0x0a));
+    const __m128i c2 = _mm_set1_epi8((char)0xC2);
+    const __m128i e2 = _mm_set1_epi8((char)0xE2);
+    for(; i + 16 <= n; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i candidates = _mm_or_si128(
+            _mm_cmplt_epi8(_mm_add_epi8(block, bias), limit),
+            _mm_or_si128(_mm_cmpeq_epi8(block, c2), _mm_cmpeq_epi8(block, e2)));
+        unsigned int mask = _mm_movemask_epi8(candidates);
+        while(mask) {
+            Py_ssize_t k = i + _ctz(mask);
+            if((*brklen = _line_break_at(s + k, n - k)) != 0)
+                return k;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for(; i < n; ++i) {
+        if((*brklen = _line_break_at(s + i, n - i)) != 0)
+            return i;
+    }
+    *brklen = 0;
+    return n;
+}
+
+/*
+ * ASCII case mapping. Each op flips bit 0x20 of the letters in one range;
+ * for CASE_SWAP the range test is done on (c | 0x20) to cover both cases.
+ * Bytes >= 0x80 are never changed.
+ */
+enum _case_op {
+    CASE_LOWER,
+    CASE_UPPER,
+    CASE_SWAP,
+};
+
+#define CASE_RANGE_LO(op)   ((op) == CASE_LOWER ? 'A' : 'a')
+#define CASE_RANGE_HI(op)   ((op) == CASE_LOWER ? 'Z' : 'z')
+#define CASE_FOLD(op)       ((op) == CASE_SWAP ? 0x20 : 0)
+
+static inline char _ascii_case_byte(char c, enum _case_op op) {
+    unsigned char t = (unsigned char)c | CASE_FOLD(op);
+    if(t >= CASE_RANGE_LO(op) && t <= CASE_RANGE_HI(op))
+        return c ^ 0x20;
+    return c;
+}
+
+#ifdef CSTRING_AVX2
+CSTRING_TARGET("avx2")
+static Py_ssize_t _ascii_case_avx2(char *d, const char *s, Py_ssize_t n, enum _case_op op) {
+    const __m256i lo = _mm256_set1_epi8(CASE_RANGE_LO(op) - 1);
+    const __m256i hi = _mm256_set1_epi8(CASE_RANGE_HI(op) + 1);
+    const __m256i fold = _mm256_set1_epi8(CASE_FOLD(op));
+    const __m256i flip = _mm256_set1_epi8(0x20);
+    Py_ssize_t i = 0;
+    for(; i + 32 <= n; i += 32) {
+        __m256i c = _mm256_loadu_si256((const __m256i *)(s + i));
+        __m256i t = _mm256_or_si256(c, fold);
+        __m256i in = _mm256_and_si256(_mm256_cmpgt_epi8(t, lo), _mm256_cmpgt_epi8(hi, t));
+        _mm256_storeu_si256((__m256i *)(d + i), _mm256_xor_si256(c, _mm256_and_si256(in, flip)));
+    }
+    return i;
+}
+#endif
+
+static void _ascii_case(char *d, const char *s, Py_ssize_t n, enum _case_op op) {
+    Py_ssize_t i = 0;
+#ifdef CSTRING_AVX2
+    if(_cpu_avx2)
+        i = _ascii_case_avx2(d, s, n, op);
+#endif
+#ifdef CSTRING_SSE2
+    /* signed compares: bytes >= 0x80 are negative and never in range */
+    const __m128i lo = _mm_set1_epi8(CASE_RANGE_LO(op) - 1);
+    const __m128i hi = _mm_set1_epi8(CASE_RANGE_HI(op) + 1);
+    const __m128i fold = _mm_set1_epi8(CASE_FOLD(op));
+    const __m128i flip = _mm_set1_epi8(0x20);
+    for(; i + 16 <= n; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i t = _mm_or_si128(c, fold);
+        __m128i in = _mm_and_si128(_mm_cmpgt_epi8(t, lo), _mm_cmplt_epi8(t, hi));
+        _mm_storeu_si128((__m128i *)(d + i), _mm_xor_si128(c, _mm_and_si128(in, flip)));
+    }
+#endif
+    for(; i < n; ++i)
+        d[i] = _ascii_case_byte(s[i], op);
+}
+
+/* d[0:n] = s[0:n] with every byte `from` changed to `to` */
+#ifdef CSTRING_AVX2
+CSTRING_TARGET("avx2")
+static Py_ssize_t _replace_byte_avx2(char *d, const char *s, Py_ssize_t n, char from, char to) {
+    const __m256i f = _mm256_set1_epi8(from);
+    const __m256i t = _mm256_set1_epi8(to);
+    Py_ssize_t i = 0;
+    for(; i + 32 <= n; i += 32) {
+        __m256i c = _mm256_loadu_si256((const __m256i *)(s + i));
+        _mm256_storeu_si256((__m256i *)(d + i), _mm256_blendv_epi8(c, t, _mm256_cmpeq_epi8(c, f)));
+    }
+    return i;
+}
+#endif
+
+static void _replace_byte(char *d, const char *s, Py_ssize_t n, char from, char to) {
+    Py_ssize_t i = 0;
+#ifdef CSTRING_AVX2
+    if(_cpu_avx2)
+        i = _replace_byte_avx2(d, s, n, from, to);
+#endif
+#ifdef CSTRING_SSE2
+    const __m128i f = _mm_set1_epi8(from);
+    const __m128i t = _mm_set1_epi8(to);
+    for(; i + 16 <= n; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i match = _mm_cmpeq_epi8(c, f);
+        _mm_storeu_si128((__m128i *)(d + i), _mm_or_si128(_mm_andnot_si128(match, c), _mm_and_si128(match, t)));
+    }
+#endif
+    for(; i < n; ++i)
+        d[i] = s[i] == from ? to : s[i];
+}
+
+/* d[0:n] = map[s[0:n]]. The AVX2 kernel looks each byte up in the 16-byte
+ * row of map for its high nibble, with one shuffle per row; rows of bytes
+ * >= 0x80 are skipped if map leaves them unchanged (groups == 8). */
+#ifdef CSTRING_AVX2
+CSTRING_TARGET("avx2")
+static Py_ssize_t _translate_avx2(char *d, const char *s, Py_ssize_t n, const unsigned char map[256], int groups) {
+    __m256i rows[16];
+    for(int g = 0; g < groups; ++g)
+        rows[g] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(map + 16 * g)));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    Py_ssize_t i = 0;
+    for(; i + 32 <= n; i += 32) {
+        __m256i c = _mm256_loadu_si256((const __m256i *)(s + i));
+        __m256i lo = _mm256_and_si256(c, nibble);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(c, 4), nibble);
+        __m256i r = c;
+        for(int g = 0; g < groups; ++g) {
+            __m256i in = _mm256_cmpeq_epi8(hi, _mm256_set1_epi8((char)g));
+            r = _mm256_blendv_epi8(r, _mm256_shuffle_epi8(rows[g], lo), in);
+        }
+        _mm256_storeu_si256((__m256i *)(d + i), r);
+    }
+    return i;
+}
+#endif
+
+static void _translate(char *d, const char *s, Py_ssize_t n, const unsigned char map[256], int groups) {
+    Py_ssize_t i = 0;
+#ifdef CSTRING_AVX2
+    if(_cpu_avx2)
+        i = _translate_avx2(d, s, n, map, groups);
+#endif
+    for(; i < n; ++i)
+        d[i] = map[(unsigned char)s[i]];
+}
+
+/* Like _translate, dropping bytes c with !keep[c] (a compacting store:
+ * every byte is written, and the output only advances past kept ones).
+ * Returns the number of bytes written. */
+static Py_ssize_t _translate_compact(char *d, const char *s, Py_ssize_t n, const unsigned char map[256], const unsigned char keep[256]) {
+    Py_ssize_t j = 0;
+    for(Py_ssize_t i = 0; i < n; ++i) {
+        unsigned char c = s[i];
+        d[j] = map[c];
+        j += keep[c];
+    }
+    return j;
+}
+
+/*
+ * UTF-8 validation
+ *
+ * The AVX2 kernel follows Keiser & Lemire, "Validating UTF-8 In Less Than
+ * One Instruction Per Byte": each byte and its predecessor are classified
+ * by three nibble lookups whose AND is nonzero for any bad pair, and the
+ * positions where a 3- or 4-byte lead requires continuations are checked
+ * separately. Blocks of pure ASCII skip the lookups.
+ */
+
+#ifdef CSTRING_AVX2
+#define U8_TOO_SHORT        (1 << 0)
+#define U8_TOO_LONG         (1 << 1)
+#define U8_OVERLONG_3       (1 << 2)
+#define U8_TOO_LARGE        (1 << 3)
+#define U8_SURROGATE        (1 << 4)
+#define U8_OVERLONG_2       (1 << 5)
+#define U8_TOO_LARGE_1000   (1 << 6)
+#define U8_OVERLONG_4       (1 << 6)
+#define U8_TWO_CONTS        (1 << 7)
+#define U8_CARRY            (U8_TOO_SHORT | U8_TOO_LONG | U8_TWO_CONTS)
+
+/* input shifted back by n bytes, continuing from the previous block */
+#define U8_PREV(input, prev, n) \
+    _mm256_alignr_epi8((input), _mm256_permute2x128_si256((prev), (input), 0x21), 16 - (n))
+
+#define U8_TABLE(...)       _mm256_setr_epi8(__VA_ARGS__, __VA_ARGS__)
+
+CSTRING_TARGET("avx2")
+static inline __m256i _utf8_check_block(__m256i input, __m256i prev) {
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i byte_1_high_table = U8_TABLE(
+        U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG,
+        U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG,
+        U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS,
+        U8_TOO_SHORT | U8_OVERLONG_2,
+        U8_TOO_SHORT,
+        U8_TOO_SHORT | U8_OVERLONG_3 | U8_SURROGATE,
+        U8_TOO_SHORT | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_OVERLONG_4);
+    const __m256i byte_1_low_table = U8_TABLE(
+        U8_CARRY | U8_OVERLONG_3 | U8_OVERLONG_2 | U8_OVERLONG_4,
+        U8_CARRY | U8_OVERLONG_2,
+        U8_CARRY,
+        U8_CARRY,
+        U8_CARRY | U8_TOO_LARGE,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_SURROGATE,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000);
+    const __m256i byte_2_high_table = U8_TABLE(
+        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT,
+        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 | U8_TOO_LARGE_1000 | U8_OVERLONG_4,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 | U8_TOO_LARGE,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE | U8_TOO_LARGE,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE | U8_TOO_LARGE,
+        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT);
+
+    __m256i prev1 = U8_PREV(input, prev, 1);
+    __m256i byte_1_high = _mm256_shuffle_epi8(byte_1_high_table,
+        _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+    __m256i byte_1_low = _mm256_shuffle_epi8(byte_1_low_table,
+        _mm256_and_si256(prev1, nibble));
+    __m256i byte_2_high = _mm256_shuffle_epi8(byte_2_high_table,
+        _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+    __m256i special = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    /* bytes 2 back from a 3-byte lead or 3 back from a 4-byte lead must be
+     * continuations; `special` has TWO_CONTS set exactly where they are */
+    __m256i third = _mm256_subs_epu8(U8_PREV(input, prev, 2), _mm256_set1_epi8((char)(0xE0 - 0x80)));
+    __m256i fourth = _mm256_subs_epu8(U8_PREV(input, prev, 3), _mm256_set1_epi8((char)(0xF0 - 0x80)));
+    __m256i must_be_cont = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(must_be_cont, special);
+}
+
+CSTRING_TARGET("avx2")
+static Py_ssize_t _utf8_length_avx2(const char *s, Py_ssize_t n, int *ascii) {
+    /* nonzero where the last bytes of a block start an unfinished sequence */
+    const __m256i max_value = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+    const __m256i cont_limit = _mm256_set1_epi8(-64);
+    __m256i prev = _mm256_setzero_si256();
+    __m256i error = _mm256_setzero_si256();
+    __m256i incomplete = _mm256_setzero_si256();
+    Py_ssize_t continuations = 0;
+    int non_ascii = 0;
+
+    /* the last block is zero-padded, and always present, so a sequence
+     * cut off by the end of input is caught like any other */
+    for(Py_ssize_t i = 0;; i += 32) {
+        __m256i input;
+        int last = i + 32 > n;
+        if(last) {
+            char tail[32] = {0};
+            memcpy(tail, s + i, n - i);
+            input = _mm256_loadu_si256((const __m256i *)tail);
+        } else {
+            input = _mm256_loadu_si256((const __m256i *)(s + i));
+        }
+
+        if(_mm256_movemask_epi8(input) == 0) {
+            error = _mm256_or_si256(error, incomplete);
+        } else {
+            non_ascii = 1;
+            error = _mm256_or_si256(error, _utf8_check_block(input, prev));
+            incomplete = _mm256_subs_epu8(input, max_value);
+            continuations += __builtin_popcount(
+                (unsigned int)_mm256_movemask_epi8(_mm256_cmpgt_epi8(cont_limit, input)));
+        }
+        prev = input;
+        if(last)
+            break;
+    }
+
+    *ascii = !non_ascii;
+    if(!_mm256_testz_si256(error, error))
+        return -1;
+    return n - continuations;
+}
+#endif
+
+/*
+ * Returns the number of code points in s[0:n], or -1 if it is not valid
+ * UTF-8. Sets *ascii if every byte is ASCII.
+ */
+static Py_ssize_t _utf8_length(const char *s, Py_ssize_t n, int *ascii) {
+#ifdef CSTRING_AVX2
+    if(_cpu_avx2)
+        return _utf8_length_avx2(s, n, ascii);
+#endif
+    const unsigned char *p = (const unsigned char *)s;
+    Py_ssize_t length = 0;
+    Py_ssize_t i = 0;
+    *ascii = 1;
+    for(;;) {
+        Py_ssize_t run = _find_non_ascii(s + i, n - i);
+        i += run;
+        length += run;
+        if(i == n)
+            return length;
+        *ascii = 0;
+
+        unsigned char c = p[i];
+        unsigned char lo = 0x80, hi = 0xBF;
+        Py_ssize_t need;
+        if(c >= 0xC2 && c <= 0xDF) {
+            need = 1;
+        } else if(c >= 0xE0 && c <= 0xEF) {
+            need = 2;
+            if(c == 0xE0)
+                lo = 0xA0;  /* overlong */
+            else if(c == 0xED)
+                hi = 0x9F;  /* surrogates */
+        } else if(c >= 0xF0 && c <= 0xF4) {
+            need = 3;
+            if(c == 0xF0)
+                lo = 0x90;  /* overlong */
+            else if(c == 0xF4)
+                hi = 0x8F;  /* > U+10FFFF */
+        } else {
+            return -1;
+        }
+        if(n - i <= need)
+            return -1;
+        if(p[i + 1] < lo || p[i + 1] > hi)
+            return -1;
+        for(Py_ssize_t k = 2; k <= need; ++k) {
+            if((p[i + k] & 0xC0) != 0x80)
+                return -1;
+        }
+        i += need + 1;
+        ++length;
+    }
+}
+
+
+/*
+ * Substring search
+ *
+ * All searches are length-bounded and go through struct _search. Needles
+ * of two or more bytes are located with a SIMD filter on their first and
+ * last bytes (SSE2, or AVX2 when the CPU supports it), verifying candidates
+ * with memcmp. If verification work outgrows the scanned length the search
+ * switches to Two-Way for the rest of the haystack, which bounds the worst
+ * case at O(n + m).
+ */
+
+struct _search {
+    const char *needle;
+    Py_ssize_t len;
+    /* Two-Way parameters per direction (0: forward, 1: reverse),
+     * computed on first use */
+    size_t suffix[2];
+    size_t period[2];
+    int periodic[2];
+    /* Horspool shift tables per direction, only set by _search_compile */
+    const uint16_t *shift[2];
+};
+
+#define SEARCH_UNSET            ((size_t)-1)
+
+/* Shortest needle for which _search_compile builds Horspool tables. They
+ * are only built where there is no SIMD filter: measured with SSE2/AVX2,
+ * the filter outruns Horspool even on long needles over random bytes. */
+#define SEARCH_HORSPOOL_MIN     64
+
+
+/* verification cost (in bytes compared) allowed before falling back */
+#define SEARCH_BUDGET(scanned)  (4096 + 4 * (scanned))
+
+static void _search_init(struct _search *s, const char *needle, Py_ssize_t len) {
+    s->needle = needle;
+    s->len = len;
+    s->suffix[0] = s->suffix[1] = SEARCH_UNSET;
+    s->shift[0] = s->shift[1] = NULL;
+}
+
+/* byte i of p (of length len), counted from the right if rev */
+#define TW_AT(p, len, i, rev)   ((unsigned char)((rev) ? (p)[(len) - 1 - (i)] : (p)[(i)]))
+
+/* Critical factorization (Crochemore & Perrin), as in glibc's str-two-way.h */
+static inline size_t _two_way_factorize(const char *needle, size_t m, size_t *period, const int rev) {
+    size_t max_suffix, max_suffix_rev, j, k, p;
+    unsigned char a, b;
+
+    max_suffix = SIZE_MAX;
+    j = 0;
+    k = p = 1;
+    while(j + k < m) {
+        a = TW_AT(needle, m, j + k, rev);
+        b = TW_AT(needle, m, max_suffix + k, rev);
+        if(a < b) {
+            j += k;
+            k = 1;
+            p = j - max_suffix;
+        } else if(a == b) {
+            if(k != p) {
+                ++k;
+            } else {
+                j += p;
+                k = 1;
+            }
+        } else {
+            max_suffix = j++;
+            k = p = 1;
+        }
+    }
+    *period = p;
+
+    max_suffix_rev = SIZE_MAX;
+    j = 0;
+    k = p = 1;
+    while(j + k < m) {
+        a = TW_AT(needle, m, j + k, rev);
+        b = TW_AT(needle, m, max_suffix_rev + k, rev);
+        if(b < a) {
+            j += k;
+            k = 1;
+            p = j - max_suffix_rev;
+        } else if(a == b) {
+            if(k != p) {
+                ++k;
+            } else {
+                j += p;
+                k = 1;
+            }
+        } else {
+            max_suffix_rev = j++;
+            k = p = 1;
+        }
+    }
+
+    if(max_suffix_rev + 1 < max_suffix + 1)
+        return max_suffix + 1;
+    *period = p;
+    return max_suffix_rev + 1;
+}
+
+static inline void _two_way_prepare(struct _search *s, const int rev) {
+    size_t m = s->len;
+    size_t period;
+    size_t suffix = _two_way_factorize(s->needle, m, &period, rev);
+
+    int periodic = 1;
+    for(size_t i = 0; i < suffix; ++i) {
+        if(TW_AT(s->needle, m, i, rev) != TW_AT(s->needle, m, i + period, rev)) {
+            periodic = 0;
+            break;
+        }
+    }
+    if(!periodic)
+        period = Py_MAX(suffix, m - suffix) + 1;
+
+    s->suffix[rev] = suffix;
+    s->period[rev] = period;
+    s->periodic[rev] = periodic;
+}
+
+/* Two-Way search; with rev, both strings are indexed from the right and the
+ * rightmost match is returned. */
+static inline const char *_two_way(struct _search *s, const char *hay, Py_ssize_t len, const int rev) {
+    const char *needle = s->needle;
+    size_t m = s->len;
+    size_t n = len;
+    size_t i, j;
+
+    if(len < s->len)
+        return NULL;
+    if(s->suffix[rev] == SEARCH_UNSET)
+        _two_way_prepare(s, rev);
+
+    size_t suffix = s->suffix[rev];
+    size_t period = s->period[rev];
+
+    j = 0;
+    if(s->periodic[rev]) {
+        size_t memory = 0;
+        while(j <= n - m) {
+            i = Py_MAX(suffix, memory);
+            while(i < m && TW_AT(needle, m, i, rev) == TW_AT(hay, n, i + j, rev))
+                ++i;
+            if(m <= i) {
+                i = suffix - 1;
+                while(memory < i + 1 && TW_AT(needle, m, i, rev) == TW_AT(hay, n, i + j, rev))
+                    --i;
+                if(i + 1 < memory + 1)
+                    goto found;
+                j += period;
+                memory = m - period;
+            } else {
+                j += i - suffix + 1;
+                memory = 0;
+            }
+        }
+    } else {
+        while(j <= n - m) {
+            i = suffix;
+            while(i < m && TW_AT(needle, m, i, rev) == TW_AT(hay, n, i + j, rev))
+                ++i;
+            if(m <= i) {
+                i = suffix - 1;
+                while(i != SIZE_MAX && TW_AT(needle, m, i, rev) == TW_AT(hay, n, i + j, rev))
+                    --i;
+                if(i == SIZE_MAX)
+                    goto found;
+                j += period;
+            } else {
+                j += i - suffix + 1;
+            }
+        }
+    }
+    return NULL;
+
+found:
+    return rev ? hay + (n - m - j) : hay + j;
+}
+
+static const char *_search_find_two_way(struct _search *s, const char *hay, Py_ssize_t n) {
+    return _two_way(s, hay, n, 0);
+}
+
+static const char *_search_rfind_two_way(struct _search *s, const char *hay, Py_ssize_t n) {
+    return _two_way(s, hay, n, 1);
+}
+
+/* Candidate filter on the first byte (memchr) and last byte. */
+static const char *_search_find_scalar(struct _search *s, const char *hay, Py_ssize_t n) {
+    const char *needle = s->needle;
+    Py_ssize_t m = s->len;
+    const char *p = hay;
+    const char *end = hay + n - m + 1;
+    Py_ssize_t cost = 0;
+
+    while(p < end) {
+        p = memchr(p, needle[0], end - p);
+        if(!p)
+            return NULL;
+        if(p[m - 1] == needle[m - 1]) {
+            if(memcmp(p + 1, needle + 1, m - 2) == 0)
+                return p;
+            cost += m;
+        }
+        ++p;
+        if(cost > SEARCH_BUDGET(p - hay))
+            return _search_find_two_way(s, p, hay + n - p);
+    }
+    return NULL;
+}
+
+static const char *_search_rfind_scalar(struct _search *s, const char *hay, Py_ssize_t n) {
+    const char *needle = s->needle;
+    Py_ssize_t m = s->len;
+    Py_ssize_t i = n - m;
+    Py_ssize_t cost = 0;
+
+    while(i >= 0) {
+        const char *p = _memrchr(hay, needle[0], i + 1);
+        if(!p)
+            return NULL;
+        i = p - hay;
+        if(p[m - 1] == needle[m - 1]) {
+            if(memcmp(p + 1, needle + 1, m - 2) == 0)
+                return p;
+            cost += m;
+        }
+        --i;
+        if(cost > SEARCH_BUDGET(n - m - i))
+            return _search_rfind_two_way(s, hay, i + m);
+    }
+    return NULL;
+}
+
+#ifdef CSTRING_SSE2
+static const char *_search_find_sse2(struct _search *s, const char *hay, Py_ssize_t n) {
+    const char *needle = s->needle;
+    Py_ssize_t m = s->len;
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[m - 1]);
+    Py_ssize_t cost = 0;
+    Py_ssize_t i = 0;
+
+    for(; i + 16 <= n - m + 1; i += 16) {
+        __m128i bf = _mm_loadu_si128((const __m128i *)(hay + i));
+        __m128i bl = _mm_loadu_si128((const __m128i *)(hay + i + m - 1));
+        unsigned int mask = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, bf), _mm_cmpeq_epi8(last, bl)));
+        while(mask) {
+            int bit = _ctz(mask);
+            if(memcmp(hay + i + bit + 1, needle + 1, m - 2) == 0)
+                return hay + i + bit;
+            cost += m;
+            mask &= mask - 1;
+        }
+        if(cost > SEARCH_BUDGET(i))
+            return _search_find_two_way(s, hay + i + 16, n - i - 16);
+    }
+
+    return _search_find_scalar(s, hay + i, n - i);
+}
+
+static const char *_search_rfind_sse2(struct _search *s, const char *hay, Py_ssize_t n) {
+    const char *needle = s->needle;
+    Py_ssize_t m = s->len;
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[m - 1]);
+    Py_ssize_t cost = 0;
+    Py_ssize_t i = n - m - 15;
+
+    for(; i >= 0; i -= 16) {
+        __m128i bf = _mm_loadu_si128((const __m128i *)(hay + i));
+        __m128i bl = _mm_loadu_si128((const __m128i *)(hay + i + m - 1));
+        unsigned int mask = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, bf), _mm_cmpeq_epi8(last, bl)));
+        while(mask) {
+            int bit = _bsr(mask);
+            if(memcmp(hay + i + bit + 1, needle + 1, m - 2) == 0)
+                return hay + i + bit;
+            cost += m;
+            mask &= ~(1u << bit);
+        }
+        if(cost > SEARCH_BUDGET(n - m - i))
+            return _search_rfind_two_way(s, hay, i + m - 1);
+    }
+
+    return _search_rfind_scalar(s, hay, i + 15 + m);
+}
+#endif
+
+#ifdef CSTRING_AVX2
+CSTRING_TARGET("avx2")
+static const char *_search_find_avx2(struct _search *s, const char *hay, Py_ssize_t n) {
+    const char *needle = s->needle;
+    Py_ssize_t m = s->len;
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[m - 1]);
+    Py_ssize_t cost = 0;
+    Py_ssize_t i = 0;
+
+    for(; i + 32 <= n - m + 1; i += 32) {
+        __m256i bf = _mm256_loadu_si256((const __m256i *)(hay + i));
+        __m256i bl = _mm256_loadu_si256((const __m256i *)(hay + i + m - 1));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(first, bf), _mm256_cmpeq_epi8(last, bl)));
+        while(mask) {
+            int bit = _ctz(mask);
+            if(memcmp(hay + i + bit + 1, needle + 1, m - 2) == 0)
+                return hay + i + bit;
+            cost += m;
+            mask &= mask - 1;
+        }
+        if(cost > SEARCH_BUDGET(i))
+            return _search_find_two_way(s, hay + i + 32, n - i - 32);
+    }
+
+    return _search_find_sse2(s, hay + i, n - i);
+}
+
+CSTRING_TARGET("avx2")
+static const char *_search_rfind_avx2(struct _search *s, const char *hay, Py_ssize_t n) {
+    const char *needle = s->needle;
+    Py_ssize_t m = s->len;
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[m - 1]);
+    Py_ssize_t cost = 0;
+    Py_ssize_t i = n - m - 31;
+
+    for(; i >= 0; i -= 32) {
+        __m256i bf = _mm256_loadu_si256((const __m256i *)(hay + i));
+        __m256i bl = _mm256_loadu_si256((const __m256i *)(hay + i + m - 1));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(first, bf), _mm256_cmpeq_epi8(last, bl)));
+        while(mask) {
+            int bit = _bsr(mask);
+            if(memcmp(hay + i + bit + 1, needle + 1, m - 2) == 0)
+                return hay + i + bit;
+            cost += m;
+            mask &= ~(1u << bit);
+        }
+        if(cost > SEARCH_BUDGET(n - m - i))
+            return _search_rfind_two_way(s, hay, i + m - 1);
+    }
+
+    return _search_rfind_sse2(s, hay, i + 31 + m);
+}
+#endif
+
+/* Horspool: skip on the byte under the needle's last (or, reversed, first)
+ * position. Only used for long needles, where skips beat the SIMD filter. */
+static const char *_search_find_horspool(struct _search *s, const char *hay, Py_ssize_t n) {
+    const unsigned char *h = (const unsigned char *)hay;
+    const char *needle = s->needle;
+    const uint16_t *shift = s->shift[0];
+    Py_ssize_t m = s->len;
+    unsigned char last = needle[m - 1];
+    Py_ssize_t cost = 0;
+    Py_ssize_t i = 0;
+
+    while(i <= n - m) {
+        unsigned char c = h[i + m - 1];
+        if(c == last) {
+            if(memcmp(hay + i, needle, m - 1) == 0)
+                return hay + i;
+            cost += m;
+            if(cost > SEARCH_BUDGET(i))
+                return _search_find_two_way(s, hay + i + 1, n - i - 1);
+        }
+        i += shift[c];
+    }
+    return NULL;
+}
+
+static const char *_search_rfind_horspool(struct _search *s, const char *hay, Py_ssize_t n) {
+    const unsigned char *h = (const unsigned char *)hay;
+    const char *needle = s->needle;
+    const uint16_t *shift = s->shift[1];
+    Py_ssize_t m = s->len;
+    unsigned char first = needle[0];
+    Py_ssize_t cost = 0;
+    Py_ssize_t i = n - m;
+
+    while(i >= 0) {
+        unsigned char c = h[i];
+        if(c == first) {
+            if(memcmp(hay + i + 1, needle + 1, m - 1) == 0)
+                return hay + i;
+            cost += m;
+            if(cost > SEARCH_BUDGET(n - m - i))
+                return _search_rfind_two_way(s, hay, i - 1 + m);
+        }
+        i -= shift[c];
+    }
+    return NULL;
+}
+
+#ifndef CSTRING_SSE2
+static void _horspool_compile(struct _search *s, uint16_t tables[2][256]) {
+    const unsigned char *needle = (const unsigned char *)s->needle;
+    Py_ssize_t m = s->len;
+    uint16_t maxshift = (uint16_t)Py_MIN(m, UINT16_MAX);
+    for(int c = 0; c < 256; ++c)
+        tables[0][c] = tables[1][c] = maxshift;
+    for(Py_ssize_t k = 0; k < m - 1; ++k)
+        tables[0][needle[k]] = (uint16_t)Py_MIN(m - 1 - k, UINT16_MAX);
+    for(Py_ssize_t k = m - 1; k > 0; --k)
+        tables[1][needle[k]] = (uint16_t)Py_MIN(k, UINT16_MAX);
+
+    s->shift[0] = tables[0];
+    s->shift[1] = tables[1];
+}
+#endif
+
+/*
+ * Precompute everything a search can use, for patterns that are searched
+ * many times. `tables` must stay valid as long as s is used.
+ */
+static void _search_compile(struct _search *s, uint16_t tables[2][256]) {
+    if(s->len < 2)
+        return;
+
+    _two_way_prepare(s, 0);
+    _two_way_prepare(s, 1);
+
+#ifndef CSTRING_SSE2
+    if(s->len >= SEARCH_HORSPOOL_MIN)
+        _horspool_compile(s, tables);
+#endif
+}
+
+/* Leftmost match of s in hay[0:n], or NULL. */
+static const char *_search_find(struct _search *s, const char *hay, Py_ssize_t n) {
+    Py_ssize_t m = s->len;
+    if(m == 0)
+        return hay;
+    if(m > n)
+        return NULL;
+    if(m == 1)
+        return memchr(hay, s->needle[0], n);
+    if(s->shift[0])
+        return _search_find_horspool(s, hay, n);
+#ifdef CSTRING_AVX2
+    if(_cpu_avx2)
+        return _search_find_avx2(s, hay, n);
+#endif
+#ifdef CSTRING_SSE2
+    return _search_find_sse2(s, hay, n);
+#else
+    return _search_find_scalar(s, hay, n);
+#endif
+}
+
+/* Rightmost match of s in hay[0:n], or NULL. */
+static const char *_search_rfind(struct _search *s, const char *hay, Py_ssize_t n) {
+    Py_ssize_t m = s->len;
+    if(m == 0)
+        return hay + n;
+    if(m > n)
+        return NULL;
+    if(m == 1)
+        return _memrchr(hay, s->needle[0], n);
+    if(s->shift[1])
+        return _search_rfind_horspool(s, hay, n);
+#ifdef CSTRING_AVX2
+    if(_cpu_avx2)
+        return _search_rfind_avx2(s, hay, n);
+#endif
+#ifdef CSTRING_SSE2
+    return _search_rfind_sse2(s, hay, n);
+#else
+    return _search_rfind_scalar(s, hay, n);
+#endif
+}
+
+/* Number of non-overlapping matches of s in hay[0:n]. */
+static Py_ssize_t _search_count(struct _search *s, const char *hay, Py_ssize_t n) {
+    if(s->len == 0)
+        return n + 1;
+    if(s->len == 1)
+        return _count_byte(hay, n, s->needle[0]);
+
+    Py_ssize_t count = 0;
+    const char *end = hay + n;
+    const char *p = hay;
+    while((p = _search_find(s, p, end - p)) != NULL) {
+        ++count;
+        p += s->len;
+    }
+    return count;
+}
+
+static const char *_memmem(const char *s, Py_ssize_t n, const char *find, Py_ssize_t m) {
+    struct _search search;
+    _search_init(&search, find, m);
+    return _search_find(&search, s, n);
+}
+
+static const char *_memrmem(const char *s, Py_ssize_t n, const char *find, Py_ssize_t m) {
+    struct _search search;
+    _search_init(&search, find, m);
+    return _search_rfind(&search, s, n);
+}
+
+
+/*
+ * Large inputs
+ *
+ * cstrings are immutable, so kernels over their bytes don't need the GIL:
+ * scans of at least ALLOW_THREADS_MIN bytes release it. Scans of at least
+ * PARALLEL_MIN bytes are also split into chunks, one per thread, run by a
+ * small pool of worker threads and the calling thread. Workers only run
+ * the C kernels below, on memory the caller keeps alive and unchanged;
+ * they never touch Python objects.
+ */
+
+#define ALLOW_THREADS_MIN   (64 * 1024)
+#define PARALLEL_MIN        (8 * 1024 * 1024)
+#define PARALLEL_CHUNK_MIN  (2 * 1024 * 1024)   /* bytes per thread */
+#define POOL_MAX_THREADS    8                   /* including the caller */
+
+/* Like Py_BEGIN/END_ALLOW_THREADS, but only for scans of n >= ALLOW_THREADS_MIN bytes. */
+#define CSTRING_BEGIN_ALLOW_THREADS(n) \
+    { PyThreadState *_save = (n) >= ALLOW_THREADS_MIN ? PyEval_SaveThread() : NULL;
+#define CSTRING_END_ALLOW_THREADS \
+    if(_save) PyEval_RestoreThread(_save); }
+
+struct _pool_worker {
+    PyThread_type_lock wake;    /* released to start the task */
+    PyThread_type_lock done;    /* released when the task has run */
+    void (*run)(void *);
+    void *arg;
+};
+
+static struct _pool_worker pool_WORKERS[POOL_MAX_THREADS - 1];
+static int pool_STARTED = 0;
+static int pool_THREADS = 1;        /* see set_threads */
+/* held while a job runs; a job that can't get it runs serially instead */
+static PyThread_type_lock pool_LOCK = NULL;
+
+static void _pool_worker_main(void *arg) {
+    struct _pool_worker *w = arg;
+    for(;;) {
+        PyThread_acquire_lock(w->wake, WAIT_LOCK);
+        w->run(w->arg);
+        PyThread_release_lock(w->done);
+    }
+}
+
+static int _pool_start_worker(struct _pool_worker *w) {
+    w->wake = PyThread_allocate_lock();
+    w->done = PyThread_allocate_lock();
+    if(!w->wake || !w->done)
+        goto fail;
+    /* both start out taken */
+    PyThread_acquire_lock(w->wake, WAIT_LOCK);
+    PyThread_acquire_lock(w->done, WAIT_LOCK);
+    if(PyThread_start_new_thread(_pool_worker_main, w) == PYTHREAD_INVALID_THREAD_ID)
+        goto fail;
+    return 0;
+
+fail:
+    if(w->wake)
+        PyThread_free_lock(w->wake);
+    if(w->done)
+        PyThread_free_lock(w->done);
+    return -1;
+}
+
+/*
+ * Number of threads to split a scan of n bytes across. If more than one,
+ * the pool is reserved for the caller until _pool_release.
+ */
+static int _pool_acquire(Py_ssize_t n) {
+    int threads = (int)Py_MIN(pool_THREADS, n / PARALLEL_CHUNK_MIN);
+    if(n < PARALLEL_MIN || threads < 2 || !pool_LOCK)
+        return 1;
+    if(!PyThread_acquire_lock(pool_LOCK, NOWAIT_LOCK))
+        return 1;
+    while(pool_STARTED < threads - 1 && _pool_start_worker(&pool_WORKERS[pool_STARTED]) == 0)
+        ++pool_STARTED;
+    threads = Py_MIN(threads, pool_STARTED + 1);
+    if(threads < 2)
+        PyThread_release_lock(pool_LOCK);
+    return threads;
+}
+
+static void _pool_release(void) {
+    PyThread_release_lock(pool_LOCK);
+}
+
+#ifdef POOL_AT_FORK
+/* the workers don't exist in a forked child */
+static void _pool_after_fork_child(void) {
+    pool_STARTED = 0;
+    pool_LOCK = PyThread_allocate_lock();
+}
+#endif
+
+PyDoc_STRVAR(set_threads__doc__, "");
+static PyObject *cstring_set_threads(PyObject *module, PyObject *const *args, Py_ssize_t nargs) {
+    int threads;
+    if(_check_nargs("set_threads", nargs, 1, 1) < 0 || _arg_int(args[0], &threads) < 0)
+        return NULL;
+    if(threads < 1) {
+        PyErr_SetString(PyExc_ValueError, "threads must be at least 1");
+        return NULL;
+    }
+    int previous = pool_THREADS;
+    pool_THREADS = Py_MIN(threads, POOL_MAX_THREADS);
+    return PyLong_FromLong(previous);
+}
+
+/* Default thread count: one per CPU, up to POOL_MAX_THREADS. */
+static int _pool_init(void) {
+    pool_LOCK = PyThread_allocate_lock();
+    if(!pool_LOCK)
+        return -1;
+#ifdef POOL_AT_FORK
+    pthread_atfork(NULL, NULL, _pool_after_fork_child);
+#endif
+    PyObject *os = PyImport_ImportModule("os");
+    PyObject *cpus = os ? PyObject_CallMethod(os, "cpu_count", NULL) : NULL;
+    Py_XDECREF(os);
+    if(!cpus)
+        return -1;
+    long count = cpus == Py_None ? 1 : PyLong_AsLong(cpus);
+    Py_DECREF(cpus);
+    if(count == -1 && PyErr_Occurred())
+        return -1;
+    pool_THREADS = (int)Py_MAX(1, Py_MIN(count, POOL_MAX_THREADS));
+    return 0;
+}
+
+/* Runs run(tasks + i * size) for i < threads, from _pool_acquire. */
+static void _pool_run(int threads, void (*run)(void *), void *tasks, size_t size) {
+    for(int i = 1; i < threads; ++i) {
+        pool_WORKERS[i - 1].run = run;
+        pool_WORKERS[i - 1].arg = (char *)tasks + i * size;
+        PyThread_release_lock(pool_WORKERS[i - 1].wake);
+    }
+    run(tasks);
+    for(int i = 1; i < threads; ++i)
+        PyThread_acquire_lock(pool_WORKERS[i - 1].done, WAIT_LOCK);
+}
+
+/* Splits s[0:n] into `threads` chunks, returning chunk i's start.
+ * With utf8, chunks start on a code point (unless the text is invalid). */
+static Py_ssize_t _pool_chunk_start(const char *s, Py_ssize_t n, int threads, int i, int utf8) {
+    Py_ssize_t start = n / threads * i;
+    if(utf8 && i > 0) {
+        for(int k = 0; k < 3 && start < n && ((unsigned char)s[start] & 0xC0) == 0x80; ++k)
+            ++start;
+    }
+    return start;
+}
+
+/*
+ * Counting in parallel: each chunk counts, greedily, the matches that
+ * start inside it. A chunk's count is only right if the scan of the chunk
+ * before it doesn't end with a match running into it; otherwise the chunk
+ * is rescanned from the end of that match until it meets one of the
+ * chunk's own matches, after which the two scans agree.
+ */
+
+#define COUNT_SYNC_MAX      8   /* matches kept per chunk to sync a rescan with */
+
+struct _count_task {
+    struct _search search;
+    const char *start;      /* matches starting in [start, stop) ... */
+    const char *stop;
+    const char *end;        /* ... and ending by end */
+    Py_ssize_t count;
+    const char *first[COUNT_SYNC_MAX];
+    const char *last;       /* end of the last match, or NULL */
+};
+
+static void _count_task_run(void *arg) {
+    struct _count_task *t = arg;
+    Py_ssize_t m = t->search.len;
+    const char *end = Py_MIN(t->stop + m - 1, t->end);
+    const char *p = t->start;
+    const char *q;
+    t->count = 0;
+    t->last = NULL;
+    while(p < t->stop && (q = _search_find(&t->search, p, end - p)) != NULL) {
+        if(t->count < COUNT_SYNC_MAX)
+            t->first[t->count] = q;
+        ++t->count;
+        p = t->last = q + m;
+    }
+}
+
+static Py_ssize_t _search_count_parallel(struct _search *s, const char *hay, Py_ssize_t n) {
+    int threads = s->len > 0 ? _pool_acquire(n) : 1;
+    if(threads < 2)
+        return _search_count(s, hay, n);
+
+    struct _count_task tasks[POOL_MAX_THREADS];
+    for(int i = 0; i < threads; ++i) {
+        tasks[i].search = *s;
+        tasks[i].start = hay + _pool_chunk_start(hay, n, threads, i, 0);
+        tasks[i].stop = hay + (i + 1 < threads ? _pool_chunk_start(hay, n, threads, i + 1, 0) : n);
+        tasks[i].end = hay + n;
+    }
+    _pool_run(threads, _count_task_run, tasks, sizeof(*tasks));
+    _pool_release();
+
+    Py_ssize_t m = s->len;
+    Py_ssize_t count = 0;
+    const char *pos = hay;  /* where the next match may start */
+    for(int i = 0; i < threads; ++i) {
+        struct _count_task *t = &tasks[i];
+        if(pos <= t->start) {
+            count += t->count;
+            if(t->last)
+                pos = t->last;
+            continue;
+        }
+
+        const char *end = Py_MIN(t->stop + m - 1, t->end);
+        Py_ssize_t kept = Py_MIN(t->count, COUNT_SYNC_MAX);
+        Py_ssize_t k = 0;
+        const char *q;
+        while(pos < t->stop && (q = _search_find(s, pos, end - pos)) != NULL) {
+            while(k < kept && t->first[k] < q)
+                ++k;
+            if(k < kept && t->first[k] == q) {
+                count += t->count - k;
+                pos = t->last;
+                break;
+            }
+            ++count;
+            pos = q + m;
+        }
+    }
+    return count;
+}
+
+/*
+ * find and rfind go through the text in rounds of one chunk per thread,
+ * nearest chunks first, so that a match near the start costs no more than
+ * a serial search would.
+ */
+
+struct _find_task {
+    struct _search search;
+    const char *start;      /* matches starting in [start, stop) */
+    const char *stop;
+    const char *end;
+    int reverse;
+    const char *result;
+};
+
+static void _find_task_run(void *arg) {
+    struct _find_task *t = arg;
+    const char *end = Py_MIN(t->stop + t->search.len - 1, t->end);
+    t->result = t->start >= t->stop ? NULL
+        : t->reverse ? _search_rfind(&t->search, t->start, end - t->start)
+        : _search_find(&t->search, t->start, end - t->start);
+}
+
+static const char *_search_find_rounds(struct _search *s, const char *hay, Py_ssize_t n, int reverse) {
+    int threads = s->len > 1 ? _pool_acquire(n) : 1;
+    if(threads < 2)
+        return reverse ? _search_rfind(s, hay, n) : _search_find(s, hay, n);
+
+    struct _find_task tasks[POOL_MAX_THREADS];
+    const char *result = NULL;
+    Py_ssize_t round = (Py_ssize_t)PARALLEL_CHUNK_MIN * threads;
+    for(Py_ssize_t done = 0; done < n && !result; done += round) {
+        for(int i = 0; i < threads; ++i) {
+            Py_ssize_t a = Py_MIN(done + (Py_ssize_t)PARALLEL_CHUNK_MIN * i, n);
+            Py_ssize_t b = Py_MIN(a + PARALLEL_CHUNK_MIN, n);
+            tasks[i].search = *s;
+            tasks[i].start = reverse ? hay + n - b : hay + a;
+            tasks[i].stop = reverse ? hay + n - a : hay + b;
+            tasks[i].end = hay + n;
+            tasks[i].reverse = reverse;
+        }
+        _pool_run(threads, _find_task_run, tasks, sizeof(*tasks));
+        for(int i = 0; i < threads && !result; ++i)
+            result = tasks[i].result;
+    }
+    _pool_release();
+    return result;
+}
+
+static const char *_search_find_parallel(struct _search *s, const char *hay, Py_ssize_t n) {
+    return _search_find_rounds(s, hay, n, 0);
+}
+
+static const char *_search_rfind_parallel(struct _search *s, const char *hay, Py_ssize_t n) {
+    return _search_find_rounds(s, hay, n, 1);
+}
+
+/* UTF-8 validation: chunks start on code points, so each checks alone. */
+
+struct _utf8_task {
+    const char *s;
+    Py_ssize_t n;
+    Py_ssize_t length;
+    int ascii;
+};
+
+static void _utf8_task_run(void *arg) {
+    struct _utf8_task *t = arg;
+    t->length = _utf8_length(t->s, t->n, &t->ascii);
+}
+
+static Py_ssize_t _utf8_length_parallel(const char *s, Py_ssize_t n, int *ascii) {
+    int threads = _pool_acquire(n);
+    if(threads < 2)
+        return _utf8_length(s, n, ascii);
+
+    struct _utf8_task tasks[POOL_MAX_THREADS];
+    for(int i = 0; i < threads; ++i) {
+        Py_ssize_t start = _pool_chunk_start(s, n, threads, i, 1);
+        Py_ssize_t stop = i + 1 < threads ? _pool_chunk_start(s, n, threads, i + 1, 1) : n;
+        tasks[i].s = s + start;
+        tasks[i].n = stop - start;
+    }
+    _pool_run(threads, _utf8_task_run, tasks, sizeof(*tasks));
+    _pool_release();
+
+    Py_ssize_t length = 0;
+    *ascii = 1;
+    for(int i = 0; i < threads; ++i) {
+        *ascii &= tasks[i].ascii;
+        if(length >= 0)
+            length = tasks[i].length < 0 ? -1 : length + tasks[i].length;
+    }
+    return length;
+}
+
+struct _case_task {
+    char *d;
+    const char *s;
+    Py_ssize_t n;
+    enum _case_op op;
+};
+
+static void _case_task_run(void *arg) {
+    struct _case_task *t = arg;
+    _ascii_case(t->d, t->s, t->n, t->op);
+}
+
+static void _ascii_case_parallel(char *d, const char *s, Py_ssize_t n, enum _case_op op) {
+    int threads = _pool_acquire(n);
+    if(threads < 2) {
+        _ascii_case(d, s, n, op);
+        return;
+    }
+
+    struct _case_task tasks[POOL_MAX_THREADS];
+    for(int i = 0; i < threads; ++i) {
+        Py_ssize_t start = _pool_chunk_start(s, n, threads, i, 0);
+        Py_ssize_t stop = i + 1 < threads ? _pool_chunk_start(s, n, threads, i + 1, 0) : n;
+        tasks[i].d = d + start;
+        tasks[i].s = s + start;
+        tasks[i].n = stop - start;
+        tasks[i].op = op;
+    }
+    _pool_run(threads, _case_task_run, tasks, sizeof(*tasks));
+    _pool_release();
+}
+
+
+struct cstring {
+    PyObject_VAR_HEAD
+    Py_hash_t hash;
+    int flags;
+    Py_ssize_t length;  /* code points; valid if flags has META and VALID */
+    char value[];
+};
+
+/*
+ * View mode: the object borrows its bytes from `base` instead of storing
+ * them inline. The initial members are shared with struct cstring, so the
+ * header macros work on either layout. A view is not zero-terminated.
+ */
+struct cstring_view {
+    PyObject_VAR_HEAD
+    Py_hash_t hash;
+    int flags;
+    Py_ssize_t length;
+    PyObject *base;
+    char *data;
+};
+
+#define CSTRING_FLAG_VIEW           0x01
+/* text metadata, computed at construction or on first use */
+#define CSTRING_FLAG_META           0x02    /* VALID, ASCII and length are known */
+#define CSTRING_FLAG_VALID          0x04    /* well-formed UTF-8 */
+#define CSTRING_FLAG_ASCII          0x08
+#define CSTRING_META_MASK           (CSTRING_FLAG_META | CSTRING_FLAG_VALID | CSTRING_FLAG_ASCII)
+#define CSTRING_FLAG_INDEXED        0x10    /* has an entry in cstring_CHAR_INDEXES */
+#define CSTRING_FLAG_INTERNED       0x20    /* the canonical instance in cstring_INTERNED */
+#define CSTRING_FLAG_STR_HASH       0x40    /* cached hash is str-compatible */
+
+static PyTypeObject cstring_type;
+
+#define CSTRING_HASH(self)          (((struct cstring *)self)->hash)
+#define CSTRING_FLAGS(self)         (((struct cstring *)self)->flags)
+#define CSTRING_IS_VIEW(self)       (CSTRING_FLAGS(self) & CSTRING_FLAG_VIEW)
+#define CSTRING_LENGTH(self)        (((struct cstring *)self)->length)
+#define CSTRING_VIEW_BASE(self)     (((struct cstring_view *)self)->base)
+#define CSTRING_VALUE(self)         (CSTRING_IS_VIEW(self) \
+                                        ? ((struct cstring_view *)self)->data \
+                                        : ((struct cstring *)self)->value)
+#define CSTRING_VALUE_AT(self, i)   (&CSTRING_VALUE(self)[(i)])
+#define CSTRING_END(self)           (CSTRING_VALUE_AT(self, Py_SIZE(self) - 1))
+#define CSTRING_LAST_BYTE(self)     (CSTRING_VALUE(self)[Py_SIZE(self) - 1])
+
+#define CSTRING_ALLOC(tp, len)      (_cstring_alloc((tp), (len)))
+
+/* number of items to request from tp_alloc to fit struct cstring_view */
+#define CSTRING_VIEW_ITEMS          (sizeof(struct cstring_view) - offsetof(struct cstring, value))
+
+/* singleton, initialized in cstring_new_empty (called at import) */
+static const struct cstring *cstring_EMPTY = NULL;
+
+/*
+ * Free lists for short compact strings of exact type cstring, one per
+ * size class of FREELIST_CLASS_SIZE bytes (counting the zero-byte). The
+ * memory of such objects is always rounded up to the end of their class,
+ * so any object on a list can take any size in the class.
+ */
+#ifndef Py_GIL_DISABLED
+#define CSTRING_FREELISTS
+#endif
+
+#define FREELIST_CLASS_SIZE     8
+#define FREELIST_CLASSES        8       /* sizes up to 64 */
+#define FREELIST_MAX_LENGTH     256     /* objects kept per class */
+
+#define FREELIST_CLASS(size)    (((size) - 1) / FREELIST_CLASS_SIZE)
+
+#ifdef CSTRING_FREELISTS
+static struct {
+    struct cstring *head;   /* linked through ob_type of free objects */
+    int length;
+} cstring_FREELISTS[FREELIST_CLASSES];
+#endif
+
+/*
+ * Instrumentation: event counters, compiled in only if CSTRING_STATS is
+ * defined (setup.py defines it if the CSTRING_STATS environment variable
+ * is set) and read with cstring._stats(). Counters are bumped with relaxed
+ * atomic adds, since some events happen without the GIL.
+ */
+#define STATS_ALLOC_CLASSES     7
+
+enum _stats_search {
+    STATS_SEARCH_COUNT,
+    STATS_SEARCH_FIND,          /* find, index */
+    STATS_SEARCH_RFIND,         /* rfind, rindex */
+    STATS_SEARCH_CONTAINS,
+    STATS_SEARCH_SPLIT,         /* the split family */
+    STATS_SEARCH_PARTITION,     /* partition, rpartition */
+    STATS_SEARCH_REPLACE,
+    STATS_SEARCH_CASE_MAP,
+    STATS_SEARCH_FINDER,
+    STATS_SEARCH_MULTIFINDER,
+    STATS_SEARCH_ARRAY,
+    STATS_SEARCH_KINDS,
+};
+
+#ifdef CSTRING_STATS
+static const char *const stats_ALLOC_CLASS_NAMES[STATS_ALLOC_CLASSES] = {
+    "8", "64", "512", "4K", "64K", "1M", "larger"};
+static const char *const stats_SEARCH_NAMES[STATS_SEARCH_KINDS] = {
+    "count", "find", "rfind", "contains", "split", "partition", "replace",
+    "case_map", "Finder", "MultiFinder", "Array.find"};
+
+static struct {
+    Py_ssize_t allocs[STATS_ALLOC_CLASSES];     /* by size, including the zero-byte */
+    Py_ssize_t views;
+    Py_ssize_t reallocs;
+    Py_ssize_t realloc_bytes;                   /* new sizes */
+    Py_ssize_t bytes_copied;                    /* into new strings */
+    Py_ssize_t freelist_hits;                   /* allocations served from a free list */
+    Py_ssize_t freelist_misses;
+    Py_ssize_t hash_computed;
+    Py_ssize_t hash_cached;
+    Py_ssize_t empty_singleton;
+    Py_ssize_t byte_singleton;
+    Py_ssize_t searches[STATS_SEARCH_KINDS];    /* calls into the search kernels */
+} cstring_STATS;
+
+#if defined(__GNUC__) || defined(__clang__)
+#define STATS_ADD(counter, n)   ((void)__atomic_fetch_add(&cstring_STATS.counter, (Py_ssize_t)(n), __ATOMIC_RELAXED))
+#else
+#define STATS_ADD(counter, n)   ((void)(cstring_STATS.counter += (n)))
+#endif
+
+static int _stats_alloc_class(Py_ssize_t size) {
+    static const Py_ssize_t limits[STATS_ALLOC_CLASSES - 1] = {
+        8, 64, 512, 4096, 65536, 1048576};
+    int class = 0;
+    while(class < STATS_ALLOC_CLASSES - 1 && size > limits[class])
+        ++class;
+    return class;
+}
+#else
+#define STATS_ADD(counter, n)   ((void)0)
+#endif
+
+#define STATS_INC(counter)      STATS_ADD(counter, 1)
+#define STATS_SEARCH(kind)      STATS_INC(searches[STATS_SEARCH_##kind])
+
+/* bytes of memory for a compact cstring with `size` items */
+static size_t _cstring_mem_size(Py_ssize_t size) {
+    if(size <= FREELIST_CLASSES * FREELIST_CLASS_SIZE)
+        size = (FREELIST_CLASS(size) + 1) * FREELIST_CLASS_SIZE;
+    return sizeof(struct cstring) + size;
+}
+
+static struct cstring *_cstring_alloc(PyTypeObject *type, Py_ssize_t size) {
+    struct cstring *new;
+    if(type != &cstring_type) {
+        new = (struct cstring *)type->tp_alloc(type, size);
+    } else {
+#ifdef CSTRING_FREELISTS
+        if(size <= FREELIST_CLASSES * FREELIST_CLASS_SIZE) {
+            int class = FREELIST_CLASS(size);
+            new = cstring_FREELISTS[class].head;
+            if(new) {
+                cstring_FREELISTS[class].head = (struct cstring *)Py_TYPE(new);
+                cstring_FREELISTS[class].length--;
+                STATS_INC(freelist_hits);
+                PyObject_InitVar((PyVarObject *)new, type, size);
+                goto init;
+            }
+            STATS_INC(freelist_misses);
+        }
+#endif
+        new = PyObject_Malloc(_cstring_mem_size(size));
+        if(!new)
+            return (struct cstring *)PyErr_NoMemory();
+        PyObject_InitVar((PyVarObject *)new, type, size);
+    }
+    if(!new)
+        return NULL;
+#ifdef CSTRING_FREELISTS
+init:
+#endif
+    STATS_INC(allocs[_stats_alloc_class(size)]);
+    new->hash = -1;
+    new->flags = 0;
+    CSTRING_LAST_BYTE(new) = '\0';
+    return new;
+}
+
+static void *_bad_argument_type(PyObject *o) {
+    PyErr_Format(
+        PyExc_TypeError,
+        "Bad argument type: %s",
+        Py_TYPE(o)->tp_name);
+    return NULL;
+}
+
+static PyObject *_cstring_new(PyTypeObject *type, const char *value, Py_ssize_t len) {
+    struct cstring *new = CSTRING_ALLOC(type, len + 1);
+    if(!new)
+        return NULL;
+    memcpy(new->value, value, len);
+    STATS_ADD(bytes_copied, len);
+    return (PyObject *)new;
+}
+
+/*
+ * Without the GIL (free-threaded builds), flags of objects other threads
+ * can see are only changed inside a critical section on the object.
+ */
+#ifndef Py_BEGIN_CRITICAL_SECTION
+#define Py_BEGIN_CRITICAL_SECTION(op)   {
+#define Py_END_CRITICAL_SECTION()       }
+#endif
+
+static void _cstring_set_meta(PyObject *self, int flags, Py_ssize_t length) {
+    /* length first: it's only read once META is seen */
+    CSTRING_LENGTH(self) = length;
+    CSTRING_FLAGS(self) = (CSTRING_FLAGS(self) & ~CSTRING_META_MASK) | CSTRING_FLAG_META | flags;
+}
+
+static void _cstring_add_flags(PyObject *self, int flags) {
+    Py_BEGIN_CRITICAL_SECTION(self);
+    CSTRING_FLAGS(self) |= flags;
+    Py_END_CRITICAL_SECTION();
+}
+
+static void _cstring_set_ascii(PyObject *self) {
+    _cstring_set_meta(self, CSTRING_FLAG_VALID | CSTRING_FLAG_ASCII, Py_SIZE(self) - 1);
+}
+
+/* Text metadata flags, scanning the bytes the first time they're needed. */
+static int _cstring_meta(PyObject *self) {
+    if(!(CSTRING_FLAGS(self) & CSTRING_FLAG_META)) {
+        int ascii;
+        Py_ssize_t length;
+        CSTRING_BEGIN_ALLOW_THREADS(Py_SIZE(self) - 1)
+        length = _utf8_length_parallel(CSTRING_VALUE(self), Py_SIZE(self) - 1, &ascii);
+        CSTRING_END_ALLOW_THREADS
+        Py_BEGIN_CRITICAL_SECTION(self);
+        _cstring_set_meta(self,
+            (length >= 0 ? CSTRING_FLAG_VALID : 0) | (ascii ? CSTRING_FLAG_ASCII : 0),
+            length);
+        Py_END_CRITICAL_SECTION();
+    }
+    return CSTRING_FLAGS(self);
+}
+
+#define CSTRING_IS_ASCII(self)      (_cstring_meta(self) & CSTRING_FLAG_ASCII)
+/* without scanning: only true if already known */
+#define CSTRING_KNOWN_ASCII(self)   ((CSTRING_FLAGS(self) & (CSTRING_FLAG_META | CSTRING_FLAG_ASCII)) \
+                                        == (CSTRING_FLAG_META | CSTRING_FLAG_ASCII))
+#define CSTRING_KNOWN_VALID(self)   ((CSTRING_FLAGS(self) & (CSTRING_FLAG_META | CSTRING_FLAG_VALID)) \
+                                        == (CSTRING_FLAG_META | CSTRING_FLAG_VALID))
+
+/*
+ * Code-point index: for long non-ASCII text, the byte offset of every
+ * CHAR_INDEX_STEP-th code point, so that locating any code point takes at
+ * most CHAR_INDEX_STEP steps. Built on first use and kept in a side table
+ * keyed by object address, since most objects never need one.
+ */
+#define CHAR_INDEX_STEP     64
+#define CHAR_INDEX_MIN      (4 * CHAR_INDEX_STEP)   /* bytes; shorter text is just scanned */
+
+#define UTF8_IS_CONT(c)     (((unsigned char)(c) & 0xC0) == 0x80)
+
+static PyObject *cstring_CHAR_INDEXES = NULL;
+
+static void _cstring_drop_index(PyObject *self) {
+    if(!(CSTRING_FLAGS(self) & CSTRING_FLAG_INDEXED))
+        return;
+    PyObject *type, *value, *traceback;
+    PyErr_Fetch(&type, &value, &traceback);
+    PyObject *key = PyLong_FromVoidPtr(self);
+    if(!key || PyDict_DelItem(cstring_CHAR_INDEXES, key) < 0)
+        PyErr_Clear();
+    Py_XDECREF(key);
+    PyErr_Restore(type, value, traceback);
+    CSTRING_FLAGS(self) &= ~CSTRING_FLAG_INDEXED;
+}
+
+static void _char_index_free(PyObject *capsule) {
+    PyMem_Free(PyCapsule_GetPointer(capsule, NULL));
+}
+
+/* Index for self, which must be known valid; builds it if needed. */
+static const Py_ssize_t *_cstring_char_index(PyObject *self) {
+    PyObject *key = PyLong_FromVoidPtr(self);
+    if(!key)
+        return NULL;
+
+    if(CSTRING_FLAGS(self) & CSTRING_FLAG_INDEXED) {
+        PyObject *capsule = PyDict_GetItemWithError(cstring_CHAR_INDEXES, key);
+        Py_DECREF(key);
+        if(!capsule) {
+            if(!PyErr_Occurred())
+                PyErr_BadInternalCall();
+            return NULL;
+        }
+        return PyCapsule_GetPointer(capsule, NULL);
+    }
+
+    Py_ssize_t entries = CSTRING_LENGTH(self) / CHAR_INDEX_STEP + 1;
+    Py_ssize_t *offsets = PyMem_New(Py_ssize_t, entries);
+    if(!offsets) {
+        PyErr_NoMemory();
+        goto fail;
+    }
+    const char *s = CSTRING_VALUE(self);
+    Py_ssize_t n = Py_SIZE(self) - 1;
+    Py_ssize_t j = 0;
+    Py_ssize_t countdown = 0;
+    CSTRING_BEGIN_ALLOW_THREADS(n)
+    for(Py_ssize_t i = 0; i < n; ++i) {
+        if(UTF8_IS_CONT(s[i]))
+            continue;
+        if(countdown-- == 0) {
+            offsets[j++] = i;
+            countdown = CHAR_INDEX_STEP - 1;
+        }
+    }
+    CSTRING_END_ALLOW_THREADS
+    if(j < entries)
+        offsets[j] = n;
+
+    PyObject *capsule = PyCapsule_New(offsets, NULL, _char_index_free);
+    if(!capsule) {
+        PyMem_Free(offsets);
+        goto fail;
+    }
+    /* another thread may have stored an index meanwhile; use that one */
+    PyObject *stored = PyDict_SetDefault(cstring_CHAR_INDEXES, key, capsule);
+    Py_DECREF(key);
+    offsets = stored ? PyCapsule_GetPointer(stored, NULL) : NULL;
+    Py_DECREF(capsule);
+    if(offsets)
+        _cstring_add_flags(self, CSTRING_FLAG_INDEXED);
+    return offsets;
+
+fail:
+    Py_DECREF(key);
+    return NULL;
+}
+
+/* Raises UnicodeDecodeError unless self is valid UTF-8. */
+static int _cstring_ensure_valid(PyObject *self) {
+    if(_cstring_meta(self) & CSTRING_FLAG_VALID)
+        return 0;
+    PyObject *str = PyUnicode_DecodeUTF8(CSTRING_VALUE(self), Py_SIZE(self) - 1, "strict");
+    if(str) {
+        Py_DECREF(str);
+        PyErr_BadInternalCall();
+    }
+    return -1;
+}
+
+/* Byte offset of code point i (0 <= i <= length) in valid text, or -1. */
+static Py_ssize_t _cstring_char_offset(PyObject *self, Py_ssize_t i) {
+    if(CSTRING_FLAGS(self) & CSTRING_FLAG_ASCII)
+        return i;
+    const char *s = CSTRING_VALUE(self);
+    Py_ssize_t n = Py_SIZE(self) - 1;
+    if(i == CSTRING_LENGTH(self))
+        return n;
+
+    Py_ssize_t off = 0;
+    if(n >= CHAR_INDEX_MIN) {
+        const Py_ssize_t *index = _cstring_char_index(self);
+        if(!index)
+            return -1;
+        off = index[i / CHAR_INDEX_STEP];
+        i %= CHAR_INDEX_STEP;
+    }
+    while(i-- > 0) {
+        ++off;
+        while(off < n && UTF8_IS_CONT(s[off]))
+            ++off;
+    }
+    return off;
+}
+
+static PyObject *_cstring_realloc(PyObject *self, Py_ssize_t len) {
+    if(Py_REFCNT(self) > 1 || CSTRING_IS_VIEW(self))
+        return PyErr_BadInternalCall(), NULL;
+    _cstring_drop_index(self);
+    struct cstring *new = PyObject_Realloc(self, _cstring_mem_size(len + 1));
+    if(!new)
+        return PyErr_NoMemory();
+    Py_SET_SIZE(new, len + 1);
+    new->hash = -1;
+    new->flags &= ~CSTRING_META_MASK;
+    STATS_INC(reallocs);
+    STATS_ADD(realloc_bytes, len + 1);
+    return (PyObject *)new;
+}
+
+/* Compact copy of self (with its cached hash and metadata) of type `type`. */
+static PyObject *_cstring_copy_as(PyTypeObject *type, PyObject *self) {
+    PyObject *new = _cstring_new(type, CSTRING_VALUE(self), Py_SIZE(self) - 1);
+    if(!new)
+        return NULL;
+    CSTRING_HASH(new) = CSTRING_HASH(self);
+    CSTRING_FLAGS(new) |= CSTRING_FLAGS(self) & CSTRING_FLAG_STR_HASH;
+    if(CSTRING_FLAGS(self) & CSTRING_FLAG_META)
+        _cstring_set_meta(new, CSTRING_FLAGS(self) & CSTRING_META_MASK, CSTRING_LENGTH(self));
+    return new;
+}
+
+static PyObject *_cstring_copy(PyObject *self) {
+    return _cstring_copy_as(Py_TYPE(self), self);
+}
+
+static PyObject *cstring_new_empty(void) {
+    if(!cstring_EMPTY) {
+        cstring_EMPTY = (struct cstring *)_cstring_new(&cstring_type, "", 0);
+        if(!cstring_EMPTY)
+            return NULL;
+        _cstring_set_ascii((PyObject *)cstring_EMPTY);
+    }
+    /* leaking one reference for singleton cache (never cleaned up) */
+    STATS_INC(empty_singleton);
+    Py_INCREF(cstring_EMPTY);
+    return (PyObject *)cstring_EMPTY;
+}
+
+/* single-byte singletons, initialized in cstring_new_byte (called at import) */
+static struct cstring *cstring_BYTES[256];
+
+static PyObject *cstring_new_byte(char c) {
+    unsigned char i = (unsigned char)c;
+    if(!cstring_BYTES[i]) {
+        PyObject *new = _cstring_new(&cstring_type, &c, 1);
+        if(!new)
+            return NULL;
+        if(i < 0x80)
+            _cstring_set_ascii(new);
+        else
+            _cstring_set_meta(new, 0, -1);  /* a lone byte >= 0x80 is never valid */
+        cstring_BYTES[i] = (struct cstring *)new;
+    }
+    /* leaking one reference for singleton cache (never cleaned up) */
+    STATS_INC(byte_singleton);
+    Py_INCREF(cstring_BYTES[i]);
+    return (PyObject *)cstring_BYTES[i];
+}
+
+/* View of value[0:len], which `base` keeps alive. */
+static PyObject *_cstring_view_alloc(PyObject *base, const char *value, Py_ssize_t len) {
+    if(len == 0)
+        return cstring_new_empty();
+
+    struct cstring_view *new = (struct cstring_view *)cstring_type.tp_alloc(
+        &cstring_type, CSTRING_VIEW_ITEMS);
+    if(!new)
+        return NULL;
+    Py_SET_SIZE(new, len + 1);
+    new->hash = -1;
+    new->flags = CSTRING_FLAG_VIEW;
+    STATS_INC(views);
+    Py_INCREF(base);
+    new->base = base;
+    new->data = (char *)value;
+    return (PyObject *)new;
+}
+
+static PyObject *_cstring_view_new(PyObject *owner, const char *value, Py_ssize_t len) {
+    /* views always reference the storage owner, never another view */
+    PyObject *base = CSTRING_IS_VIEW(owner) ? CSTRING_VIEW_BASE(owner) : owner;
+    PyObject *new = _cstring_view_alloc(base, value, len);
+    if(new && len && CSTRING_KNOWN_ASCII(owner))
+        _cstring_set_ascii(new);
+    return new;
+}
+
+/* Sub-range of self: shares storage if self is a view, otherwise a copy. */
+static PyObject *_cstring_substr(PyObject *self, const char *value, Py_ssize_t len) {
+    if(len == 1 && Py_TYPE(self) == &cstring_type)
+        return cstring_new_byte(*value);
+    if(CSTRING_IS_VIEW(self))
+        return _cstring_view_new(self, value, len);
+    if(len == 0)
+        return cstring_new_empty();
+    if(len == Py_SIZE(self) - 1) {
+        Py_INCREF(self);
+        return self;
+    }
+    PyObject *new = _cstring_new(Py_TYPE(self), value, len);
+    if(new && CSTRING_KNOWN_ASCII(self))
+        _cstring_set_ascii(new);
+    return new;
+}
+
+static const char *_obj_as_string_and_size(PyObject *o, Py_ssize_t *s) {
+    if(PyUnicode_Check(o))
+        return PyUnicode_AsUTF8AndSize(o, s);
+
+    if(PyObject_TypeCheck(o, &cstring_type)) {
+        *s = Py_SIZE(o) - 1;
+        return CSTRING_VALUE(o);
+    }
+
+    if(PyObject_CheckBuffer(o)) {
+        /* handles bytes, bytearrays, arrays, memoryviews, etc. */
+        Py_buffer view;
+        if(PyObject_GetBuffer(o, &view, PyBUF_SIMPLE) < 0)
+            return NULL;
+        *s = view.len;
+        const char *buffer = view.buf;
+        PyBuffer_Release(&view);
+        return buffer;
+    }
+
+    *s = -1;
+    return _bad_argument_type(o);
+}
+
+/* Like _obj_as_string_and_size, but the storage stays pinned until the
+ * caller does PyBuffer_Release(view). */
+static int _obj_get_buffer(PyObject *o, Py_buffer *view) {
+    if(PyUnicode_Check(o)) {
+        Py_ssize_t len;
+        const char *s = PyUnicode_AsUTF8AndSize(o, &len);
+        if(!s)
+            return -1;
+        return PyBuffer_FillInfo(view, o, (void *)s, len, 1, PyBUF_SIMPLE);
+    }
+
+    if(PyObject_CheckBuffer(o))
+        return PyObject_GetBuffer(o, view, PyBUF_SIMPLE);
+
+    _bad_argument_type(o);
+    return -1;
+}
+
+/* Text metadata of a string-like object, as far as known without
+ * scanning: VALID and ASCII flags, with *length set if VALID. */
+static int _obj_text_meta(PyObject *o, Py_ssize_t *length) {
+    if(PyUnicode_Check(o)) {
+        *length = PyUnicode_GET_LENGTH(o);
+        return CSTRING_FLAG_VALID | (PyUnicode_IS_ASCII(o) ? CSTRING_FLAG_ASCII : 0);
+    }
+    if(PyObject_TypeCheck(o, &cstring_type) && CSTRING_KNOWN_VALID(o)) {
+        *length = CSTRING_LENGTH(o);
+        return CSTRING_FLAGS(o) & (CSTRING_FLAG_VALID | CSTRING_FLAG_ASCII);
+    }
+    *length = 0;
+    return 0;
+}
+
+static int _check_errors(const char *errors) {
+    if(strcmp(errors, "strict") != 0 && strcmp(errors, "replace") != 0 && strcmp(errors, "trust") != 0) {
+        PyErr_Format(PyExc_ValueError, "unknown errors mode: '%s'", errors);
+        return -1;
+    }
+    return 0;
+}
+
+/* Validates the bytes of new (a reference that is stolen) according to
+ * `errors`, as checked by _check_errors:
+ *   "strict": raise UnicodeDecodeError if invalid
+ *   "replace": replace invalid sequences with U+FFFD, in a compact copy
+ *   "trust": no validation (deferred until something needs it) */
+static PyObject *_cstring_validated(PyObject *new, const char *errors) {
+    if(strcmp(errors, "trust") == 0 || Py_SIZE(new) == 1 || CSTRING_KNOWN_VALID(new))
+        return new;
+
+    PyTypeObject *type = Py_TYPE(new);
+    Py_ssize_t len = Py_SIZE(new) - 1;
+    int ascii;
+    Py_ssize_t length;
+    CSTRING_BEGIN_ALLOW_THREADS(len)
+    length = _utf8_length_parallel(CSTRING_VALUE(new), len, &ascii);
+    CSTRING_END_ALLOW_THREADS
+    if(length >= 0) {
+        _cstring_set_meta(new, CSTRING_FLAG_VALID | (ascii ? CSTRING_FLAG_ASCII : 0), length);
+        return new;
+    }
+
+    /* let the codec raise, or build the replaced text */
+    PyObject *text = PyUnicode_DecodeUTF8(CSTRING_VALUE(new), len, errors);
+    PyObject *replaced = NULL;
+    if(text) {
+        Py_ssize_t size;
+        const char *utf8 = PyUnicode_AsUTF8AndSize(text, &size);
+        replaced = utf8 ? _cstring_new(type, utf8, size) : NULL;
+        if(replaced)
+            _cstring_set_meta(replaced, CSTRING_FLAG_VALID, PyUnicode_GET_LENGTH(text));
+        Py_DECREF(text);
+    }
+    Py_DECREF(new);
+    return replaced;
+}
+
+/* Copy of UTF-8 bytes, validated according to `errors`. */
+static PyObject *_cstring_new_validated(PyTypeObject *type, const char *value, Py_ssize_t len, const char *errors) {
+    if(_check_errors(errors) < 0)
+        return NULL;
+    /* the copy is validated, so that value may change once the GIL is released */
+    PyObject *new = _cstring_new(type, value, len);
+    if(!new)
+        return NULL;
+    return _cstring_validated(new, errors);
+}
+
+static PyObject *_cstring_from_object(PyTypeObject *type, PyObject *argobj, const char *errors) {
+    if(PyObject_TypeCheck(argobj, type)) {
+        Py_INCREF(argobj);
+        return argobj;
+    }
+
+    if(PyUnicode_Check(argobj)) {
+        /* already known to be valid; the str has the rest */
+        Py_ssize_t len;
+        const char *buffer = PyUnicode_AsUTF8AndSize(argobj, &len);
+        if(!buffer)
+            return NULL;
+        if(len == 0)
+            return cstring_new_empty();
+        PyObject *new = _cstring_new(type, buffer, len);
+        if(new)
+            _cstring_set_meta(new,
+                CSTRING_FLAG_VALID | (PyUnicode_IS_ASCII(argobj) ? CSTRING_FLAG_ASCII : 0),
+                PyUnicode_GET_LENGTH(argobj));
+        return new;
+    }
+
+    Py_ssize_t len = 0;
+    const char *buffer = _obj_as_string_and_size(argobj, &len);
+    if(!buffer)
+        return NULL;
+
+    if(len == 0)
+        return cstring_new_empty();
+
+    return _cstring_new_validated(type, buffer, len, errors);
+}
+
+static PyObject *cstring_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"", "errors", NULL};
+    PyObject *argobj = NULL;
+    const char *errors = "strict";
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "O|s", kwlist, &argobj, &errors))
+        return NULL;
+    return _cstring_from_object(type, argobj, errors);
+}
+
+/* cstring(...) without an args tuple; subclasses don't inherit it and go through tp_new */
+static PyObject *cstring_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames) {
+    static const char *const kwlist[] = {"", "errors", NULL};
+    PyObject *argv[2];
+    const char *errors = "strict";
+    if(_parse_args("cstring", args, PyVectorcall_NARGS(nargsf), kwnames, kwlist, 1, argv) < 0)
+        return NULL;
+    if(argv[1] && _arg_str(argv[1], "errors", &errors) < 0)
+        return NULL;
+    return _cstring_from_object((PyTypeObject *)type, argv[0], errors);
+}
+
+static void cstring_dealloc(PyObject *self) {
+    _cstring_drop_index(self);
+    if(CSTRING_IS_VIEW(self)) {
+        Py_DECREF(CSTRING_VIEW_BASE(self));
+    }
+#ifdef CSTRING_FREELISTS
+    else if(Py_TYPE(self) == &cstring_type && Py_SIZE(self) <= FREELIST_CLASSES * FREELIST_CLASS_SIZE) {
+        int class = FREELIST_CLASS(Py_SIZE(self));
+        if(cstring_FREELISTS[class].length < FREELIST_MAX_LENGTH) {
+            Py_SET_TYPE(self, (PyTypeObject *)cstring_FREELISTS[class].head);
+            cstring_FREELISTS[class].head = (struct cstring *)self;
+            cstring_FREELISTS[class].length++;
+            return;
+        }
+    }
+#endif
+    Py_TYPE(self)->tp_free(self);
+}
+
+PyDoc_STRVAR(freelist_lengths__doc__, "");
+static PyObject *cstring_freelist_lengths(PyObject *module, PyObject *args) {
+    PyObject *sizes = PyTuple_New(FREELIST_CLASSES);
+    if(!sizes)
+        return NULL;
+    for(int i = 0; i < FREELIST_CLASSES; ++i) {
+#ifdef CSTRING_FREELISTS
+        PyObject *length = PyLong_FromLong(cstring_FREELISTS[i].length);
+#else
+        PyObject *length = PyLong_FromLong(0);
+#endif
+        if(!length) {
+            Py_DECREF(sizes);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(sizes, i, length);
+    }
+    return sizes;
+}
+
+#ifdef CSTRING_STATS
+static PyObject *_stats_dict(const char *const *names, const Py_ssize_t *counters, int n) {
+    PyObject *dict = PyDict_New();
+    if(!dict)
+        return NULL;
+    for(int i = 0; i < n; ++i) {
+        PyObject *value = PyLong_FromSsize_t(counters[i]);
+        if(!value || PyDict_SetItemString(dict, names[i], value) < 0) {
+            Py_XDECREF(value);
+            Py_DECREF(dict);
+            return NULL;
+        }
+        Py_DECREF(value);
+    }
+    return dict;
+}
+#endif
+
+PyDoc_STRVAR(_stats__doc__, "");
+static PyObject *cstring__stats(PyObject *module, PyObject *args) {
+#ifdef CSTRING_STATS
+    PyObject *allocs = _stats_dict(stats_ALLOC_CLASS_NAMES, cstring_STATS.allocs, STATS_ALLOC_CLASSES);
+    if(!allocs)
+        return NULL;
+    PyObject *searches = _stats_dict(stats_SEARCH_NAMES, cstring_STATS.searches, STATS_SEARCH_KINDS);
+    if(!searches) {
+        Py_DECREF(allocs);
+        return NULL;
+    }
+    return Py_BuildValue("{s:N,s:n,s:n,s:n,s:n,s:n,s:n,s:n,s:n,s:n,s:n,s:N}",
+        "allocs", allocs,
+        "views", cstring_STATS.views,
+        "reallocs", cstring_STATS.reallocs,
+        "realloc_bytes", cstring_STATS.realloc_bytes,
+        "bytes_copied", cstring_STATS.bytes_copied,
+        "freelist_hits", cstring_STATS.freelist_hits,
+        "freelist_misses", cstring_STATS.freelist_misses,
+        "hash_computed", cstring_STATS.hash_computed,
+        "hash_cached", cstring_STATS.hash_cached,
+        "empty_singleton", cstring_STATS.empty_singleton,
+        "byte_singleton", cstring_STATS.byte_singleton,
+        "searches", searches);
+#else
+    PyErr_SetString(PyExc_RuntimeError, "cstring was built without CSTRING_STATS");
+    return NULL;
+#endif
+}
+
+PyDoc_STRVAR(_reset_stats__doc__, "");
+static PyObject *cstring__reset_stats(PyObject *module, PyObject *args) {
+#ifdef CSTRING_STATS
+    memset(&cstring_STATS, 0, sizeof(cstring_STATS));
+    Py_RETURN_NONE;
+#else
+    PyErr_SetString(PyExc_RuntimeError, "cstring was built without CSTRING_STATS");
+    return NULL;
+#endif
+}
+
+static int _ensure_cstring(PyObject *self) {
+    if(PyObject_TypeCheck(self, &cstring_type))
+        return 1;
+    PyErr_Format(
+        PyExc_TypeError,
+        "Object must have type cstring, not %s.",
+        Py_TYPE(self)->tp_name);
+    return 0;
+}
+
+static Py_ssize_t cstring_len(PyObject *self) {
+    return Py_SIZE(self) - 1;
+}
+
+static PyObject *cstring_str(PyObject *self) {
+    if(CSTRING_KNOWN_ASCII(self)) {
+        PyObject *str = PyUnicode_New(cstring_len(self), 127);
+        if(str)
+            memcpy(PyUnicode_DATA(str), CSTRING_VALUE(self), cstring_len(self));
+        return str;
+    }
+    return PyUnicode_FromStringAndSize(CSTRING_VALUE(self), cstring_len(self));
+}
+
+static PyObject *cstring_repr(PyObject *self) {
+    PyObject *tmp = cstring_str(self);
+    if(!tmp)
+        return NULL;
+    PyObject *repr = PyObject_Repr(tmp);
+    Py_DECREF(tmp);
+    return repr;
+}
+
+/*
+ * By default the hash is that of the bytes. In str hash mode (see
+ * use_str_hash) it is that of the equal str, so cstrings can look up
+ * str-keyed dicts. The two agree for ASCII, which CPython hashes as the
+ * bytes themselves; other text is decoded once to hash it. Each object
+ * records which mode its cached hash belongs to.
+ *
+ * Changing the mode would change the hash of live objects in dicts and
+ * sets, so it is refused once text not known to be ASCII has been hashed.
+ */
+static int cstring_STR_HASH = 0;
+static int cstring_HASHED = 0;
+
+static Py_hash_t cstring_hash(PyObject *self) {
+    int str_hash = (CSTRING_FLAGS(self) & CSTRING_FLAG_STR_HASH) != 0;
+    if(CSTRING_HASH(self) != -1 && str_hash == cstring_STR_HASH) {
+        STATS_INC(hash_cached);
+        return CSTRING_HASH(self);
+    }
+    STATS_INC(hash_computed);
+    if(!CSTRING_KNOWN_ASCII(self))
+        cstring_HASHED = 1;
+
+    Py_hash_t hash;
+    if(!cstring_STR_HASH || CSTRING_IS_ASCII(self)) {
+        hash = _Py_HashBytes(CSTRING_VALUE(self), cstring_len(self));
+    } else {
+        PyObject *str = PyUnicode_DecodeUTF8(CSTRING_VALUE(self), cstring_len(self), "surrogateescape");
+        if(!str)
+            return -1;
+        hash = PyObject_Hash(str);
+        Py_DECREF(str);
+        if(hash == -1)
+            return -1;
+    }
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    CSTRING_HASH(self) = hash;
+    if(cstring_STR_HASH)
+        CSTRING_FLAGS(self) |= CSTRING_FLAG_STR_HASH;
+    else
+        CSTRING_FLAGS(self) &= ~CSTRING_FLAG_STR_HASH;
+    Py_END_CRITICAL_SECTION();
+    return hash;
+}
+
+PyDoc_STRVAR(use_str_hash__doc__, "");
+static PyObject *cstring_use_str_hash(PyObject *module, PyObject *const *args, Py_ssize_t nargs) {
+    int enable = 1;
+    if(_check_nargs("use_str_hash", nargs, 0, 1) < 0 || (nargs > 0 && _arg_bool(args[0], &enable) < 0))
+        return NULL;
+    int previous = cstring_STR_HASH;
+    if(enable != previous && cstring_HASHED) {
+        PyErr_SetString(PyExc_RuntimeError, "use_str_hash() must be called before non-ASCII text is hashed");
+        return NULL;
+    }
+    cstring_STR_HASH = enable;
+    return PyBool_FromLong(previous);
+}
+
+/* Decodes one code point from s[0:n] (n > 0), returning its length.
+ * Invalid bytes decode as lone surrogates, as with surrogateescape. */
+static Py_ssize_t _utf8_decode_one(const char *s, Py_ssize_t n, Py_UCS4 *cp) {
+    const unsigned char *p = (const unsigned char *)s;
+    Py_ssize_t len;
+    Py_UCS4 c, min;
+    if(p[0] < 0x80) {
+        *cp = p[0];
+        return 1;
+    } else if(p[0] >= 0xC2 && p[0] <= 0xDF) {
+        len = 2, c = p[0] & 0x1F, min = 0x80;
+    } else if(p[0] >= 0xE0 && p[0] <= 0xEF) {
+        len = 3, c = p[0] & 0x0F, min = 0x800;
+    } else if(p[0] >= 0xF0 && p[0] <= 0xF4) {
+        len = 4, c = p[0] & 0x07, min = 0x10000;
+    } else {
+        goto invalid;
+    }
+    if(n < len)
+        goto invalid;
+    for(Py_ssize_t i = 1; i < len; ++i) {
+        if(!UTF8_IS_CONT(p[i]))
+            goto invalid;
+        c = (c << 6) | (p[i] & 0x3F);
+    }
+    if(c < min || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF))
+        goto invalid;
+    *cp = c;
+    return len;
+
+invalid:
+    *cp = 0xDC00 + p[0];
+    return 1;
+}
+
+static int _compare_bytes(const char *a, Py_ssize_t alen, const char *b, Py_ssize_t blen) {
+    int cmp = memcmp(a, b, Py_MIN(alen, blen));
+    if(cmp == 0)
+        cmp = (alen > blen) - (alen < blen);
+    return cmp;
+}
+
+/* Compares with a str by code point, straight from its internal data.
+ * UTF-8 order is code point order, so this agrees with comparing bytes. */
+static int _compare_with_str(PyObject *self, PyObject *str) {
+    const char *s = CSTRING_VALUE(self);
+    Py_ssize_t n = cstring_len(self);
+    const void *data = PyUnicode_DATA(str);
+    Py_ssize_t len = PyUnicode_GET_LENGTH(str);
+    if(PyUnicode_IS_ASCII(str))
+        return _compare_bytes(s, n, data, len);
+
+    int kind = PyUnicode_KIND(str);
+    Py_ssize_t i = 0, j = 0;
+    while(i < n && j < len) {
+        Py_UCS4 a, b = PyUnicode_READ(kind, data, j++);
+        if((unsigned char)s[i] < 0x80) {
+            a = (unsigned char)s[i++];
+        } else {
+            i += _utf8_decode_one(s + i, n - i, &a);
+        }
+        if(a != b)
+            return a < b ? -1 : 1;
+    }
+    return (i < n) - (j < len);
+}
+
+static PyObject *_richcompare_result(int cmp, int op) {
+    switch (op) {
+    case Py_EQ:
+        return PyBool_FromLong(cmp == 0);
+    case Py_NE:
+        return PyBool_FromLong(cmp != 0);
+    case Py_LT:
+        return PyBool_FromLong(cmp < 0);
+    case Py_GT:
+        return PyBool_FromLong(cmp > 0);
+    case Py_LE:
+        return PyBool_FromLong(cmp <= 0);
+    case Py_GE:
+        return PyBool_FromLong(cmp >= 0);
+    default:
+        Py_UNREACHABLE();
+    }
+}
+
+static PyObject *_richcompare_str(PyObject *self, PyObject *str, int op) {
+#if PY_VERSION_HEX < 0x030C0000
+    if(PyUnicode_READY(str) < 0)
+        return NULL;
+#endif
+    if((op == Py_EQ || op == Py_NE) && CSTRING_KNOWN_VALID(self)) {
+        /* code point counts must match */
+        if(CSTRING_LENGTH(self) != PyUnicode_GET_LENGTH(str))
+            return PyBool_FromLong(op == Py_NE);
+    }
+    return _richcompare_result(_compare_with_str(self, str), op);
+}
+
+static PyObject *cstring_richcompare(PyObject *self, PyObject *other, int op) {
+    if(PyUnicode_Check(other))
+        return _richcompare_str(self, other, op);
+
+    if(!PyObject_TypeCheck(other, &cstring_type)) {
+        if(!PyObject_CheckBuffer(other))
+            Py_RETURN_NOTIMPLEMENTED;
+        Py_buffer view;
+        if(PyObject_GetBuffer(other, &view, PyBUF_SIMPLE) < 0)
+            return NULL;
+        int cmp = _compare_bytes(CSTRING_VALUE(self), cstring_len(self), view.buf, view.len);
+        PyBuffer_Release(&view);
+        return _richcompare_result(cmp, op);
+    }
+
+    if(op == Py_EQ || op == Py_NE) {
+        int eq;
+        if(self == other)
+            eq = 1;
+        else if(Py_SIZE(self) != Py_SIZE(other))
+            eq = 0;
+        else if(CSTRING_FLAGS(self) & CSTRING_FLAGS(other) & CSTRING_FLAG_INTERNED)
+            eq = 0;  /* equal interned strings are the same object */
+        else if(CSTRING_HASH(self) != -1 && CSTRING_HASH(other) != -1
+                && !((CSTRING_FLAGS(self) ^ CSTRING_FLAGS(other)) & CSTRING_FLAG_STR_HASH)
+                && CSTRING_HASH(self) != CSTRING_HASH(other))
+            eq = 0;
+        else
+            eq = memcmp(CSTRING_VALUE(self), CSTRING_VALUE(other), cstring_len(self)) == 0;
+        return PyBool_FromLong(eq == (op == Py_EQ));
+    }
+
+    return _richcompare_result(
+        _compare_bytes(CSTRING_VALUE(self), cstring_len(self), CSTRING_VALUE(other), cstring_len(other)),
+        op);
+}
+
+static PyObject *cstring_concat(PyObject *left, PyObject *right) {
+    if(!_ensure_cstring(left))
+        return NULL;
+    if(!_ensure_cstring(right))
+        return NULL;
+
+    Py_ssize_t size = cstring_len(left) + cstring_len(right) + 1;
+
+    struct cstring *new = CSTRING_ALLOC(Py_TYPE(left), size);
+    if(!new)
+        return NULL;
+    memcpy(new->value, CSTRING_VALUE(left), cstring_len(left));
+    memcpy(&new->value[cstring_len(left)], CSTRING_VALUE(right), cstring_len(right));
+    STATS_ADD(bytes_copied, size - 1);
+    /* valid + valid is valid (but invalid + invalid may not be invalid) */
+    if(CSTRING_KNOWN_VALID(left) && CSTRING_KNOWN_VALID(right))
+        _cstring_set_meta((PyObject *)new,
+            CSTRING_FLAGS(left) & CSTRING_FLAGS(right) & (CSTRING_FLAG_VALID | CSTRING_FLAG_ASCII),
+            CSTRING_LENGTH(left) + CSTRING_LENGTH(right));
+    return (PyObject *)new;
+}
+
+static PyObject *cstring_repeat(PyObject *self, Py_ssize_t count) {
+    if(!_ensure_cstring(self))
+        return NULL;
+    if(count <= 0 || cstring_len(self) == 0)
+        return cstring_new_empty();
+    if(cstring_len(self) > (PY_SSIZE_T_MAX - 1) / count)
+        return PyErr_NoMemory();
+
+    Py_ssize_t size = (cstring_len(self) * count) + 1;
+
+    struct cstring *new = CSTRING_ALLOC(Py_TYPE(self), size);
+    if(!new)
+        return NULL;
+    const char *s = CSTRING_VALUE(self);
+    Py_ssize_t len = cstring_len(self);
+    CSTRING_BEGIN_ALLOW_THREADS(size)
+    for(Py_ssize_t i = 0; i < size - 1; i += len) {
+        memcpy(&new->value[i], s, len);
+    }
+    CSTRING_END_ALLOW_THREADS
+    STATS_ADD(bytes_copied, size - 1);
+    if(CSTRING_KNOWN_VALID(self))
+        _cstring_set_meta((PyObject *)new,
+            CSTRING_FLAGS(self) & (CSTRING_FLAG_VALID | CSTRING_FLAG_ASCII),
+            CSTRING_LENGTH(self) * count);
+    return (PyObject *)new;
+}
+
+static Py_ssize_t _ensure_valid_index(PyObject *self, Py_ssize_t i) {
+    if(i >= 0 && i < cstring_len(self))
+        return i;
+    PyErr_SetString(PyExc_IndexError, "Index is out of bounds");
+    return -1;
+}
+
+static PyObject *cstring_item(PyObject *self, Py_ssize_t i) {
+    if(_ensure_valid_index(self, i) < 0)
+        return NULL;
+    if(Py_TYPE(self) == &cstring_type)
+        return cstring_new_byte(CSTRING_VALUE(self)[i]);
+    return _cstring_new(Py_TYPE(self), CSTRING_VALUE_AT(self, i), 1);
+}
+
+static int cstring_contains(PyObject *self, PyObject *arg) {
+    Py_buffer view;
+    if(_obj_get_buffer(arg, &view) < 0)
+        return -1;
+    struct _search search;
+    _search_init(&search, view.buf, view.len);
+    const char *p;
+    CSTRING_BEGIN_ALLOW_THREADS(cstring_len(self))
+    STATS_SEARCH(CONTAINS);
+    p = _search_find_parallel(&search, CSTRING_VALUE(self), cstring_len(self));
+    CSTRING_END_ALLOW_THREADS
+    PyBuffer_Release(&view);
+    return p != NULL;
+}
+
+static PyObject *_cstring_subscript_index(PyObject *self, PyObject *index) {
+    Py_ssize_t i = PyNumber_AsSsize_t(index, PyExc_IndexError);
+    if(PyErr_Occurred())
+        return NULL;
+    if(i < 0)
+        i += cstring_len(self);
+    return cstring_item(self, i);
+}
+
+static PyObject *_cstring_subscript_slice(PyObject *self, PyObject *slice) {
+    Py_ssize_t start, stop, step;
+    if(PySlice_Unpack(slice, &start, &stop, &step) < 0)
+        return NULL;
+
+    Py_ssize_t slicelen = PySlice_AdjustIndices(cstring_len(self), &start, &stop, step);
+    if(step == 1)
+        return _cstring_substr(self, CSTRING_VALUE_AT(self, start), slicelen);
+
+    struct cstring *new = CSTRING_ALLOC(Py_TYPE(self), slicelen + 1);
+    if(!new)
+        return NULL;
+
+    char *src = CSTRING_VALUE_AT(self, start);
+    for(Py_ssize_t i = 0; i < slicelen; ++i) {
+        new->value[i] = *src;
+        src += step;
+    }
+    new->value[slicelen] = '\0';
+    return (PyObject *)new;
+}
+
+static PyObject *cstring_subscript(PyObject *self, PyObject *key) {
+    if(PyIndex_Check(key))
+        return _cstring_subscript_index(self, key);
+    if(PySlice_Check(key))
+        return _cstring_subscript_slice(self, key);
+
+    PyErr_SetString(PyExc_TypeError, "Subscript must be int or slice.");
+    return NULL;
+}
+
+static Py_ssize_t _fix_index(Py_ssize_t i, Py_ssize_t len) {
+    Py_ssize_t result = i;
+    if(result < 0)
+        result += len;
+    if(result < 0)
+        result = 0;
+    if(result > len)
+        result = len;
+    return result;
+}
+
+/* Clamp [start:end) as str methods do. A start beyond the end becomes
+ * len + 1, so it never matches, not even an empty substring. */
+static void _fix_range(Py_ssize_t len, Py_ssize_t *start, Py_ssize_t *end) {
+    *start = (*start > len) ? len + 1 : _fix_index(*start, len);
+    *end = _fix_index(*end, len);
+}
+
+struct _substr_params {
+    const char *start;
+    const char *end;
+    const char *substr;
+    Py_ssize_t substr_len;
+    Py_buffer view;     /* pins substr; the caller releases it */
+};
+
+static struct _substr_params *_parse_substr_args(PyObject *self, const char *name, PyObject *const *args, Py_ssize_t nargs,
+                                                 struct _substr_params *params) {
+    Py_ssize_t start = 0;
+    Py_ssize_t end = PY_SSIZE_T_MAX;
+
+    if(_check_nargs(name, nargs, 1, 3) < 0)
+        return NULL;
+    if(nargs > 1 && _arg_ssize(args[1], &start) < 0)
+        return NULL;
+    if(nargs > 2 && _arg_ssize(args[2], &end) < 0)
+        return NULL;
+
+    if(_obj_get_buffer(args[0], &params->view) < 0)
+        return NULL;
+
+    _fix_range(cstring_len(self), &start, &end);
+
+    params->start = CSTRING_VALUE_AT(self, start);
+    params->end = CSTRING_VALUE_AT(self, end);
+    params->substr = params->view.buf;
+    params->substr_len = params->view.len;
+
+    return params;
+}
+
+PyDoc_STRVAR(count__doc__, "");
+static PyObject *cstring_count(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    struct _substr_params params;
+
+    if(!_parse_substr_args(self, "count", args, nargs, &params))
+        return NULL;
+
+    Py_ssize_t count = 0;
+    if(params.end >= params.start) {
+        struct _search search;
+        _search_init(&search, params.substr, params.substr_len);
+        CSTRING_BEGIN_ALLOW_THREADS(params.end - params.start)
+        STATS_SEARCH(COUNT);
+        count = _search_count_parallel(&search, params.start, params.end - params.start);
+        CSTRING_END_ALLOW_THREADS
+    }
+    PyBuffer_Release(&params.view);
+    return PyLong_FromSsize_t(count);
+}
+
+/* Search for the substring (releasing params->view) in either direction. */
+static const char *_substr_params_search(struct _substr_params *params, int reverse) {
+    const char *p = NULL;
+    if(params->end >= params->start) {
+        struct _search search;
+        _search_init(&search, params->substr, params->substr_len);
+        Py_ssize_t n = params->end - params->start;
+        if(reverse)
+            STATS_SEARCH(RFIND);
+        else
+            STATS_SEARCH(FIND);
+        CSTRING_BEGIN_ALLOW_THREADS(n)
+        p = reverse
+            ? _search_rfind_parallel(&search, params->start, n)
+            : _search_find_parallel(&search, params->start, n);
+        CSTRING_END_ALLOW_THREADS
+    }
+    PyBuffer_Release(&params->view);
+    return p;
+}
+
+static const char *_substr_params_str(struct _substr_params *params) {
+    return _substr_params_search(params, 0);
+}
+
+static const char *_substr_params_rstr(struct _substr_params *params) {
+    return _substr_params_search(params, 1);
+}
+
+PyDoc_STRVAR(find__doc__, "");
+PyObject *cstring_find(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    struct _substr_params params;
+
+    if(!_parse_substr_args(self, "find", args, nargs, &params))
+        return NULL;
+
+    const char *p = _substr_params_str(&params);
+    if(!p)
+        return PyLong_FromLong(-1);
+
+    return PyLong_FromSsize_t(p - CSTRING_VALUE(self));
+}
+
+PyDoc_STRVAR(index__doc__, "");
+PyObject *cstring_index(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    struct _substr_params params;
+
+    if(!_parse_substr_args(self, "index", args, nargs, &params))
+        return NULL;
+
+    const char *p = _substr_params_str(&params);
+    if(!p) {
+        PyErr_SetString(PyExc_ValueError, "substring not found");
+        return NULL;
+    }
+
+    return PyLong_FromSsize_t(p - CSTRING_VALUE(self));
+}
+
+/* Calls the str method on UTF-8 s[0:n].
+ * Invalid UTF-8 is decoded with surrogateescape. */
+static PyObject *_unicode_call_method(const char *s, Py_ssize_t n, const char *method) {
+    PyObject *str = PyUnicode_DecodeUTF8(s, n, "surrogateescape");
+    if(!str)
+        return NULL;
+    PyObject *result = PyObject_CallMethod(str, method, NULL);
+    Py_DECREF(str);
+    return result;
+}
+
+/* The is*() methods test bytes with <ctype.h>, which is only right for
+ * ASCII; anything else gets the answer from str. */
+#define CSTRING_UNICODE_UNLESS_ASCII(self, method) \
+    do { \
+        if(!CSTRING_IS_ASCII(self)) \
+            return _unicode_call_method(CSTRING_VALUE(self), cstring_len(self), (method)); \
+    } while(0)
+
+/* interned instances by their bytes hash, which unlike cstring_hash doesn't
+ * depend on use_str_hash; a value is the instance, or a list of them if
+ * hashes collide. Entries are never removed. Created at import. */
+static PyObject *cstring_INTERNED = NULL;
+
+/* the interned instance in entry equal to self (borrowed), or NULL */
+static PyObject *_interned_find(PyObject *entry, PyObject *self) {
+    Py_ssize_t n = PyList_Check(entry) ? PyList_GET_SIZE(entry) : 1;
+    for(Py_ssize_t i = 0; i < n; ++i) {
+        PyObject *item = PyList_Check(entry) ? PyList_GET_ITEM(entry, i) : entry;
+        if(Py_SIZE(item) == Py_SIZE(self) && memcmp(CSTRING_VALUE(item), CSTRING_VALUE(self), cstring_len(self)) == 0)
+            return item;
+    }
+    return NULL;
+}
+
+/* adds interned to the table under key, next to an existing entry if any */
+static int _interned_add(PyObject *key, PyObject *entry, PyObject *interned) {
+    if(!entry)
+        return PyDict_SetItem(cstring_INTERNED, key, interned);
+    if(PyList_Check(entry))
+        return PyList_Append(entry, interned);
+    PyObject *list = PyList_New(2);
+    if(!list)
+        return -1;
+    Py_INCREF(entry);
+    PyList_SET_ITEM(list, 0, entry);
+    Py_INCREF(interned);
+    PyList_SET_ITEM(list, 1, interned);
+    int result = PyDict_SetItem(cstring_INTERNED, key, list);
+    Py_DECREF(list);
+    return result;
+}
+
+PyDoc_STRVAR(intern__doc__, "");
+PyObject *cstring_intern(PyObject *self, PyObject *args) {
+    if(CSTRING_FLAGS(self) & CSTRING_FLAG_INTERNED) {
+        Py_INCREF(self);
+        return self;
+    }
+
+    Py_hash_t hash = CSTRING_HASH(self);
+    if(hash == -1 || (CSTRING_FLAGS(self) & CSTRING_FLAG_STR_HASH))
+        hash = _Py_HashBytes(CSTRING_VALUE(self), cstring_len(self));
+    PyObject *key = PyLong_FromSsize_t(hash);
+    if(!key)
+        return NULL;
+
+    PyObject *result = NULL;
+    /* lookup and insertion are one step, in case another thread interns
+     * an equal string meanwhile */
+    Py_BEGIN_CRITICAL_SECTION(cstring_INTERNED);
+    PyObject *entry = PyDict_GetItemWithError(cstring_INTERNED, key);
+    if(entry) {
+        result = _interned_find(entry, self);
+        Py_XINCREF(result);
+    }
+    if(!result && !PyErr_Occurred()) {
+        /* the table holds compact, exact cstrings, so a view's base isn't
+         * kept alive and the identity shortcut in richcompare is safe */
+        if(CSTRING_IS_VIEW(self) || Py_TYPE(self) != &cstring_type) {
+            result = _cstring_copy_as(&cstring_type, self);
+        } else {
+            Py_INCREF(self);
+            result = self;
+        }
+        if(result && _interned_add(key, entry, result) < 0)
+            Py_CLEAR(result);
+        if(result)
+            _cstring_add_flags(result, CSTRING_FLAG_INTERNED);
+    }
+    Py_END_CRITICAL_SECTION();
+    Py_DECREF(key);
+    return result;
+}
+
+/* Whether pred holds for every byte of ASCII s[0:n]. */
+static int _all_bytes(const char *s, Py_ssize_t n, int (*pred)(int)) {
+    int result = 1;
+    CSTRING_BEGIN_ALLOW_THREADS(n)
+    for(Py_ssize_t i = 0; i < n; ++i) {
+        if(!pred(s[i])) {
+            result = 0;
+            break;
+        }
+    }
+    CSTRING_END_ALLOW_THREADS
+    return result;
+}
+
+/* Whether ASCII s[0:n] has at least one alpha, and is_case holds for all. */
+static int _ascii_cased(const char *s, Py_ssize_t n, int (*is_case)(int)) {
+    int cased = 0;
+    CSTRING_BEGIN_ALLOW_THREADS(n)
+    for(Py_ssize_t i = 0; i < n; ++i) {
+        if(isalpha(s[i])) {
+            if(!is_case(s[i])) {
+                cased = 0;
+                break;
+            }
+            cased = 1;
+        }
+    }
+    CSTRING_END_ALLOW_THREADS
+    return cased;
+}
+
+PyDoc_STRVAR(isascii__doc__, "");
+PyObject *cstring_isascii(PyObject *self, PyObject *args) {
+    return PyBool_FromLong(CSTRING_IS_ASCII(self));
+}
+
+PyDoc_STRVAR(isalnum__doc__, "");
+PyObject *cstring_isalnum(PyObject *self, PyObject *args) {
+    CSTRING_UNICODE_UNLESS_ASCII(self, "isalnum");
+    return PyBool_FromLong(_all_bytes(CSTRING_VALUE(self), cstring_len(self), isalnum));
+}
+
+PyDoc_STRVAR(isalpha__doc__, "");
+PyObject *cstring_isalpha(PyObject *self, PyObject *args) {
+    CSTRING_UNICODE_UNLESS_ASCII(self, "isalpha");
+    return PyBool_FromLong(_all_bytes(CSTRING_VALUE(self), cstring_len(self), isalpha));
+}
+
+PyDoc_STRVAR(isdigit__doc__, "");
+PyObject *cstring_isdigit(PyObject *self, PyObject *args) {
+    CSTRING_UNICODE_UNLESS_ASCII(self, "isdigit");
+    return PyBool_FromLong(_all_bytes(CSTRING_VALUE(self), cstring_len(self), isdigit));
+}
+
+PyDoc_STRVAR(islower__doc__, "");
+PyObject *cstring_islower(PyObject *self, PyObject *args) {
+    CSTRING_UNICODE_UNLESS_ASCII(self, "islower");
+    return PyBool_FromLong(_ascii_cased(CSTRING_VALUE(self), cstring_len(self), islower));
+}
+
+PyDoc_STRVAR(isprintable__doc__, "");
+PyObject *cstring_isprintable(PyObject *self, PyObject *args) {
+    CSTRING_UNICODE_UNLESS_ASCII(self, "isprintable");
+    return PyBool_FromLong(_all_bytes(CSTRING_VALUE(self), cstring_len(self), isprint));
+}
+
+PyDoc_STRVAR(isspace__doc__, "");
+PyObject *cstring_isspace(PyObject *self, PyObject *args) {
+    CSTRING_UNICODE_UNLESS_ASCII(self, "isspace");
+    return PyBool_FromLong(cstring_len(self) > 0
+        && _all_bytes(CSTRING_VALUE(self), cstring_len(self), isspace));
+}
+
+PyDoc_STRVAR(isupper__doc__, "");
+PyObject *cstring_isupper(PyObject *self, PyObject *args) {
+    CSTRING_UNICODE_UNLESS_ASCII(self, "isupper");
+    return PyBool_FromLong(_ascii_cased(CSTRING_VALUE(self), cstring_len(self), isupper));
+}
+
+PyDoc_STRVAR(join__doc__, "");
+PyObject *cstring_join(PyObject *self, PyObject *arg) {
+    /* result metadata, if every part's is known; this may release the
+     * GIL, so it's done before the items are borrowed */
+    int meta = _cstring_meta(self) & (CSTRING_FLAG_VALID | CSTRING_FLAG_ASCII);
+
+    PyObject *seq = PySequence_Fast(arg, "can only join an iterable");
+    if(!seq)
+        return NULL;
+
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(seq);
+    PyObject **items = PySequence_Fast_ITEMS(seq);
+    if(count == 0) {
+        Py_DECREF(seq);
+        return cstring_new_empty();
+    }
+    if(count == 1 && Py_TYPE(items[0]) == Py_TYPE(self)) {
+        PyObject *result = items[0];
+        Py_INCREF(result);
+        Py_DECREF(seq);
+        return result;
+    }
+
+    /* first pass: pin every item's bytes and size the result; the buffers
+     * are held until the copy, as getting one can run Python code */
+    Py_buffer stack_parts[16], *parts = stack_parts;
+    if(count > (Py_ssize_t)Py_ARRAY_LENGTH(stack_parts)) {
+        parts = PyMem_New(Py_buffer, count);
+        if(!parts) {
+            Py_DECREF(seq);
+            return PyErr_NoMemory();
+        }
+    }
+
+    PyObject *result = NULL;
+    Py_ssize_t seplen = cstring_len(self);
+    Py_ssize_t total = 0;
+    Py_ssize_t length = CSTRING_LENGTH(self) * (count - 1);
+    Py_ssize_t pinned = 0;
+
+    for(Py_ssize_t i = 0; i < count; ++i) {
+        /* a list may have been changed by an item's buffer code */
+        if(count != PySequence_Fast_GET_SIZE(seq)) {
+            PyErr_SetString(PyExc_RuntimeError, "sequence changed size during join");
+            goto done;
+        }
+        PyObject *item = PySequence_Fast_GET_ITEM(seq, i);
+        if(_obj_get_buffer(item, &parts[i]) < 0)
+            goto done;
+        ++pinned;
+        if(parts[i].len > PY_SSIZE_T_MAX - 1 - total - (i ? seplen : 0)) {
+            PyErr_NoMemory();
+            goto done;
+        }
+        total += parts[i].len + (i ? seplen : 0);
+
+        Py_ssize_t itemlength;
+        meta &= _obj_text_meta(item, &itemlength);
+        length += itemlength;
+    }
+
+    /* second pass: one allocation, then copy */
+    result = (PyObject *)CSTRING_ALLOC(Py_TYPE(self), total + 1);
+    if(!result)
+        goto done;
+    char *d = CSTRING_VALUE(result);
+    const char *sep = CSTRING_VALUE(self);
+    for(Py_ssize_t i = 0; i < count; ++i) {
+        if(i && seplen) {
+            memcpy(d, sep, seplen);
+            d += seplen;
+        }
+        memcpy(d, parts[i].buf, parts[i].len);
+        d += parts[i].len;
+    }
+    STATS_ADD(bytes_copied, total);
+    if(meta & CSTRING_FLAG_VALID)
+        _cstring_set_meta(result, meta, length);
+
+done:
+    for(Py_ssize_t i = 0; i < pinned; ++i)
+        PyBuffer_Release(&parts[i]);
+    if(parts != stack_parts)
+        PyMem_Free(parts);
+    Py_DECREF(seq);
+    return result;
+}
+
+/* Applies the str method to UTF-8 s[0:n]; returns the result as bytes. */
+static PyObject *_unicode_case_map(const char *s, Py_ssize_t n, const char *method) {
+    PyObject *mapped = _unicode_call_method(s, n, method);
+    if(!mapped)
+        return NULL;
+    PyObject *bytes = PyUnicode_AsEncodedString(mapped, "utf-8", "surrogateescape");
+    Py_DECREF(mapped);
+    return bytes;
+}
+
+static PyObject *_cstring_from_bytes(PyTypeObject *type, PyObject *bytes) {
+    if(!bytes)
+        return NULL;
+    PyObject *result = _cstring_new(type, PyBytes_AS_STRING(bytes), PyBytes_GET_SIZE(bytes));
+    Py_DECREF(bytes);
+    return result;
+}
+
+/*
+ * Case mapping: ASCII runs go through _ascii_case; runs of non-ASCII bytes
+ * (whole UTF-8 sequences, since those never contain ASCII bytes) are
+ * mapped by str, one run at a time, since the mapped length can differ.
+ * `method` names the equivalent str method.
+ */
+static PyObject *_cstring_case_map(PyObject *self, enum _case_op op, const char *method) {
+    const char *s = CSTRING_VALUE(self);
+    Py_ssize_t n = cstring_len(self);
+
+    Py_ssize_t pos = n;
+    if(!CSTRING_KNOWN_ASCII(self)) {
+        CSTRING_BEGIN_ALLOW_THREADS(n)
+        pos = _find_non_ascii(s, n);
+        CSTRING_END_ALLOW_THREADS
+    }
+    if(pos == n) {
+        struct cstring *new = CSTRING_ALLOC(Py_TYPE(self), n + 1);
+        if(!new)
+            return NULL;
+        CSTRING_BEGIN_ALLOW_THREADS(n)
+        _ascii_case_parallel(new->value, s, n, op);
+        CSTRING_END_ALLOW_THREADS
+        _cstring_set_ascii((PyObject *)new);
+        return (PyObject *)new;
+    }
+
+    /* Lowercasing capital sigma depends on the surrounding letters (final
+     * sigma rule), so it can't be done run by run. */
+    if(op != CASE_UPPER)
+        STATS_SEARCH(CASE_MAP);
+    if(op != CASE_UPPER && _memmem(s + pos, n - pos, "\xce\xa3", 2))
+        return _cstring_from_bytes(Py_TYPE(self), _unicode_case_map(s, n, method));
+
+    Py_ssize_t capacity = n;
+    PyObject *new = (PyObject *)CSTRING_ALLOC(Py_TYPE(self), capacity + 1);
+    if(!new)
+        return NULL;
+    Py_ssize_t outlen = 0;
+
+    pos = 0;
+    while(pos < n) {
+        Py_ssize_t ascii = _find_non_ascii(s + pos, n - pos);
+        _ascii_case(CSTRING_VALUE_AT(new, outlen), s + pos, ascii, op);
+        outlen += ascii;
+        pos += ascii;
+        if(pos == n)
+            break;
+
+        Py_ssize_t end = pos;
+        while(end < n && (unsigned char)s[end] >= 0x80)
+            ++end;
+        PyObject *mapped = _unicode_case_map(s + pos, end - pos, method);
+        if(!mapped)
+            goto fail;
+
+        Py_ssize_t needed = outlen + PyBytes_GET_SIZE(mapped) + (n - end);
+        if(needed > capacity) {
+            capacity = Py_MAX(needed, capacity + capacity / 2);
+            PyObject *grown = _cstring_realloc(new, capacity);
+            if(!grown) {
+                Py_DECREF(mapped);
+                goto fail;
+            }
+            new = grown;
+        }
+        memcpy(CSTRING_VALUE_AT(new, outlen), PyBytes_AS_STRING(mapped), PyBytes_GET_SIZE(mapped));
+        outlen += PyBytes_GET_SIZE(mapped);
+        Py_DECREF(mapped);
+        pos = end;
+    }
+
+    if(outlen != capacity) {
+        PyObject *shrunk = _cstring_realloc(new, outlen);
+        if(!shrunk)
+            goto fail;
+        new = shrunk;
+    }
+    CSTRING_LAST_BYTE(new) = '\0';
+    return new;
+
+fail:
+    Py_DECREF(new);
+    return NULL;
+}
+
+PyDoc_STRVAR(lower__doc__, "");
+PyObject *cstring_lower(PyObject *self, PyObject *args) {
+    return _cstring_case_map(self, CASE_LOWER, "lower");
+}
+
+static PyObject *_tuple_steal_refs(Py_ssize_t count, ...) {
+    PyObject *result = PyTuple_New(count);
+    if(!result)
+        return NULL;
+
+    va_list va;
+    va_start(va, count);
+    for(int i = 0; i < count; ++i) {
+        PyObject *o = va_arg(va, PyObject *);
+        if(!o)
+            goto fail;
+        PyTuple_SET_ITEM(result, i, o);
+    }
+    va_end(va);
+
+    return result;
+
+fail:
+    Py_DECREF(result);
+    return NULL;
+}
+
+PyDoc_STRVAR(partition__doc__, "");
+PyObject *cstring_partition(PyObject *self, PyObject *arg) {
+    Py_ssize_t seplen;
+    const char *sep = _obj_as_string_and_size(arg, &seplen);
+    if(!sep)
+        return NULL;
+    if(seplen == 0) {
+        PyErr_SetString(PyExc_ValueError, "empty separator");
+        return NULL;
+    }
+
+    const char *left = CSTRING_VALUE(self);
+    STATS_SEARCH(PARTITION);
+    const char *mid = _memmem(left, cstring_len(self), sep, seplen);
+    if(!mid) {
+        return _tuple_steal_refs(3,
+            (Py_INCREF(self), self),
+            cstring_new_empty(),
+            cstring_new_empty());
+    }
+    const char *right = mid + seplen;
+
+    return _tuple_steal_refs(3,
+        _cstring_substr(self, left, mid - left),
+        _cstring_substr(self, mid, right - mid),
+        _cstring_substr(self, right, CSTRING_END(self) - right));
+}
+
+PyDoc_STRVAR(rpartition__doc__, "");
+PyObject *cstring_rpartition(PyObject *self, PyObject *arg) {
+    Py_ssize_t seplen;
+    const char *sep = _obj_as_string_and_size(arg, &seplen);
+    if(!sep)
+        return NULL;
+    if(seplen == 0) {
+        PyErr_SetString(PyExc_ValueError, "empty separator");
+        return NULL;
+    }
+
+    const char *left = CSTRING_VALUE(self);
+    STATS_SEARCH(PARTITION);
+    const char *mid = _memrmem(left, cstring_len(self), sep, seplen);
+    if(!mid) {
+        return _tuple_steal_refs(3,
+            cstring_new_empty(),
+            cstring_new_empty(),
+            (Py_INCREF(self), self));
+    }
+    const char *right = mid + seplen;
+
+    return _tuple_steal_refs(3,
+        _cstring_substr(self, left, mid - left),
+        _cstring_substr(self, mid, right - mid),
+        _cstring_substr(self, right, CSTRING_END(self) - right));
+}
+
+/* Like str.replace with an empty `old`: `new` before each code point and
+ * at the end, at most count times. */
+static PyObject *_cstring_replace_empty(PyObject *self, const char *new, Py_ssize_t k, Py_ssize_t count) {
+    const char *s = CSTRING_VALUE(self);
+    Py_ssize_t n = cstring_len(self);
+    Py_ssize_t positions = 1;
+    for(Py_ssize_t i = 0; i < n; ++i)
+        positions += i == 0 || !UTF8_IS_CONT(s[i]);
+    Py_ssize_t matches = Py_MIN(count, positions);
+    if(k == 0 || matches == 0) {
+        Py_INCREF(self);
+        return self;
+    }
+    if(k > (PY_SSIZE_T_MAX - 1 - n) / matches)
+        return PyErr_NoMemory();
+
+    struct cstring *result = CSTRING_ALLOC(Py_TYPE(self), n + matches * k + 1);
+    if(!result)
+        return NULL;
+    char *d = result->value;
+    Py_ssize_t i = 0;
+    for(Py_ssize_t j = 0; j < matches; ++j) {
+        memcpy(d, new, k);
+        d += k;
+        if(i < n) {
+            Py_ssize_t start = i++;
+            while(i < n && UTF8_IS_CONT(s[i]))
+                ++i;
+            memcpy(d, s + start, i - start);
+            d += i - start;
+        }
+    }
+    memcpy(d, s + i, n - i);
+    return (PyObject *)result;
+}
+
+/*
+ * Replaces up to count non-overlapping matches of old[0:m] with new[0:k].
+ * Replacements of the same length are made in a copy of self (for single
+ * bytes, in a single substitution pass); otherwise the matches are
+ * counted first, so the result is allocated at its exact size and filled
+ * in one more pass. Returns self if nothing matches.
+ */
+static PyObject *_cstring_replace(PyObject *self, const char *old, Py_ssize_t m, const char *new, Py_ssize_t k, Py_ssize_t count) {
+    const char *s = CSTRING_VALUE(self);
+    Py_ssize_t n = cstring_len(self);
+    const char *end = s + n;
+    if(count < 0)
+        count = PY_SSIZE_T_MAX;
+    if(m == 0)
+        return _cstring_replace_empty(self, new, k, count);
+
+    struct _search search;
+    _search_init(&search, old, m);
+    const char *first = NULL;
+    Py_ssize_t matches = 0;
+    if(count > 0 && m <= n && (m != k || memcmp(old, new, m) != 0)) {
+        CSTRING_BEGIN_ALLOW_THREADS(n)
+        STATS_SEARCH(REPLACE);
+        first = _search_find(&search, s, n);
+        if(first && m != k) {
+            STATS_SEARCH(REPLACE);
+            if(count == PY_SSIZE_T_MAX) {
+                matches = 1 + _search_count_parallel(&search, first + m, end - first - m);
+            } else {
+                for(const char *p = first; p && matches < count; ++matches)
+                    p = _search_find(&search, p + m, end - p - m);
+            }
+        }
+        CSTRING_END_ALLOW_THREADS
+    }
+    if(!first) {
+        Py_INCREF(self);
+        return self;
+    }
+
+    Py_ssize_t size = n;
+    if(m != k) {
+        if(k > m && matches > (PY_SSIZE_T_MAX - 1 - n) / (k - m))
+            return PyErr_NoMemory();
+        size = n + matches * (k - m);
+        if(size == 0)
+            return cstring_new_empty();
+    }
+    struct cstring *result = CSTRING_ALLOC(Py_TYPE(self), size + 1);
+    if(!result)
+        return NULL;
+    char *d = result->value;
+
+    CSTRING_BEGIN_ALLOW_THREADS(n)
+    if(m == 1 && k == 1 && count == PY_SSIZE_T_MAX) {
+        Py_ssize_t pos = first - s;
+        memcpy(d, s, pos);
+        _replace_byte(d + pos, first, n - pos, old[0], new[0]);
+    } else if(m == k) {
+        memcpy(d, s, n);
+        const char *p = first;
+        for(Py_ssize_t i = 0; p && i < count; ++i) {
+            memcpy(d + (p - s), new, k);
+            p = _search_find(&search, p + m, end - p - m);
+        }
+    } else {
+        const char *p = first;
+        const char *copied = s;
+        for(Py_ssize_t i = 0; i < matches; ++i) {
+            memcpy(d, copied, p - copied);
+            d += p - copied;
+            memcpy(d, new, k);
+            d += k;
+            copied = p + m;
+            if(i + 1 < matches)
+                p = _search_find(&search, copied, end - copied);
+        }
+        memcpy(d, copied, end - copied);
+    }
+    CSTRING_END_ALLOW_THREADS
+
+    if(CSTRING_KNOWN_ASCII(self) && _find_non_ascii(new, k) == k)
+        _cstring_set_ascii((PyObject *)result);
+    return (PyObject *)result;
+}
+
+PyDoc_STRVAR(replace__doc__, "");
+PyObject *cstring_replace(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    static const char *const kwlist[] = {"", "", "count", NULL};
+    PyObject *argv[3];
+    Py_ssize_t count = -1;
+    if(_parse_args("replace", args, nargs, kwnames, kwlist, 2, argv) < 0)
+        return NULL;
+    if(argv[2] && _arg_ssize(argv[2], &count) < 0)
+        return NULL;
+    PyObject *oldobj = argv[0];
+    PyObject *newobj = argv[1];
+
+    Py_buffer old;
+    Py_buffer new;
+    if(_obj_get_buffer(oldobj, &old) < 0)
+        return NULL;
+    if(_obj_get_buffer(newobj, &new) < 0) {
+        PyBuffer_Release(&old);
+        return NULL;
+    }
+    PyObject *result = _cstring_replace(self, old.buf, old.len, new.buf, new.len, count);
+    PyBuffer_Release(&old);
+    PyBuffer_Release(&new);
+    return result;
+}
+
+/*
+ * Translation tables (maketrans/translate). Mappings of single bytes to
+ * single bytes (or to nothing) are kept as a 256-byte lookup table and a
+ * table of which bytes are kept. Mappings of str arguments that involve
+ * non-ASCII characters are multibyte in UTF-8; those tables hold a
+ * str.maketrans table instead and are applied by str.translate.
+ */
+
+struct translation {
+    PyObject_HEAD
+    unsigned char map[256];
+    unsigned char keep[256];    /* 0 if the byte is deleted */
+    int deletes;                /* any byte is deleted */
+    int ascii;                  /* only ASCII bytes change, to ASCII bytes */
+    int groups;                 /* 16-byte rows of map with changes: 8 (ASCII only) or 16 */
+    PyObject *mapping;          /* str.maketrans table, or NULL */
+};
+
+static PyTypeObject translation_type;
+
+static struct translation *_translation_new(void) {
+    struct translation *t = PyObject_New(struct translation, &translation_type);
+    if(!t)
+        return NULL;
+    for(int c = 0; c < 256; ++c) {
+        t->map[c] = (unsigned char)c;
+        t->keep[c] = 1;
+    }
+    t->deletes = 0;
+    t->ascii = 1;
+    t->groups = 8;
+    t->mapping = NULL;
+    return t;
+}
+
+static void translation_dealloc(PyObject *self) {
+    Py_XDECREF(((struct translation *)self)->mapping);
+    PyObject_Del(self);
+}
+
+/* Maps byte `key` to `value`, or deletes it if value is -1. */
+static void _translation_set(struct translation *t, int key, int value) {
+    if(value < 0) {
+        t->keep[key] = 0;
+        t->deletes = 1;
+    } else {
+        t->map[key] = (unsigned char)value;
+        t->keep[key] = 1;
+    }
+    if(key >= 0x80 || value >= 0x80)
+        t->ascii = 0;
+    if(key >= 0x80)
+        t->groups = 16;
+}
+
+/* The ASCII code of a code point (int) or one-character str, -1 if it is
+ * anything else, or -2 on error. */
+static int _translation_char(PyObject *o) {
+    if(PyLong_Check(o)) {
+        long c = PyLong_AsLong(o);
+        if(c == -1 && PyErr_Occurred())
+            return -2;
+        return c >= 0 && c < 0x80 ? (int)c : -1;
+    }
+    if(PyUnicode_Check(o) && PyUnicode_GET_LENGTH(o) == 1 && PyUnicode_IS_ASCII(o))
+        return PyUnicode_READ_CHAR(o, 0);
+    return -1;
+}
+
+/* A table for a str.translate-style dict, from code points to characters,
+ * strings or None. As for str.maketrans, with char_keys one-character str
+ * keys are taken as their code points; otherwise, as for str.translate,
+ * keys that aren't ints are never looked up and so are skipped. */
+static struct translation *_translation_from_dict(PyObject *dict, int char_keys) {
+    struct translation *t = _translation_new();
+    if(!t)
+        return NULL;
+
+    PyObject *key, *value;
+    Py_ssize_t pos = 0;
+    while(PyDict_Next(dict, &pos, &key, &value)) {
+        if(!char_keys && !PyLong_Check(key))
+            continue;
+        int deleted = value == Py_None || (PyUnicode_Check(value) && PyUnicode_GET_LENGTH(value) == 0);
+        int k = _translation_char(key);
+        int v = deleted ? -1 : _translation_char(value);
+        if(k == -2 || v == -2) {
+            Py_DECREF(t);
+            return NULL;
+        }
+        if(k == -1 || (v == -1 && !deleted)) {
+            /* not byte to byte: let str handle the whole table */
+            t->mapping = PyObject_CallMethod((PyObject *)&PyUnicode_Type, "maketrans", "O", dict);
+            if(!t->mapping) {
+                Py_DECREF(t);
+                return NULL;
+            }
+            return t;
+        }
+        _translation_set(t, k, v);
+    }
+    return t;
+}
+
+PyDoc_STRVAR(maketrans__doc__, "");
+PyObject *cstring_maketrans(PyObject *cls, PyObject *const *args, Py_ssize_t nargs) {
+    if(_check_nargs("maketrans", nargs, 1, 3) < 0)
+        return NULL;
+    PyObject *x = args[0];
+    PyObject *y = nargs > 1 ? args[1] : NULL;
+    PyObject *z = nargs > 2 ? args[2] : NULL;
+
+    if(!y) {
+        if(!PyDict_Check(x)) {
+            PyErr_SetString(PyExc_TypeError, "if you give only one argument to maketrans it must be a dict");
+            return NULL;
+        }
+        return (PyObject *)_translation_from_dict(x, 1);
+    }
+
+    /* str arguments with non-ASCII characters map characters, not bytes */
+    PyObject *strs[] = {x, y, z};
+    for(int i = 0; i < 3; ++i) {
+        if(strs[i] && PyUnicode_Check(strs[i]) && !PyUnicode_IS_ASCII(strs[i])) {
+            struct translation *t = _translation_new();
+            if(!t)
+                return NULL;
+            t->mapping = z ? PyObject_CallMethod((PyObject *)&PyUnicode_Type, "maketrans", "OOO", x, y, z)
+                : PyObject_CallMethod((PyObject *)&PyUnicode_Type, "maketrans", "OO", x, y);
+            if(!t->mapping) {
+                Py_DECREF(t);
+                return NULL;
+            }
+            return (PyObject *)t;
+        }
+    }
+
+    /* the buffers are held until the table is filled, as getting one
+     * can run Python code */
+    Py_buffer views[3];
+    int pinned = 0;
+    struct translation *t = NULL;
+    for(; pinned < 3 && strs[pinned]; ++pinned) {
+        if(_obj_get_buffer(strs[pinned], &views[pinned]) < 0)
+            goto done;
+    }
+    if(views[0].len != views[1].len) {
+        PyErr_SetString(PyExc_ValueError, "the first two maketrans arguments must have equal length");
+        goto done;
+    }
+
+    if(!(t = _translation_new()))
+        goto done;
+    const unsigned char *xs = views[0].buf, *ys = views[1].buf;
+    for(Py_ssize_t i = 0; i < views[0].len; ++i)
+        _translation_set(t, xs[i], ys[i]);
+    if(z) {
+        const unsigned char *zs = views[2].buf;
+        for(Py_ssize_t i = 0; i < views[2].len; ++i)
+            _translation_set(t, zs[i], -1);
+    }
+
+done:
+    while(pinned > 0)
+        PyBuffer_Release(&views[--pinned]);
+    return (PyObject *)t;
+}
+
+static PyObject *_cstring_translate_str(PyObject *self, PyObject *mapping) {
+    PyObject *str = cstring_str(self);
+    if(!str)
+        return NULL;
+    PyObject *translated = PyObject_CallMethod(str, "translate", "O", mapping);
+    Py_DECREF(str);
+    if(!translated)
+        return NULL;
+    PyObject *bytes = PyUnicode_AsEncodedString(translated, "utf-8", "surrogateescape");
+    Py_DECREF(translated);
+    return _cstring_from_bytes(Py_TYPE(self), bytes);
+}
+
+static PyObject *_cstring_translate(PyObject *self, struct translation *t) {
+    if(t->mapping)
+        return _cstring_translate_str(self, t->mapping);
+
+    const char *s = CSTRING_VALUE(self);
+    Py_ssize_t n = cstring_len(self);
+    Py_ssize_t i = 0;
+    CSTRING_BEGIN_ALLOW_THREADS(n)
+    while(i < n && t->map[(unsigned char)s[i]] == (unsigned char)s[i] && t->keep[(unsigned char)s[i]])
+        ++i;
+    CSTRING_END_ALLOW_THREADS
+    if(i == n) {
+        Py_INCREF(self);
+        return self;
+    }
+
+    PyObject *result = (PyObject *)CSTRING_ALLOC(Py_TYPE(self), n + 1);
+    if(!result)
+        return NULL;
+    char *d = CSTRING_VALUE(result);
+    Py_ssize_t len = n;
+    memcpy(d, s, i);
+    CSTRING_BEGIN_ALLOW_THREADS(n)
+    if(t->deletes)
+        len = i + _translate_compact(d + i, s + i, n - i, t->map, t->keep);
+    else
+        _translate(d + i, s + i, n - i, t->map, t->groups);
+    CSTRING_END_ALLOW_THREADS
+
+    if(len == 0) {
+        Py_DECREF(result);
+        return cstring_new_empty();
+    }
+    if(len != n) {
+        PyObject *shrunk = _cstring_realloc(result, len);
+        if(!shrunk) {
+            Py_DECREF(result);
+            return NULL;
+        }
+        result = shrunk;
+        CSTRING_LAST_BYTE(result) = '\0';
+    }
+    if(t->ascii && CSTRING_KNOWN_ASCII(self))
+        _cstring_set_ascii(result);
+    return result;
+}
+
+PyDoc_STRVAR(translate__doc__, "");
+PyObject *cstring_translate(PyObject *self, PyObject *arg) {
+    if(Py_TYPE(arg) == &translation_type)
+        return _cstring_translate(self, (struct translation *)arg);
+
+    struct translation *t;
+    if(PyDict_Check(arg)) {
+        t = _translation_from_dict(arg, 0);
+    } else if(PyObject_CheckBuffer(arg)) {
+        /* a 256-byte table, as for bytes.translate */
+        Py_buffer view;
+        if(PyObject_GetBuffer(arg, &view, PyBUF_SIMPLE) < 0)
+            return NULL;
+        if(view.len != 256) {
+            PyBuffer_Release(&view);
+            PyErr_SetString(PyExc_ValueError, "translation table must be 256 characters long");
+            return NULL;
+        }
+        if((t = _translation_new()) != NULL) {
+            for(int c = 0; c < 256; ++c) {
+                if(((unsigned char *)view.buf)[c] != c)
+                    _translation_set(t, c, ((unsigned char *)view.buf)[c]);
+            }
+        }
+        PyBuffer_Release(&view);
+    } else {
+        /* any other mapping, looked up by str.translate */
+        return _cstring_translate_str(self, arg);
+    }
+    if(!t)
+        return NULL;
+    PyObject *result = _cstring_translate(self, t);
+    Py_DECREF(t);
+    return result;
+}
+
+static PyTypeObject translation_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "cstring.TranslationTable",
+    .tp_basicsize = sizeof(struct translation),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = translation_dealloc,
+};
+
+PyDoc_STRVAR(rfind__doc__, "");
+PyObject *cstring_rfind(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    struct _substr_params params;
+
+    if(!_parse_substr_args(self, "rfind", args, nargs, &params))
+        return NULL;
+
+    const char *p = _substr_params_rstr(&params);
+
+    if(!p)
+        return PyLong_FromLong(-1);
+
+    return PyLong_FromSsize_t(p - CSTRING_VALUE(self));
+}
+
+PyDoc_STRVAR(rindex__doc__, "");
+PyObject *cstring_rindex(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    struct _substr_params params;
+
+    if(!_parse_substr_args(self, "rindex", args, nargs, &params))
+        return NULL;
+
+    const char *p = _substr_params_rstr(&params);
+    if(!p) {
+        PyErr_SetString(PyExc_ValueError, "substring not found");
+        return NULL;
+    }
+
+    return PyLong_FromSsize_t(p - CSTRING_VALUE(self));
+}
+
+/* Appends [start:end) of self, or a new cstring copy if self is NULL. */
+static int _list_append_substr(PyObject *list, PyObject *self, const char *start, const char *end) {
+    PyObject *new = self
+        ? _cstring_substr(self, start, end - start)
+        : _cstring_new(&cstring_type, start, end - start);
+    if(!new)
+        return -1;
+    int result = PyList_Append(list, new);
+    Py_DECREF(new);
+    return result;
+}
+
+static int _is_sep(const char seps[], char c) {
+    return memchr(seps, c, strlen(seps)) != NULL;
+}
+
+/*
+ * Splitting. A struct _splitter walks the text and hands out one piece at
+ * a time, so the list-building methods and the lazy iterators share the
+ * same code, and an iterator stopped early never looks at the rest.
+ */
+
+enum _split_mode {
+    SPLIT_WHITESPACE,   /* runs of WHITESPACE_CHARS */
+    SPLIT_SEARCH,       /* occurrences of search */
+    SPLIT_LINES,        /* line boundaries, as str.splitlines */
+};
+
+struct _splitter {
+    const char *s;      /* unconsumed text is [s:stop) */
+    const char *stop;
+    enum _split_mode mode;
+    struct _search search;
+    Py_ssize_t maxsplit;    /* splits left */
+    int keepends;
+    int done;
+};
+
+#define IS_WHITESPACE(c)    ((c) == ' ' || (unsigned char)((c) - '\t') < 5)
+
+static void _splitter_init(struct _splitter *sp, const char *s, const char *stop, enum _split_mode mode, Py_ssize_t maxsplit) {
+    sp->s = s;
+    sp->stop = stop;
+    sp->mode = mode;
+    sp->maxsplit = maxsplit < 0 ? PY_SSIZE_T_MAX : maxsplit;
+    sp->keepends = 0;
+    sp->done = 0;
+}
+
+/* Next piece from the left into [*start:*end); returns 0 when done. */
+static int _split_next(struct _splitter *sp, const char **start, const char **end) {
+    if(sp->done)
+        return 0;
+    const char *s = sp->s;
+    const char *stop = sp->stop;
+    const char *e;
+    Py_ssize_t brklen;
+
+    switch(sp->mode) {
+    case SPLIT_WHITESPACE:
+        while(s < stop && IS_WHITESPACE(*s))
+            ++s;
+        if(s == stop) {
+            sp->done = 1;
+            return 0;
+        }
+        if(sp->maxsplit == 0) {
+            e = stop;
+            break;
+        }
+        e = s;
+        while(e < stop && !IS_WHITESPACE(*e))
+            ++e;
+        sp->maxsplit--;
+        break;
+
+    case SPLIT_SEARCH:
+        STATS_SEARCH(SPLIT);
+        e = sp->maxsplit > 0 ? _search_find(&sp->search, s, stop - s) : NULL;
+        if(!e) {
+            sp->done = 1;
+            *start = s;
+            *end = stop;
+            return 1;
+        }
+        sp->maxsplit--;
+        *start = s;
+        *end = e;
+        sp->s = e + sp->search.len;
+        return 1;
+
+    case SPLIT_LINES:
+        if(s == stop) {
+            sp->done = 1;
+            return 0;
+        }
+        e = s + _find_line_break(s, stop - s, &brklen);
+        *start = s;
+        *end = sp->keepends ? e + brklen : e;
+        sp->s = e + brklen;
+        return 1;
+
+    default:
+        Py_UNREACHABLE();
+    }
+
+    *start = s;
+    *end = e;
+    sp->s = e;
+    return 1;
+}
+
+/* Next piece from the right (whitespace and search modes). */
+static int _split_prev(struct _splitter *sp, const char **start, const char **end) {
+    if(sp->done)
+        return 0;
+    const char *s = sp->s;
+    const char *stop = sp->stop;
+    const char *b;
+
+    if(sp->mode == SPLIT_WHITESPACE) {
+        while(stop > s && IS_WHITESPACE(stop[-1]))
+            --stop;
+        if(stop == s) {
+            sp->done = 1;
+            return 0;
+        }
+        if(sp->maxsplit == 0) {
+            b = s;
+        } else {
+            b = stop;
+            while(b > s && !IS_WHITESPACE(b[-1]))
+                --b;
+            sp->maxsplit--;
+        }
+        *start = b;
+        *end = stop;
+        sp->stop = b;
+        return 1;
+    }
+
+    STATS_SEARCH(SPLIT);
+    b = sp->maxsplit > 0 ? _search_rfind(&sp->search, s, stop - s) : NULL;
+    if(!b) {
+        sp->done = 1;
+        *start = s;
+        *end = stop;
+        return 1;
+    }
+    sp->maxsplit--;
+    *start = b + sp->search.len;
+    *end = stop;
+    sp->stop = b;
+    return 1;
+}
+
+/* Collects all pieces; they refer to owner (see _list_append_substr). */
+static PyObject *_split_to_list(PyObject *owner, struct _splitter *sp, int reverse) {
+    PyObject *list = PyList_New(0);
+    if(!list)
+        return NULL;
+
+    const char *start, *end;
+    while(reverse ? _split_prev(sp, &start, &end) : _split_next(sp, &start, &end)) {
+        if(_list_append_substr(list, owner, start, end) < 0) {
+            Py_DECREF(list);
+            return NULL;
+        }
+    }
+
+    if(reverse && PyList_Reverse(list) < 0) {
+        Py_DECREF(list);
+        return NULL;
+    }
+    return list;
+}
+
+/* Splits [s:stop) on search; pieces refer to owner (see _list_append_substr). */
+static PyObject *_split_on_search(PyObject *owner, const char *s, const char *stop, struct _search *search, Py_ssize_t maxsplit) {
+    if(search->len == 0) {
+        PyErr_SetString(PyExc_ValueError, "empty separator");
+        return NULL;
+    }
+
+    struct _splitter sp;
+    _splitter_init(&sp, s, stop, SPLIT_SEARCH, maxsplit);
+    sp.search = *search;
+    return _split_to_list(owner, &sp, 0);
+}
+
+/*
+ * Sets up sp for splitting self on sepobj (None for whitespace). If a
+ * separator is given, its storage is pinned in *sepview, which the caller
+ * releases when done with sp.
+ */
+static int _cstring_splitter(PyObject *self, PyObject *sepobj, Py_ssize_t maxsplit, struct _splitter *sp, Py_buffer *sepview) {
+    sepview->obj = NULL;
+    if(sepobj == Py_None) {
+        _splitter_init(sp, CSTRING_VALUE(self), CSTRING_END(self), SPLIT_WHITESPACE, maxsplit);
+        return 0;
+    }
+
+    if(_obj_get_buffer(sepobj, sepview) < 0)
+        return -1;
+    if(sepview->len == 0) {
+        PyBuffer_Release(sepview);
+        PyErr_SetString(PyExc_ValueError, "empty separator");
+        return -1;
+    }
+    _splitter_init(sp, CSTRING_VALUE(self), CSTRING_END(self), SPLIT_SEARCH, maxsplit);
+    _search_init(&sp->search, sepview->buf, sepview->len);
+    return 0;
+}
+
+/* Parses the (sep=None, maxsplit=-1) arguments of the split family. */
+static int _parse_split_args(const char *name, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames,
+                             PyObject **sepobj, Py_ssize_t *maxsplit) {
+    static const char *const kwlist[] = {"sep", "maxsplit", NULL};
+    PyObject *argv[2];
+    if(_parse_args(name, args, nargs, kwnames, kwlist, 0, argv) < 0)
+        return -1;
+    *sepobj = argv[0] ? argv[0] : Py_None;
+    *maxsplit = -1;
+    return argv[1] ? _arg_ssize(argv[1], maxsplit) : 0;
+}
+
+/* Parses the (keepends=False) argument of the splitlines family. */
+static int _parse_keepends_arg(const char *name, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames,
+                               int *keepends) {
+    static const char *const kwlist[] = {"keepends", NULL};
+    PyObject *argv[1];
+    if(_parse_args(name, args, nargs, kwnames, kwlist, 0, argv) < 0)
+        return -1;
+    *keepends = 0;
+    return argv[0] ? _arg_bool(argv[0], keepends) : 0;
+}
+
+static PyObject *_cstring_split(PyObject *self, const char *name, PyObject *const *args, Py_ssize_t nargs,
+                                PyObject *kwnames, int reverse) {
+    PyObject *sepobj;
+    Py_ssize_t maxsplit;
+    if(_parse_split_args(name, args, nargs, kwnames, &sepobj, &maxsplit) < 0)
+        return NULL;
+
+    struct _splitter sp;
+    Py_buffer sepview;
+    if(_cstring_splitter(self, sepobj, maxsplit, &sp, &sepview) < 0)
+        return NULL;
+    PyObject *result = _split_to_list(self, &sp, reverse);
+    if(sepview.obj)
+        PyBuffer_Release(&sepview);
+    return result;
+}
+
+PyDoc_STRVAR(split__doc__, "");
+PyObject *cstring_split(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    return _cstring_split(self, "split", args, nargs, kwnames, 0);
+}
+
+PyDoc_STRVAR(rsplit__doc__, "");
+PyObject *cstring_rsplit(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    return _cstring_split(self, "rsplit", args, nargs, kwnames, 1);
+}
+
+PyDoc_STRVAR(splitlines__doc__, "");
+PyObject *cstring_splitlines(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    int keepends;
+    if(_parse_keepends_arg("splitlines", args, nargs, kwnames, &keepends) < 0)
+        return NULL;
+
+    struct _splitter sp;
+    _splitter_init(&sp, CSTRING_VALUE(self), CSTRING_END(self), SPLIT_LINES, -1);
+    sp.keepends = keepends;
+    return _split_to_list(self, &sp, 0);
+}
+
+/*
+ * Lazy versions of split and splitlines.
+ */
+
+struct splititer {
+    PyObject_HEAD
+    PyObject *string;
+    Py_buffer sepview;
+    struct _splitter splitter;
+};
+
+static PyTypeObject splititer_type;
+
+static struct splititer *_splititer_new(PyObject *self) {
+    struct splititer *iter = PyObject_New(struct splititer, &splititer_type);
+    if(!iter)
+        return NULL;
+    Py_INCREF(self);
+    iter->string = self;
+    iter->sepview.obj = NULL;
+    return iter;
+}
+
+PyDoc_STRVAR(itersplit__doc__, "");
+PyObject *cstring_itersplit(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    PyObject *sepobj;
+    Py_ssize_t maxsplit;
+    if(_parse_split_args("itersplit", args, nargs, kwnames, &sepobj, &maxsplit) < 0)
+        return NULL;
+
+    struct splititer *iter = _splititer_new(self);
+    if(!iter)
+        return NULL;
+    if(_cstring_splitter(self, sepobj, maxsplit, &iter->splitter, &iter->sepview) < 0) {
+        Py_DECREF(iter);
+        return NULL;
+    }
+    return (PyObject *)iter;
+}
+
+PyDoc_STRVAR(itersplitlines__doc__, "");
+PyObject *cstring_itersplitlines(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    int keepends;
+    if(_parse_keepends_arg("itersplitlines", args, nargs, kwnames, &keepends) < 0)
+        return NULL;
+
+    struct splititer *iter = _splititer_new(self);
+    if(!iter)
+        return NULL;
+    _splitter_init(&iter->splitter, CSTRING_VALUE(self), CSTRING_END(self), SPLIT_LINES, -1);
+    iter->splitter.keepends = keepends;
+    return (PyObject *)iter;
+}
+
+static void splititer_dealloc(PyObject *self) {
+    struct splititer *iter = (struct splititer *)self;
+    if(iter->sepview.obj)
+        PyBuffer_Release(&iter->sepview);
+    Py_XDECREF(iter->string);
+    PyObject_Del(self);
+}
+
+static PyObject *_splititer_next(PyObject *self) {
+    struct splititer *iter = (struct splititer *)self;
+    const char *start, *end;
+    if(!_split_next(&iter->splitter, &start, &end))
+        return NULL;
+    return _cstring_substr(iter->string, start, end - start);
+}
+
+/* next() on an iterator shared between threads runs one call at a time */
+static PyObject *splititer_next(PyObject *self) {
+    PyObject *result;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    result = _splititer_next(self);
+    Py_END_CRITICAL_SECTION();
+    return result;
+}
+
+static PyTypeObject splititer_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "cstring.split_iterator",
+    .tp_basicsize = sizeof(struct splititer),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = splititer_dealloc,
+    .tp_iter = PyObject_SelfIter,
+    .tp_iternext = splititer_next,
+};
+
+PyDoc_STRVAR(startswith__doc__, "");
+PyObject *cstring_startswith(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    struct _substr_params params;
+    if(!_parse_substr_args(self, "startswith", args, nargs, &params))
+        return NULL;
+    int cmp = params.end - params.start < params.substr_len
+        || memcmp(params.start, params.substr, params.substr_len);
+    PyBuffer_Release(&params.view);
+    return PyBool_FromLong(cmp == 0);
+}
+
+const char *_strip_chars_from_args(const char *name, PyObject *const *args, Py_ssize_t nargs) {
+    if(_check_nargs(name, nargs, 0, 1) < 0)
+        return NULL;
+    PyObject *charsobj = nargs > 0 ? args[0] : NULL;
+
+    const char *chars = WHITESPACE_CHARS;
+
+    if(charsobj && charsobj != Py_None) {
+        if(!PyUnicode_Check(charsobj))
+            return _bad_argument_type(charsobj);
+        chars = PyUnicode_AsUTF8(charsobj);
+    }
+
+    return chars;
+}
+
+static const char *_lstrip_chars(const char *start, const char *end, const char *chars) {
+    while(start < end && _is_sep(chars, *start))
+        ++start;
+    return start;
+}
+
+static const char *_rstrip_chars(const char *start, const char *end, const char *chars) {
+    while(end > start && _is_sep(chars, end[-1]))
+        --end;
+    return end;
+}
+
+PyDoc_STRVAR(strip__doc__, "");
+PyObject *cstring_strip(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    const char *chars = _strip_chars_from_args("strip", args, nargs);
+    if(!chars)
+        return NULL;
+
+    const char *start = _lstrip_chars(CSTRING_VALUE(self), CSTRING_END(self), chars);
+    const char *end = _rstrip_chars(start, CSTRING_END(self), chars);
+
+    return _cstring_substr(self, start, end - start);
+}
+
+PyDoc_STRVAR(lstrip__doc__, "");
+PyObject *cstring_lstrip(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    const char *chars = _strip_chars_from_args("lstrip", args, nargs);
+    if(!chars)
+        return NULL;
+
+    const char *start = _lstrip_chars(CSTRING_VALUE(self), CSTRING_END(self), chars);
+    const char *end = CSTRING_END(self);
+
+    return _cstring_substr(self, start, end - start);
+}
+
+PyDoc_STRVAR(rstrip__doc__, "");
+PyObject *cstring_rstrip(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    const char *chars = _strip_chars_from_args("rstrip", args, nargs);
+    if(!chars)
+        return NULL;
+
+    const char *start = CSTRING_VALUE(self);
+    const char *end = _rstrip_chars(start, CSTRING_END(self), chars);
+
+    return _cstring_substr(self, start, end - start);
+}
+
+PyDoc_STRVAR(endswith__doc__, "");
+PyObject *cstring_endswith(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    struct _substr_params params;
+    if(!_parse_substr_args(self, "endswith", args, nargs, &params))
+        return NULL;
+    int cmp = params.end - params.start < params.substr_len
+        || memcmp(params.end - params.substr_len, params.substr, params.substr_len);
+    PyBuffer_Release(&params.view);
+    return PyBool_FromLong(cmp == 0);
+}
+
+PyDoc_STRVAR(swapcase__doc__, "");
+PyObject *cstring_swapcase(PyObject *self, PyObject *args) {
+    return _cstring_case_map(self, CASE_SWAP, "swapcase");
+}
+
+PyDoc_STRVAR(upper__doc__, "");
+PyObject *cstring_upper(PyObject *self, PyObject *args) {
+    return _cstring_case_map(self, CASE_UPPER, "upper");
+}
+
+PyDoc_STRVAR(casefold__doc__, "");
+PyObject *cstring_casefold(PyObject *self, PyObject *args) {
+    /* ASCII casefolding is lowercasing */
+    return _cstring_case_map(self, CASE_LOWER, "casefold");
+}
+
+PyDoc_STRVAR(capitalize__doc__, "");
+PyObject *cstring_capitalize(PyObject *self, PyObject *args) {
+    const char *s = CSTRING_VALUE(self);
+    Py_ssize_t n = cstring_len(self);
+
+    if(!CSTRING_KNOWN_ASCII(self) && _find_non_ascii(s, n) < n)
+        return _cstring_from_bytes(Py_TYPE(self), _unicode_case_map(s, n, "capitalize"));
+
+    struct cstring *new = CSTRING_ALLOC(Py_TYPE(self), n + 1);
+    if(!new)
+        return NULL;
+    if(n > 0) {
+        new->value[0] = _ascii_case_byte(s[0], CASE_UPPER);
+        _ascii_case(&new->value[1], s + 1, n - 1, CASE_LOWER);
+    }
+    return (PyObject *)new;
+}
+
+PyDoc_STRVAR(title__doc__, "");
+PyObject *cstring_title(PyObject *self, PyObject *args) {
+    const char *s = CSTRING_VALUE(self);
+    Py_ssize_t n = cstring_len(self);
+
+    if(!CSTRING_KNOWN_ASCII(self) && _find_non_ascii(s, n) < n)
+        return _cstring_from_bytes(Py_TYPE(self), _unicode_case_map(s, n, "title"));
+
+    struct cstring *new = CSTRING_ALLOC(Py_TYPE(self), n + 1);
+    if(!new)
+        return NULL;
+    int previous_is_cased = 0;
+    for(Py_ssize_t i = 0; i < n; ++i) {
+        char c = s[i];
+        int cased = ((unsigned char)c | 0x20) >= 'a' && ((unsigned char)c | 0x20) <= 'z';
+        new->value[i] = !cased ? c
+            : _ascii_case_byte(c, previous_is_cased ? CASE_LOWER : CASE_UPPER);
+        previous_is_cased = cased;
+    }
+    return (PyObject *)new;
+}
+
+/* The code point at the start of s[0:n], which must be valid UTF-8. */
+static PyObject *_cstring_char_new(const char *s, Py_ssize_t n) {
+    if((unsigned char)s[0] < 0x80)
+        return cstring_new_byte(s[0]);
+
+    Py_ssize_t len = 1;
+    while(len < n && UTF8_IS_CONT(s[len]))
+        ++len;
+    PyObject *new = _cstring_new(&cstring_type, s, len);
+    if(new)
+        _cstring_set_meta(new, CSTRING_FLAG_VALID, 1);
+    return new;
+}
+
+PyDoc_STRVAR(char_len__doc__, "");
+PyObject *cstring_char_len(PyObject *self, PyObject *args) {
+    if(_cstring_ensure_valid(self) < 0)
+        return NULL;
+    return PyLong_FromSsize_t(CSTRING_LENGTH(self));
+}
+
+PyDoc_STRVAR(char_at__doc__, "");
+PyObject *cstring_char_at(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    Py_ssize_t i;
+    if(_check_nargs("char_at", nargs, 1, 1) < 0 || _arg_ssize(args[0], &i) < 0)
+        return NULL;
+    if(_cstring_ensure_valid(self) < 0)
+        return NULL;
+
+    Py_ssize_t length = CSTRING_LENGTH(self);
+    if(i < 0)
+        i += length;
+    if(i < 0 || i >= length) {
+        PyErr_SetString(PyExc_IndexError, "Index out of bounds");
+        return NULL;
+    }
+
+    Py_ssize_t off = _cstring_char_offset(self, i);
+    if(off < 0)
+        return NULL;
+    return _cstring_char_new(CSTRING_VALUE_AT(self, off), cstring_len(self) - off);
+}
+
+PyDoc_STRVAR(char_slice__doc__, "");
+PyObject *cstring_char_slice(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    Py_ssize_t start = 0;
+    Py_ssize_t end = PY_SSIZE_T_MAX;
+    if(_check_nargs("char_slice", nargs, 0, 2) < 0)
+        return NULL;
+    if(nargs > 0 && _arg_ssize(args[0], &start) < 0)
+        return NULL;
+    if(nargs > 1 && _arg_ssize(args[1], &end) < 0)
+        return NULL;
+    if(_cstring_ensure_valid(self) < 0)
+        return NULL;
+
+    Py_ssize_t length = CSTRING_LENGTH(self);
+    start = _fix_index(start, length);
+    end = _fix_index(end, length);
+    if(end < start)
+        end = start;
+
+    Py_ssize_t startoff = _cstring_char_offset(self, start);
+    if(startoff < 0)
+        return NULL;
+    Py_ssize_t endoff = _cstring_char_offset(self, end);
+    if(endoff < 0)
+        return NULL;
+
+    PyObject *result = _cstring_substr(self, CSTRING_VALUE_AT(self, startoff), endoff - startoff);
+    if(result && !(CSTRING_FLAGS(result) & CSTRING_FLAG_META))
+        _cstring_set_meta(result, CSTRING_FLAG_VALID, end - start);
+    return result;
+}
+
+PyDoc_STRVAR(materialize__doc__, "");
+PyObject *cstring_materialize(PyObject *self, PyObject *args) {
+    if(!CSTRING_IS_VIEW(self)) {
+        Py_INCREF(self);
+        return self;
+    }
+    return _cstring_copy(self);
+}
+
+PyDoc_STRVAR(view__doc__, "");
+PyObject *cstring_view(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    Py_ssize_t start = 0;
+    Py_ssize_t end = PY_SSIZE_T_MAX;
+    if(_check_nargs("view", nargs, 0, 2) < 0)
+        return NULL;
+    if(nargs > 0 && _arg_ssize(args[0], &start) < 0)
+        return NULL;
+    if(nargs > 1 && _arg_ssize(args[1], &end) < 0)
+        return NULL;
+
+    start = _fix_index(start, cstring_len(self));
+    end = _fix_index(end, cstring_len(self));
+    if(end < start)
+        end = start;
+
+    return _cstring_view_new(self, CSTRING_VALUE_AT(self, start), end - start);
+}
+
+/*
+ * File-backed strings: views whose base is a memoryview of a read-only
+ * mmap. While exported, the mmap can't be closed or resized, so the
+ * mapping lives exactly as long as the views of it.
+ */
+
+static PyObject *_cstring_from_mapping(PyObject *mapping, const char *errors) {
+    if(_check_errors(errors) < 0)
+        return NULL;
+    PyObject *base = PyMemoryView_FromObject(mapping);
+    if(!base)
+        return NULL;
+    Py_buffer *buffer = PyMemoryView_GET_BUFFER(base);
+    if(!buffer->readonly || !PyBuffer_IsContiguous(buffer, 'C')) {
+        PyErr_SetString(PyExc_ValueError, "mapping must be read-only (mmap.ACCESS_READ)");
+        Py_DECREF(base);
+        return NULL;
+    }
+    PyObject *new = _cstring_view_alloc(base, buffer->buf, buffer->len);
+    Py_DECREF(base);
+    if(!new)
+        return NULL;
+    return _cstring_validated(new, errors);
+}
+
+PyDoc_STRVAR(from_mmap__doc__, "");
+PyObject *cstring_from_mmap(PyObject *type, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    static const char *const kwlist[] = {"mapping", "errors", NULL};
+    PyObject *argv[2];
+    const char *errors = "strict";
+    if(_parse_args("from_mmap", args, nargs, kwnames, kwlist, 1, argv) < 0)
+        return NULL;
+    if(argv[1] && _arg_str(argv[1], "errors", &errors) < 0)
+        return NULL;
+    PyObject *mapping = argv[0];
+
+    /* only an mmap's read-only buffer is immutable: a read-only view of
+     * other memory (such as memoryview(bytearray).toreadonly()) isn't */
+    PyObject *module = PyImport_ImportModule("mmap");
+    if(!module)
+        return NULL;
+    PyObject *mmap_type = PyObject_GetAttrString(module, "mmap");
+    Py_DECREF(module);
+    if(!mmap_type)
+        return NULL;
+    int is_mmap = PyObject_IsInstance(mapping, mmap_type);
+    Py_DECREF(mmap_type);
+    if(is_mmap < 0)
+        return NULL;
+    if(!is_mmap) {
+        PyErr_Format(PyExc_TypeError, "from_mmap() argument must be mmap.mmap, not %.50s", Py_TYPE(mapping)->tp_name);
+        return NULL;
+    }
+    return _cstring_from_mapping(mapping, errors);
+}
+
+/* mmap.mmap(fileno, 0, access=mmap.ACCESS_READ) */
+static PyObject *_mmap_for_reading(PyObject *fileno) {
+    PyObject *module = PyImport_ImportModule("mmap");
+    if(!module)
+        return NULL;
+    PyObject *result = NULL;
+    PyObject *access = PyObject_GetAttrString(module, "ACCESS_READ");
+    PyObject *mmap_type = PyObject_GetAttrString(module, "mmap");
+    PyObject *args = Py_BuildValue("(Oi)", fileno, 0);
+    PyObject *kwargs = access ? Py_BuildValue("{s:O}", "access", access) : NULL;
+    if(mmap_type && args && kwargs)
+        result = PyObject_Call(mmap_type, args, kwargs);
+    Py_XDECREF(kwargs);
+    Py_XDECREF(args);
+    Py_XDECREF(mmap_type);
+    Py_XDECREF(access);
+    Py_DECREF(module);
+    return result;
+}
+
+PyDoc_STRVAR(from_file__doc__, "");
+PyObject *cstring_from_file(PyObject *type, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    static const char *const kwlist[] = {"path", "errors", NULL};
+    PyObject *argv[2];
+    const char *errors = "strict";
+    if(_parse_args("from_file", args, nargs, kwnames, kwlist, 1, argv) < 0)
+        return NULL;
+    if(argv[1] && _arg_str(argv[1], "errors", &errors) < 0)
+        return NULL;
+    PyObject *path = argv[0];
+    if(_check_errors(errors) < 0)
+        return NULL;
+
+    PyObject *io = PyImport_ImportModule("io");
+    if(!io)
+        return NULL;
+    PyObject *file = PyObject_CallMethod(io, "open", "Os", path, "rb");
+    Py_DECREF(io);
+    if(!file)
+        return NULL;
+
+    PyObject *result = NULL;
+    /* an empty file can't be mapped */
+    PyObject *size = PyObject_CallMethod(file, "seek", "ii", 0, 2);
+    int empty = size ? PyObject_Not(size) : -1;
+    Py_XDECREF(size);
+    if(empty == 1) {
+        result = cstring_new_empty();
+    } else if(empty == 0) {
+        PyObject *fileno = PyObject_CallMethod(file, "fileno", NULL);
+        PyObject *mapping = fileno ? _mmap_for_reading(fileno) : NULL;
+        Py_XDECREF(fileno);
+        if(mapping) {
+            result = _cstring_from_mapping(mapping, errors);
+            Py_DECREF(mapping);
+        }
+    }
+
+    /* the mapping doesn't need the file to stay open */
+    PyObject *exc_type, *exc_value, *exc_tb;
+    PyErr_Fetch(&exc_type, &exc_value, &exc_tb);
+    PyObject *closed = PyObject_CallMethod(file, "close", NULL);
+    Py_DECREF(file);
+    Py_XDECREF(closed);
+    if(exc_type) {
+        /* report the first error */
+        if(!closed)
+            PyErr_Clear();
+        PyErr_Restore(exc_type, exc_value, exc_tb);
+    } else if(!closed) {
+        Py_CLEAR(result);
+    }
+    return result;
+}
+
+PyDoc_STRVAR(reduce_ex__doc__, "");
+PyObject *cstring_reduce_ex(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    int protocol;
+    if(_check_nargs("__reduce_ex__", nargs, 1, 1) < 0 || _arg_int(args[0], &protocol) < 0)
+        return NULL;
+
+    /* Unpickled by the constructor (one allocation, no revalidation). Under
+     * protocol 5 the bytes go to a PickleBuffer, which the pickler can hand
+     * out of band; otherwise they are copied into bytes, or into str before
+     * protocol 3, which pickles bytes as latin-1 text. */
+    PyObject *value;
+    if(protocol >= 5)
+        value = PyPickleBuffer_FromObject(self);
+    else if(protocol >= 3 || !(_cstring_meta(self) & CSTRING_FLAG_VALID))
+        value = PyBytes_FromStringAndSize(CSTRING_VALUE(self), cstring_len(self));
+    else
+        value = cstring_str(self);
+    if(!value)
+        return NULL;
+    return Py_BuildValue("O(Ns)", (PyObject *)Py_TYPE(self), value, "trust");
+}
+
+PyDoc_STRVAR(sizeof__doc__, "");
+PyObject *cstring_sizeof(PyObject *self, PyObject *args) {
+    Py_ssize_t items = CSTRING_IS_VIEW(self) ? (Py_ssize_t)CSTRING_VIEW_ITEMS : Py_SIZE(self);
+    return PyLong_FromSsize_t(Py_TYPE(self)->tp_basicsize + items * Py_TYPE(self)->tp_itemsize);
+}
+
+/*
+ * Iteration yields one-character cstrings (code points, not bytes).
+ */
+
+struct cstring_iter {
+    PyObject_HEAD
+    PyObject *string;   /* NULL once exhausted */
+    Py_ssize_t pos;
+};
+
+static PyTypeObject cstring_iter_type;
+
+static PyObject *cstring_iter(PyObject *self) {
+    if(_cstring_ensure_valid(self) < 0)
+        return NULL;
+    struct cstring_iter *iter = PyObject_New(struct cstring_iter, &cstring_iter_type);
+    if(!iter)
+        return NULL;
+    Py_INCREF(self);
+    iter->string = self;
+    iter->pos = 0;
+    return (PyObject *)iter;
+}
+
+static void cstring_iter_dealloc(PyObject *self) {
+    Py_XDECREF(((struct cstring_iter *)self)->string);
+    PyObject_Del(self);
+}
+
+static PyObject *_cstring_iter_next(PyObject *self) {
+    struct cstring_iter *iter = (struct cstring_iter *)self;
+    if(!iter->string)
+        return NULL;
+
+    Py_ssize_t len = cstring_len(iter->string);
+    if(iter->pos >= len) {
+        Py_CLEAR(iter->string);
+        return NULL;
+    }
+
+    PyObject *c = _cstring_char_new(CSTRING_VALUE_AT(iter->string, iter->pos), len - iter->pos);
+    if(c)
+        iter->pos += cstring_len(c);
+    return c;
+}
+
+static PyObject *cstring_iter_next(PyObject *self) {
+    PyObject *result;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    result = _cstring_iter_next(self);
+    Py_END_CRITICAL_SECTION();
+    return result;
+}
+
+static PyTypeObject cstring_iter_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "cstring.cstring_iterator",
+    .tp_basicsize = sizeof(struct cstring_iter),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = cstring_iter_dealloc,
+    .tp_iter = PyObject_SelfIter,
+    .tp_iternext = cstring_iter_next,
+};
+
+static PySequenceMethods cstring_as_sequence = {
+    .sq_length = cstring_len,
+    .sq_concat = cstring_concat,
+    .sq_repeat = cstring_repeat,
+    .sq_item = cstring_item,
+    .sq_contains = cstring_contains,
+};
+
+static PyMappingMethods cstring_as_mapping = {
+    .mp_length = cstring_len,
+    .mp_subscript = cstring_subscript,
+};
+
+static int cstring_getbuffer(PyObject *self, Py_buffer *view, int flags) {
+    /* Read-only export of value[] (without the terminating zero-byte).
+     * The view holds a reference to self, which keeps the storage alive and
+     * keeps Py_REFCNT above 1, so _cstring_realloc can never move it while
+     * exported. No release hook is needed. */
+    return PyBuffer_FillInfo(view, self, CSTRING_VALUE(self), cstring_len(self), 1, flags);
+}
+
+static PyBufferProcs cstring_as_buffer = {
+    .bf_getbuffer = cstring_getbuffer,
+    .bf_releasebuffer = NULL,
+};
+
+static PyMethodDef cstring_methods[] = {
+    {"capitalize", cstring_capitalize, METH_NOARGS, capitalize__doc__},
+    {"casefold", cstring_casefold, METH_NOARGS, casefold__doc__},
+    /* TODO: center */
+    {"char_at", (PyCFunction)cstring_char_at, METH_FASTCALL, char_at__doc__},
+    {"char_len", cstring_char_len, METH_NOARGS, char_len__doc__},
+    {"char_slice", (PyCFunction)cstring_char_slice, METH_FASTCALL, char_slice__doc__},
+    {"count", (PyCFunction)cstring_count, METH_FASTCALL, count__doc__},
+    /* TODO: encode (decode???) */
+    {"endswith", (PyCFunction)cstring_endswith, METH_FASTCALL, endswith__doc__},
+    /* TODO: expandtabs */
+    {"find", (PyCFunction)cstring_find, METH_FASTCALL, find__doc__},
+    /* TODO: format */
+    /* TODO: format_map */
+    {"from_file", (PyCFunction)cstring_from_file, METH_FASTCALL | METH_KEYWORDS | METH_CLASS, from_file__doc__},
+    {"from_mmap", (PyCFunction)cstring_from_mmap, METH_FASTCALL | METH_KEYWORDS | METH_CLASS, from_mmap__doc__},
+    {"index", (PyCFunction)cstring_index, METH_FASTCALL, index__doc__},
+    {"intern", cstring_intern, METH_NOARGS, intern__doc__},
+    {"isalnum", cstring_isalnum, METH_NOARGS, isalnum__doc__},
+    {"isalpha", cstring_isalpha, METH_NOARGS, isalpha__doc__},
+    {"isascii", cstring_isascii, METH_NOARGS, isascii__doc__},
+    /* TODO: isdecimal */
+    {"isdigit", cstring_isdigit, METH_NOARGS, isdigit__doc__},
+    /* TODO: isidentifier */
+    {"islower", cstring_islower, METH_NOARGS, islower__doc__},
+    /* TODO: isnumeric */
+    {"isprintable", cstring_isprintable, METH_NOARGS, isprintable__doc__},
+    {"isspace", cstring_isspace, METH_NOARGS, isspace__doc__},
+    /* TODO: istitle */
+    {"isupper", cstring_isupper, METH_NOARGS, isupper__doc__},
+    {"itersplit", (PyCFunction)cstring_itersplit, METH_FASTCALL | METH_KEYWORDS, itersplit__doc__},
+    {"itersplitlines", (PyCFunction)cstring_itersplitlines, METH_FASTCALL | METH_KEYWORDS, itersplitlines__doc__},
+    {"join", cstring_join, METH_O, join__doc__},
+    /* TODO: ljust */
+    {"lower", cstring_lower, METH_NOARGS, lower__doc__},
+    {"lstrip", (PyCFunction)cstring_lstrip, METH_FASTCALL, lstrip__doc__},
+    {"materialize", cstring_materialize, METH_NOARGS, materialize__doc__},
+    {"maketrans", (PyCFunction)cstring_maketrans, METH_FASTCALL | METH_STATIC, maketrans__doc__},
+    {"partition", cstring_partition, METH_O, partition__doc__},
+    /* TODO: removeprefix */
+    {"replace", (PyCFunction)cstring_replace, METH_FASTCALL | METH_KEYWORDS, replace__doc__},
+    {"rfind", (PyCFunction)cstring_rfind, METH_FASTCALL, rfind__doc__},
+    {"rindex", (PyCFunction)cstring_rindex, METH_FASTCALL, rindex__doc__},
+    /* TODO: rjust */
+    {"rpartition", cstring_rpartition, METH_O, rpartition__doc__},
+    {"rsplit", (PyCFunction)cstring_rsplit, METH_FASTCALL | METH_KEYWORDS, rsplit__doc__},
+    {"rstrip", (PyCFunction)cstring_rstrip, METH_FASTCALL, rstrip__doc__},
+    {"split", (PyCFunction)cstring_split, METH_FASTCALL | METH_KEYWORDS, split__doc__},
+    {"splitlines", (PyCFunction)cstring_splitlines, METH_FASTCALL | METH_KEYWORDS, splitlines__doc__},
+    {"startswith", (PyCFunction)cstring_startswith, METH_FASTCALL, startswith__doc__},
+    {"strip", (PyCFunction)cstring_strip, METH_FASTCALL, strip__doc__},
+    {"swapcase", cstring_swapcase, METH_NOARGS, swapcase__doc__},
+    {"title", cstring_title, METH_NOARGS, title__doc__},
+    {"translate", cstring_translate, METH_O, translate__doc__},
+    {"upper", cstring_upper, METH_NOARGS, upper__doc__},
+    {"view", (PyCFunction)cstring_view, METH_FASTCALL, view__doc__},
+    /* TODO: zfill */
+    {"__reduce_ex__", (PyCFunction)cstring_reduce_ex, METH_FASTCALL, reduce_ex__doc__},
+    {"__sizeof__", cstring_sizeof, METH_NOARGS, sizeof__doc__},
+    {0},
+};
+
+static PyTypeObject cstring_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "cstring.cstring",
+    .tp_doc = "",
+    .tp_basicsize = sizeof(struct cstring),
+    .tp_itemsize = sizeof(char),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = cstring_new,
+    .tp_vectorcall = cstring_vectorcall,
+    .tp_dealloc = cstring_dealloc,
+    .tp_richcompare = cstring_richcompare,
+    .tp_str = cstring_str,
+    .tp_repr = cstring_repr,
+    .tp_hash = cstring_hash,
+    .tp_iter = cstring_iter,
+    .tp_as_sequence = &cstring_as_sequence,
+    .tp_as_mapping = &cstring_as_mapping,
+    .tp_as_buffer = &cstring_as_buffer,
+    .tp_methods = cstring_methods,
+};
+
+/*
+ * Builder: accumulates bytes in a cstring with spare capacity, growing it
+ * geometrically. freeze() shrinks the storage to fit and hands over the
+ * object itself, so the contents are never copied. Methods run in a
+ * critical section on the builder, for free-threaded builds.
+ */
+
+struct builder {
+    PyObject_HEAD
+    PyObject *buffer;   /* cstring of capacity bytes (Py_SIZE - 1), or NULL */
+    Py_ssize_t len;
+    int meta;           /* VALID and ASCII, if known for everything appended */
+    Py_ssize_t length;  /* code points, if VALID */
+};
+
+#define BUILDER_MIN_CAPACITY    64
+
+static void _builder_reset(struct builder *self) {
+    self->buffer = NULL;
+    self->len = 0;
+    self->meta = CSTRING_FLAG_VALID | CSTRING_FLAG_ASCII;
+    self->length = 0;
+}
+
+/* Makes room for `extra` more bytes. */
+static int _builder_reserve(struct builder *self, Py_ssize_t extra) {
+    Py_ssize_t capacity = self->buffer ? cstring_len(self->buffer) : 0;
+    if(extra <= capacity - self->len)
+        return 0;
+    if(extra > PY_SSIZE_T_MAX - 1 - self->len) {
+        PyErr_NoMemory();
+        return -1;
     }
-    return NULL;
-}
 
-const char *_strrstr(const char *s, const char *find) {
-    const char *p = s + strlen(s) - 1;
-    for(;p > s; --p) {
-        if(memcmp(p, find, strlen(find)) == 0)
-            return p;
+    Py_ssize_t needed = self->len + extra;
+    Py_ssize_t grown = capacity <= (PY_SSIZE_T_MAX - 1) / 2 ? capacity * 2 : needed;
+    capacity = Py_MAX(Py_MAX(needed, grown), BUILDER_MIN_CAPACITY);
+
+    if(!self->buffer) {
+        self->buffer = (PyObject *)CSTRING_ALLOC(&cstring_type, capacity + 1);
+        return self->buffer ? 0 : -1;
     }
-    return NULL;
+    PyObject *new = _cstring_realloc(self->buffer, capacity);
+    if(!new)
+        return -1;
+    self->buffer = new;
+    return 0;
 }
 
+static int _builder_append(struct builder *self, PyObject *o, Py_ssize_t *appended) {
+    Py_ssize_t len;
+    const char *s = _obj_as_string_and_size(o, &len);
+    if(!s)
+        return -1;
+    if(_builder_reserve(self, len) < 0)
+        return -1;
+    memcpy(CSTRING_VALUE_AT(self->buffer, self->len), s, len);
+    STATS_ADD(bytes_copied, len);
+    self->len += len;
 
-struct cstring {
-    PyObject_VAR_HEAD
-    Py_hash_t hash;
-    char value[];
-};
+    Py_ssize_t length;
+    self->meta &= _obj_text_meta(o, &length);
+    self->length += length;
 
-static PyTypeObject cstring_type;
+    if(appended)
+        *appended = len;
+    return 0;
+}
 
-#define CSTRING_HASH(self)          (((struct cstring *)self)->hash)
-#define CSTRING_VALUE(self)         (((struct cstring *)self)->value)
-#define CSTRING_VALUE_AT(self, i)   (&CSTRING_VALUE(self)[(i)])
-#define CSTRING_LAST_BYTE(self)     (CSTRING_VALUE(self)[Py_SIZE(self) - 1])
+static PyObject *builder_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    Py_ssize_t capacity = 0;
+    char *kwlist[] = {"capacity", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "|n", kwlist, &capacity))
+        return NULL;
 
-#define CSTRING_ALLOC(tp, len)      ((struct cstring *)(tp)->tp_alloc((tp), (len)))
+    struct builder *self = (struct builder *)type->tp_alloc(type, 0);
+    if(!self)
+        return NULL;
+    _builder_reset(self);
+    if(capacity > 0 && _builder_reserve(self, capacity) < 0) {
+        Py_DECREF(self);
+        return NULL;
+    }
+    return (PyObject *)self;
+}
 
-/* singleton, initialized in cstring_new_empty */
-static const struct cstring *cstring_EMPTY = NULL;
+static void builder_dealloc(PyObject *self) {
+    Py_XDECREF(((struct builder *)self)->buffer);
+    Py_TYPE(self)->tp_free(self);
+}
 
-static void *_bad_argument_type(PyObject *o) {
-    PyErr_Format(
-        PyExc_TypeError,
-        "Bad argument type: %s",
-        Py_TYPE(o)->tp_name);
-    return NULL;
+static Py_ssize_t builder_len(PyObject *self) {
+    return ((struct builder *)self)->len;
 }
 
-static PyObject *_cstring_new(PyTypeObject *type, const char *value, Py_ssize_t len) {
-    struct cstring *new = CSTRING_ALLOC(type, len + 1);
-    if(!new)
+PyDoc_STRVAR(builder_append__doc__, "");
+static PyObject *builder_append(PyObject *self, PyObject *arg) {
+    int err;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    err = _builder_append((struct builder *)self, arg, NULL);
+    Py_END_CRITICAL_SECTION();
+    if(err < 0)
         return NULL;
-    new->hash = -1;
-    memcpy(new->value, value, len);
-    CSTRING_LAST_BYTE(new) = '\0';
-    return (PyObject *)new;
+    Py_RETURN_NONE;
 }
 
-static PyObject *_cstring_realloc(PyObject *self, Py_ssize_t len) {
-    if(Py_REFCNT(self) > 1)
-        return PyErr_BadInternalCall(), NULL;
-    struct cstring *new = PyObject_Realloc(self, sizeof(struct cstring) + len + 1);
-    if(!new)
-        return PyErr_NoMemory();
-    Py_SET_SIZE(new, len + 1);
-    new->hash = -1;
-    return (PyObject *)new;
+PyDoc_STRVAR(builder_extend__doc__, "");
+static PyObject *builder_extend(PyObject *self, PyObject *arg) {
+    PyObject *iter = PyObject_GetIter(arg);
+    if(!iter)
+        return NULL;
+    PyObject *item;
+    while((item = PyIter_Next(iter)) != NULL) {
+        int err;
+        Py_BEGIN_CRITICAL_SECTION(self);
+        err = _builder_append((struct builder *)self, item, NULL);
+        Py_END_CRITICAL_SECTION();
+        Py_DECREF(item);
+        if(err < 0)
+            break;
+    }
+    Py_DECREF(iter);
+    if(PyErr_Occurred())
+        return NULL;
+    Py_RETURN_NONE;
 }
 
-static PyObject *_cstring_copy(PyObject *self) {
-    return _cstring_new(Py_TYPE(self), CSTRING_VALUE(self), Py_SIZE(self) - 1);
+PyDoc_STRVAR(builder_write__doc__, "");
+static PyObject *builder_write(PyObject *self, PyObject *arg) {
+    Py_ssize_t appended;
+    int err;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    err = _builder_append((struct builder *)self, arg, &appended);
+    Py_END_CRITICAL_SECTION();
+    if(err < 0)
+        return NULL;
+    return PyLong_FromSsize_t(appended);
 }
 
-static PyObject *cstring_new_empty(void) {
-    if(!cstring_EMPTY) {
-        cstring_EMPTY = (struct cstring *)_cstring_new(&cstring_type, "", 0);
+PyDoc_STRVAR(builder_reserve__doc__, "");
+static PyObject *builder_reserve(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    Py_ssize_t extra;
+    if(_check_nargs("reserve", nargs, 1, 1) < 0 || _arg_ssize(args[0], &extra) < 0)
+        return NULL;
+    if(extra < 0) {
+        PyErr_SetString(PyExc_ValueError, "reserve size must be non-negative");
+        return NULL;
     }
-    /* leaking one reference for singleton cache (never cleaned up) */
-    Py_INCREF(cstring_EMPTY);
-    return (PyObject *)cstring_EMPTY;
+    int err;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    err = _builder_reserve((struct builder *)self, extra);
+    Py_END_CRITICAL_SECTION();
+    if(err < 0)
+        return NULL;
+    Py_RETURN_NONE;
 }
 
-static const char *_obj_as_string_and_size(PyObject *o, Py_ssize_t *s) {
-    if(PyUnicode_Check(o))
-        return PyUnicode_AsUTF8AndSize(o, s);
+static PyObject *_builder_freeze(PyObject *self) {
+    struct builder *builder = (struct builder *)self;
+    if(builder->len == 0) {
+        Py_CLEAR(builder->buffer);
+        _builder_reset(builder);
+        return cstring_new_empty();
+    }
 
-    if(PyObject_CheckBuffer(o)) {
-        /* handles bytes, bytearrays, arrays, memoryviews, etc. */
-        Py_buffer view;
-        if(PyObject_GetBuffer(o, &view, PyBUF_SIMPLE) < 0)
+    PyObject *result = builder->buffer;
+    if(cstring_len(result) != builder->len) {
+        result = _cstring_realloc(result, builder->len);
+        if(!result)
             return NULL;
-        *s = view.len;
-        const char *buffer = view.buf;
-        PyBuffer_Release(&view);
-        return buffer;
     }
+    CSTRING_LAST_BYTE(result) = '\0';
+    if(builder->meta & CSTRING_FLAG_VALID)
+        _cstring_set_meta(result, builder->meta, builder->length);
 
-    if(PyObject_TypeCheck(o, &cstring_type)) {
-        /* TODO: implement buffer protocol for cstring */
-        *s = Py_SIZE(o) - 1;
-        return CSTRING_VALUE(o);
-    }
+    _builder_reset(builder);
+    return result;
+}
 
-    *s = -1;
-    return _bad_argument_type(o);
+PyDoc_STRVAR(builder_freeze__doc__, "");
+static PyObject *builder_freeze(PyObject *self, PyObject *args) {
+    PyObject *result;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    result = _builder_freeze(self);
+    Py_END_CRITICAL_SECTION();
+    return result;
 }
 
-static PyObject *cstring_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
-    PyObject *argobj = NULL;
-    if(!PyArg_ParseTuple(args, "O", &argobj))
-        return NULL;
+static PySequenceMethods builder_as_sequence = {
+    .sq_length = builder_len,
+};
 
-    if(PyObject_TypeCheck(argobj, type)) {
-        Py_INCREF(argobj);
-        return argobj;
-    }
+static PyMethodDef builder_methods[] = {
+    {"append", builder_append, METH_O, builder_append__doc__},
+    {"extend", builder_extend, METH_O, builder_extend__doc__},
+    {"freeze", builder_freeze, METH_NOARGS, builder_freeze__doc__},
+    {"reserve", (PyCFunction)builder_reserve, METH_FASTCALL, builder_reserve__doc__},
+    {"write", builder_write, METH_O, builder_write__doc__},
+    {0},
+};
 
-    Py_ssize_t len = 0;
-    const char *buffer = _obj_as_string_and_size(argobj, &len);
-    if(!buffer)
+static PyTypeObject builder_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "cstring.Builder",
+    .tp_doc = "",
+    .tp_basicsize = sizeof(struct builder),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = builder_new,
+    .tp_dealloc = builder_dealloc,
+    .tp_as_sequence = &builder_as_sequence,
+    .tp_methods = builder_methods,
+};
+
+/*
+ * Finder: a pattern compiled once (Two-Way factorizations in both
+ * directions, plus Horspool tables for long patterns) and searched for in
+ * any number of texts.
+ */
+
+struct finder {
+    PyObject_HEAD
+    PyObject *pattern;
+    struct _search search;
+    uint16_t tables[2][256];
+};
+
+static PyTypeObject finder_type;
+static PyTypeObject finditer_type;
+
+static PyObject *finder_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    PyObject *patternobj;
+    char *kwlist[] = {"pattern", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "O", kwlist, &patternobj))
         return NULL;
 
-    if(len == 0)
-        return cstring_new_empty();
+    PyObject *pattern;
+    if(PyObject_TypeCheck(patternobj, &cstring_type)) {
+        Py_INCREF(patternobj);
+        pattern = patternobj;
+    } else {
+        Py_ssize_t len;
+        const char *buffer = _obj_as_string_and_size(patternobj, &len);
+        if(!buffer)
+            return NULL;
+        pattern = _cstring_new(&cstring_type, buffer, len);
+        if(!pattern)
+            return NULL;
+    }
 
-    return _cstring_new(type, buffer, len);
+    struct finder *self = (struct finder *)type->tp_alloc(type, 0);
+    if(!self) {
+        Py_DECREF(pattern);
+        return NULL;
+    }
+    self->pattern = pattern;
+    _search_init(&self->search, CSTRING_VALUE(pattern), cstring_len(pattern));
+    _search_compile(&self->search, self->tables);
+    return (PyObject *)self;
 }
 
-static void cstring_dealloc(PyObject *self) {
+static void finder_dealloc(PyObject *self) {
+    Py_DECREF(((struct finder *)self)->pattern);
     Py_TYPE(self)->tp_free(self);
 }
 
-static int _ensure_cstring(PyObject *self) {
-    if(PyObject_TypeCheck(self, &cstring_type))
-        return 1;
-    PyErr_Format(
-        PyExc_TypeError,
-        "Object must have type cstring, not %s.",
-        Py_TYPE(self)->tp_name);
-    return 0;
+static PyObject *finder_repr(PyObject *self) {
+    return PyUnicode_FromFormat("%s(%R)", Py_TYPE(self)->tp_name, ((struct finder *)self)->pattern);
 }
 
-static PyObject *cstring_str(PyObject *self) {
-    return PyUnicode_FromString(CSTRING_VALUE(self));
+/* Parses (text [,start [,end]]); on success the caller releases view. */
+static int _finder_parse_args(const char *name, PyObject *const *args, Py_ssize_t nargs,
+                              Py_buffer *view, Py_ssize_t *start, Py_ssize_t *end) {
+    *start = 0;
+    *end = PY_SSIZE_T_MAX;
+    if(_check_nargs(name, nargs, 1, 3) < 0)
+        return -1;
+    if(nargs > 1 && _arg_ssize(args[1], start) < 0)
+        return -1;
+    if(nargs > 2 && _arg_ssize(args[2], end) < 0)
+        return -1;
+    if(_obj_get_buffer(args[0], view) < 0)
+        return -1;
+    _fix_range(view->len, start, end);
+    return 0;
 }
 
-static PyObject *cstring_repr(PyObject *self) {
-    PyObject *tmp = cstring_str(self);
-    PyObject *repr = PyObject_Repr(tmp);
-    Py_DECREF(tmp);
-    return repr;
-}
+PyDoc_STRVAR(finder_find__doc__, "");
+static PyObject *finder_find(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    struct finder *finder = (struct finder *)self;
+    Py_buffer view;
+    Py_ssize_t start, end;
+    if(_finder_parse_args("find", args, nargs, &view, &start, &end) < 0)
+        return NULL;
 
-static Py_hash_t cstring_hash(PyObject *self) {
-    if(CSTRING_HASH(self) == -1)
-        CSTRING_HASH(self) = _Py_HashBytes(CSTRING_VALUE(self), Py_SIZE(self));
-    return CSTRING_HASH(self);
+    Py_ssize_t result = -1;
+    if(end >= start) {
+        const char *p;
+        STATS_SEARCH(FINDER);
+        CSTRING_BEGIN_ALLOW_THREADS(end - start)
+        p = _search_find_parallel(&finder->search, (char *)view.buf + start, end - start);
+        CSTRING_END_ALLOW_THREADS
+        if(p)
+            result = p - (char *)view.buf;
+    }
+
+    PyBuffer_Release(&view);
+    return PyLong_FromSsize_t(result);
 }
 
-static PyObject *cstring_richcompare(PyObject *self, PyObject *other, int op) {
-    if(!_ensure_cstring(other))
+PyDoc_STRVAR(finder_rfind__doc__, "");
+static PyObject *finder_rfind(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    struct finder *finder = (struct finder *)self;
+    Py_buffer view;
+    Py_ssize_t start, end;
+    if(_finder_parse_args("rfind", args, nargs, &view, &start, &end) < 0)
         return NULL;
 
-    const char *left = CSTRING_VALUE(self);
-    const char *right = CSTRING_VALUE(other);
-
-    for(;*left && *right && *left == *right; ++left, ++right)
-        ;
-
-    switch (op) {
-    case Py_EQ:
-        return PyBool_FromLong(*left == *right);
-    case Py_NE:
-        return PyBool_FromLong(*left != *right);
-    case Py_LT:
-        return PyBool_FromLong(*left < *right);
-    case Py_GT:
-        return PyBool_FromLong(*left > *right);
-    case Py_LE:
-        return PyBool_FromLong(*left <= *right);
-    case Py_GE:
-        return PyBool_FromLong(*left >= *right);
-    default:
-        Py_UNREACHABLE();
+    Py_ssize_t result = -1;
+    if(end >= start) {
+        const char *p;
+        STATS_SEARCH(FINDER);
+        CSTRING_BEGIN_ALLOW_THREADS(end - start)
+        p = _search_rfind_parallel(&finder->search, (char *)view.buf + start, end - start);
+        CSTRING_END_ALLOW_THREADS
+        if(p)
+            result = p - (char *)view.buf;
     }
-}
 
-static Py_ssize_t cstring_len(PyObject *self) {
-    return Py_SIZE(self) - 1;
+    PyBuffer_Release(&view);
+    return PyLong_FromSsize_t(result);
 }
 
-static PyObject *_concat_in_place(PyObject *self, PyObject *other) {
-    if(!other)
-        return PyErr_BadArgument(), NULL;
-    if(!_ensure_cstring(other))
-        return NULL;
-    if(!self)
-        return _cstring_copy(other);  /* new (mutable) copy with refcnt=1 */
-    if(!_ensure_cstring(self))
+PyDoc_STRVAR(finder_count__doc__, "");
+static PyObject *finder_count(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    struct finder *finder = (struct finder *)self;
+    Py_buffer view;
+    Py_ssize_t start, end;
+    if(_finder_parse_args("count", args, nargs, &view, &start, &end) < 0)
         return NULL;
 
-    Py_ssize_t origlen = cstring_len(self);
-    Py_ssize_t newlen = origlen + cstring_len(other);
-    PyObject *new = _cstring_realloc(self, newlen);
-    if(!new)
-        return NULL;
+    Py_ssize_t result = 0;
+    if(end >= start) {
+        STATS_SEARCH(FINDER);
+        CSTRING_BEGIN_ALLOW_THREADS(end - start)
+        result = _search_count_parallel(&finder->search, (char *)view.buf + start, end - start);
+        CSTRING_END_ALLOW_THREADS
+    }
 
-    memcpy(CSTRING_VALUE_AT(new, origlen), CSTRING_VALUE(other), cstring_len(other));
-    CSTRING_LAST_BYTE(new) = '\0';
-    return new;
+    PyBuffer_Release(&view);
+    return PyLong_FromSsize_t(result);
 }
 
-static PyObject *cstring_concat(PyObject *left, PyObject *right) {
-    if(!_ensure_cstring(left))
+PyDoc_STRVAR(finder_split__doc__, "");
+static PyObject *finder_split(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    struct finder *finder = (struct finder *)self;
+    static const char *const kwlist[] = {"text", "maxsplit", NULL};
+    PyObject *argv[2];
+    Py_ssize_t maxsplit = -1;
+    if(_parse_args("split", args, nargs, kwnames, kwlist, 1, argv) < 0)
         return NULL;
-    if(!_ensure_cstring(right))
+    if(argv[1] && _arg_ssize(argv[1], &maxsplit) < 0)
         return NULL;
+    PyObject *textobj = argv[0];
 
-    Py_ssize_t size = cstring_len(left) + cstring_len(right) + 1;
+    if(PyObject_TypeCheck(textobj, &cstring_type)) {
+        return _split_on_search(textobj, CSTRING_VALUE(textobj), CSTRING_END(textobj),
+            &finder->search, maxsplit);
+    }
 
-    struct cstring *new = CSTRING_ALLOC(Py_TYPE(left), size);
-    if(!new)
+    Py_buffer view;
+    if(_obj_get_buffer(textobj, &view) < 0)
         return NULL;
-    memcpy(new->value, CSTRING_VALUE(left), Py_SIZE(left));
-    memcpy(&new->value[cstring_len(left)], CSTRING_VALUE(right), Py_SIZE(right)); 
-    return (PyObject *)new;
+    PyObject *result = _split_on_search(NULL, view.buf, (char *)view.buf + view.len,
+        &finder->search, maxsplit);
+    PyBuffer_Release(&view);
+    return result;
 }
 
-static PyObject *cstring_repeat(PyObject *self, Py_ssize_t count) {
-    if(!_ensure_cstring(self))
-        return NULL;
-    if(count <= 0)
-        return cstring_new_empty();
-
-    Py_ssize_t size = (cstring_len(self) * count) + 1;
+struct finditer {
+    PyObject_HEAD
+    struct finder *finder;
+    Py_buffer view;
+    Py_ssize_t pos;
+    Py_ssize_t end;
+};
 
-    struct cstring *new = CSTRING_ALLOC(Py_TYPE(self), size);
-    if(!new)
+PyDoc_STRVAR(finder_finditer__doc__, "");
+static PyObject *finder_finditer(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    struct finditer *iter = PyObject_New(struct finditer, &finditer_type);
+    if(!iter)
+        return NULL;
+    if(_finder_parse_args("finditer", args, nargs, &iter->view, &iter->pos, &iter->end) < 0) {
+        iter->finder = NULL;
+        iter->view.obj = NULL;
+        Py_DECREF(iter);
         return NULL;
-    for(Py_ssize_t i = 0; i < size - 1; i += cstring_len(self)) {
-        memcpy(&new->value[i], CSTRING_VALUE(self), Py_SIZE(self));
     }
-    return (PyObject *)new;
+    Py_INCREF(self);
+    iter->finder = (struct finder *)self;
+    return (PyObject *)iter;
 }
 
-static Py_ssize_t _ensure_valid_index(PyObject *self, Py_ssize_t i) {
-    if(i >= 0 && i < cstring_len(self))
-        return i;
-    PyErr_SetString(PyExc_IndexError, "Index is out of bounds");
-    return -1;
+static void finditer_dealloc(PyObject *self) {
+    struct finditer *iter = (struct finditer *)self;
+    if(iter->view.obj)
+        PyBuffer_Release(&iter->view);
+    Py_XDECREF(iter->finder);
+    PyObject_Del(self);
 }
 
-static PyObject *cstring_item(PyObject *self, Py_ssize_t i) {
-    if(_ensure_valid_index(self, i) < 0)
+static PyObject *_finditer_next(PyObject *self) {
+    struct finditer *iter = (struct finditer *)self;
+    if(iter->pos > iter->end)
         return NULL;
-    return _cstring_new(Py_TYPE(self), CSTRING_VALUE_AT(self, i), 1);
-}
 
-static int cstring_contains(PyObject *self, PyObject *arg) {
-    if(!_ensure_cstring(arg))
-        return -1;
-    if(strstr(CSTRING_VALUE(self), CSTRING_VALUE(arg)))
-        return 1;
-    return 0;
+    const char *buf = iter->view.buf;
+    STATS_SEARCH(FINDER);
+    const char *p = _search_find(&iter->finder->search, buf + iter->pos, iter->end - iter->pos);
+    if(!p) {
+        iter->pos = iter->end + 1;
+        return NULL;
+    }
+
+    Py_ssize_t result = p - buf;
+    iter->pos = result + Py_MAX(iter->finder->search.len, 1);
+    return PyLong_FromSsize_t(result);
 }
 
-static PyObject *_cstring_subscript_index(PyObject *self, PyObject *index) {
-    Py_ssize_t i = PyNumber_AsSsize_t(index, PyExc_IndexError);
-    if(PyErr_Occurred())
-        return NULL;
-    if(i < 0)
-        i += cstring_len(self);
-    return cstring_item(self, i);
+static PyObject *finditer_next(PyObject *self) {
+    PyObject *result;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    result = _finditer_next(self);
+    Py_END_CRITICAL_SECTION();
+    return result;
 }
 
-static PyObject *_cstring_subscript_slice(PyObject *self, PyObject *slice) {
-    Py_ssize_t start, stop, step;
-    if(PySlice_Unpack(slice, &start, &stop, &step) < 0)
-        return NULL;
+static PyMethodDef finder_methods[] = {
+    {"count", (PyCFunction)finder_count, METH_FASTCALL, finder_count__doc__},
+    {"find", (PyCFunction)finder_find, METH_FASTCALL, finder_find__doc__},
+    {"finditer", (PyCFunction)finder_finditer, METH_FASTCALL, finder_finditer__doc__},
+    {"rfind", (PyCFunction)finder_rfind, METH_FASTCALL, finder_rfind__doc__},
+    {"split", (PyCFunction)finder_split, METH_FASTCALL | METH_KEYWORDS, finder_split__doc__},
+    {0},
+};
 
-    Py_ssize_t slicelen = PySlice_AdjustIndices(cstring_len(self), &start, &stop, step);
-    struct cstring *new = CSTRING_ALLOC(Py_TYPE(self), slicelen + 1);
-    if(!new)
-        return NULL;
+static PyMemberDef finder_members[] = {
+    {"pattern", T_OBJECT_EX, offsetof(struct finder, pattern), READONLY, ""},
+    {0},
+};
 
-    char *src = CSTRING_VALUE_AT(self, start);
-    for(Py_ssize_t i = 0; i < slicelen; ++i) {
-        new->value[i] = *src;
-        src += step;
-    }
-    new->value[slicelen] = '\0';
-    return (PyObject *)new;
-}
+static PyTypeObject finder_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "cstring.Finder",
+    .tp_doc = "",
+    .tp_basicsize = sizeof(struct finder),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = finder_new,
+    .tp_dealloc = finder_dealloc,
+    .tp_repr = finder_repr,
+    .tp_methods = finder_methods,
+    .tp_members = finder_members,
+};
 
-static PyObject *cstring_subscript(PyObject *self, PyObject *key) {
-    if(PyIndex_Check(key))
-        return _cstring_subscript_index(self, key);
-    if(PySlice_Check(key))
-        return _cstring_subscript_slice(self, key);
+static PyTypeObject finditer_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "cstring.Finder.finditer",
+    .tp_basicsize = sizeof(struct finditer),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = finditer_dealloc,
+    .tp_iter = PyObject_SelfIter,
+    .tp_iternext = finditer_next,
+};
+
+/*
+ * MultiFinder: Aho-Corasick automaton over many patterns.
+ *
+ * Bytes are first mapped to equivalence classes (one per byte value used
+ * in any pattern, plus one for all others), and the automaton is stored as
+ * a complete DFA: delta[row + class] is the row offset of the next state,
+ * with AC_OUTPUT set when that state ends at least one pattern. Scanning is
+ * one table load per byte.
+ */
+
+#define AC_OUTPUT       ((uint32_t)1 << 31)
+#define AC_ROW_MASK     (AC_OUTPUT - 1)
+
+struct multifinder {
+    PyObject_HEAD
+    PyObject *patterns;         /* tuple of cstring */
+    Py_ssize_t maxlen;
+    int nclasses;
+    uint8_t classes[256];
+    uint32_t *delta;
+    int32_t *state_pattern;     /* first pattern ending at a state, or -1 */
+    int32_t *dict_link;         /* nearest proper suffix state with a pattern, or -1 */
+    int32_t *pattern_next;      /* next pattern with identical bytes, or -1 */
+};
+
+static PyTypeObject multifinder_type;
+static PyTypeObject multifinditer_type;
+
+#define AC_PATTERN_LEN(self, pid)   (cstring_len(PyTuple_GET_ITEM((self)->patterns, (pid))))
 
-    PyErr_SetString(PyExc_TypeError, "Subscript must be int or slice.");
-    return NULL;
-}
+static int _multifinder_build(struct multifinder *self) {
+    Py_ssize_t npatterns = PyTuple_GET_SIZE(self->patterns);
+    Py_ssize_t total = 0;
+    int used[256] = {0};
 
-static Py_ssize_t _fix_index(Py_ssize_t i, Py_ssize_t len) {
-    Py_ssize_t result = i;
-    if(result < 0)
-        result += len;
-    if(result < 0)
-        result = 0;
-    if(result > len)
-        result = len;
-    return result;
-}
+    for(Py_ssize_t pid = 0; pid < npatterns; ++pid) {
+        PyObject *pattern = PyTuple_GET_ITEM(self->patterns, pid);
+        const unsigned char *p = (const unsigned char *)CSTRING_VALUE(pattern);
+        if(cstring_len(pattern) == 0) {
+            PyErr_SetString(PyExc_ValueError, "empty pattern");
+            return -1;
+        }
+        for(Py_ssize_t i = 0; i < cstring_len(pattern); ++i)
+            used[p[i]] = 1;
+        total += cstring_len(pattern);
+        self->maxlen = Py_MAX(self->maxlen, cstring_len(pattern));
+    }
 
-struct _substr_params {
-    const char *start;
-    const char *end;
-    const char *substr;
-    Py_ssize_t substr_len;
-};
+    int nc = 1;
+    for(int b = 0; b < 256; ++b)
+        self->classes[b] = used[b] ? nc++ : 0;
+    self->nclasses = nc;
 
-static struct _substr_params *_parse_substr_args(PyObject *self, PyObject *args, struct _substr_params *params) {
-    PyObject *substr_obj;
-    Py_ssize_t start = 0;
-    Py_ssize_t end = PY_SSIZE_T_MAX;
+    Py_ssize_t maxstates = total + 1;
+    if(maxstates > INT32_MAX / nc) {
+        PyErr_SetString(PyExc_ValueError, "too many patterns");
+        return -1;
+    }
 
-    if(!PyArg_ParseTuple(args, "O|nn", &substr_obj, &start, &end))
-        return NULL;
+    int32_t *delta = PyMem_New(int32_t, maxstates * nc);
+    int32_t *fail = PyMem_New(int32_t, maxstates);
+    int32_t *queue = PyMem_New(int32_t, maxstates);
+    self->state_pattern = PyMem_New(int32_t, maxstates);
+    self->dict_link = PyMem_New(int32_t, maxstates);
+    self->pattern_next = PyMem_New(int32_t, npatterns);
+    if(!delta || !fail || !queue || !self->state_pattern || !self->dict_link || !self->pattern_next) {
+        PyMem_Free(delta);
+        PyMem_Free(fail);
+        PyMem_Free(queue);
+        PyErr_NoMemory();
+        return -1;
+    }
 
-    Py_ssize_t substr_len;
-    const char *substr = _obj_as_string_and_size(substr_obj, &substr_len);
-    if(!substr)
-        return NULL;
+    /* trie; patterns inserted last-to-first so each state's list is ascending */
+    memset(delta, 0xff, sizeof(int32_t) * maxstates * nc);
+    int32_t nstates = 1;
+    self->state_pattern[0] = -1;
+    for(Py_ssize_t pid = npatterns - 1; pid >= 0; --pid) {
+        PyObject *pattern = PyTuple_GET_ITEM(self->patterns, pid);
+        const unsigned char *p = (const unsigned char *)CSTRING_VALUE(pattern);
+        int32_t s = 0;
+        for(Py_ssize_t i = 0; i < cstring_len(pattern); ++i) {
+            int32_t *next = &delta[s * nc + self->classes[p[i]]];
+            if(*next < 0) {
+                self->state_pattern[nstates] = -1;
+                *next = nstates++;
+            }
+            s = *next;
+        }
+        self->pattern_next[pid] = self->state_pattern[s];
+        self->state_pattern[s] = (int32_t)pid;
+    }
 
-    start = _fix_index(start, cstring_len(self));
-    end = _fix_index(end, cstring_len(self));
+    /* breadth-first: failure links, dictionary links, complete transitions */
+    Py_ssize_t head = 0, tail = 0;
+    fail[0] = 0;
+    self->dict_link[0] = -1;
+    for(int c = 0; c < nc; ++c) {
+        int32_t t = delta[c];
+        if(t < 0) {
+            delta[c] = 0;
+        } else {
+            fail[t] = 0;
+            self->dict_link[t] = -1;
+            queue[tail++] = t;
+        }
+    }
+    while(head < tail) {
+        int32_t s = queue[head++];
+        for(int c = 0; c < nc; ++c) {
+            int32_t t = delta[s * nc + c];
+            int32_t f = delta[fail[s] * nc + c];
+            if(t < 0) {
+                delta[s * nc + c] = f;
+            } else {
+                fail[t] = f;
+                self->dict_link[t] = (self->state_pattern[f] >= 0) ? f : self->dict_link[f];
+                queue[tail++] = t;
+            }
+        }
+    }
 
-    params->start = CSTRING_VALUE_AT(self, start);
-    params->end = CSTRING_VALUE_AT(self, end);
-    params->substr = substr;
-    params->substr_len = substr_len;
+    /* encode as row offsets, flagging transitions into output states */
+    self->delta = (uint32_t *)delta;
+    for(Py_ssize_t i = 0; i < (Py_ssize_t)nstates * nc; ++i) {
+        int32_t t = delta[i];
+        uint32_t row = (uint32_t)t * nc;
+        if(self->state_pattern[t] >= 0 || self->dict_link[t] >= 0)
+            row |= AC_OUTPUT;
+        self->delta[i] = row;
+    }
 
-    return params;
+    PyMem_Free(fail);
+    PyMem_Free(queue);
+    return 0;
 }
 
-PyDoc_STRVAR(count__doc__, "");
-static PyObject *cstring_count(PyObject *self, PyObject *args) {
-    struct _substr_params params;
+static PyObject *multifinder_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    PyObject *patternsobj;
+    char *kwlist[] = {"patterns", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "O", kwlist, &patternsobj))
+        return NULL;
 
-    if(!_parse_substr_args(self, args, &params))
+    PyObject *seq = PySequence_Tuple(patternsobj);
+    if(!seq)
+        return NULL;
+    Py_ssize_t npatterns = PyTuple_GET_SIZE(seq);
+    if(npatterns > INT32_MAX) {
+        Py_DECREF(seq);
+        PyErr_SetString(PyExc_ValueError, "too many patterns");
         return NULL;
+    }
 
-    const char *p = params.start;
-    long result = 0;
-    while((p = strstr(p, params.substr)) != NULL) {
-        ++result;
-        p += params.substr_len;
-        if(p >= params.end)
-            break;
+    PyObject *patterns = PyTuple_New(npatterns);
+    if(!patterns) {
+        Py_DECREF(seq);
+        return NULL;
+    }
+    for(Py_ssize_t i = 0; i < npatterns; ++i) {
+        PyObject *item = PyTuple_GET_ITEM(seq, i);
+        PyObject *pattern;
+        if(PyObject_TypeCheck(item, &cstring_type)) {
+            Py_INCREF(item);
+            pattern = item;
+        } else {
+            Py_ssize_t len;
+            const char *buffer = _obj_as_string_and_size(item, &len);
+            pattern = buffer ? _cstring_new(&cstring_type, buffer, len) : NULL;
+        }
+        if(!pattern) {
+            Py_DECREF(patterns);
+            Py_DECREF(seq);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(patterns, i, pattern);
     }
+    Py_DECREF(seq);
 
-    return PyLong_FromLong(result);
+    struct multifinder *self = (struct multifinder *)type->tp_alloc(type, 0);
+    if(!self) {
+        Py_DECREF(patterns);
+        return NULL;
+    }
+    self->patterns = patterns;
+    if(_multifinder_build(self) < 0) {
+        Py_DECREF(self);
+        return NULL;
+    }
+    return (PyObject *)self;
 }
 
-static const char *_substr_params_str(const struct _substr_params *params) {
-    const char *p = strstr(params->start, params->substr);
-    if(!p || p + params->substr_len > params->end)
-        return NULL;
-    return p;
+static void multifinder_dealloc(PyObject *self) {
+    struct multifinder *mf = (struct multifinder *)self;
+    PyMem_Free(mf->delta);
+    PyMem_Free(mf->state_pattern);
+    PyMem_Free(mf->dict_link);
+    PyMem_Free(mf->pattern_next);
+    Py_XDECREF(mf->patterns);
+    Py_TYPE(self)->tp_free(self);
 }
 
-static const char *_substr_params_rstr(const struct _substr_params *params) {
-    const char *p = params->end - params->substr_len + 1;
-    for(;;) {
-        p = _memrchr(params->start, *params->substr, p - params->start);
-        if(!p)
-            goto done;
-        if(memcmp(p, params->substr, params->substr_len) == 0)
-            return p;
+/* First state, starting at s itself, on the dictionary chain of s with a
+ * pattern ending there. */
+#define AC_FIRST_OUTPUT(self, s) \
+    ((self)->state_pattern[(s)] >= 0 ? (s) : (self)->dict_link[(s)])
+
+/* Leftmost (then longest) match within text[start:end], or -1. */
+static Py_ssize_t _multifinder_search(struct multifinder *self, const char *text, Py_ssize_t start, Py_ssize_t end, Py_ssize_t *match_pid) {
+    const unsigned char *t = (const unsigned char *)text;
+    const uint32_t *delta = self->delta;
+    const uint8_t *classes = self->classes;
+    int nc = self->nclasses;
+    uint32_t row = 0;
+    Py_ssize_t best = -1;
+    Py_ssize_t bestlen = 0;
+    STATS_SEARCH(MULTIFINDER);
+
+    for(Py_ssize_t i = start; i < end; ++i) {
+        uint32_t next = delta[row + classes[t[i]]];
+        row = next & AC_ROW_MASK;
+        if(next & AC_OUTPUT) {
+            int32_t s = AC_FIRST_OUTPUT(self, (int32_t)(row / nc));
+            for(; s >= 0; s = self->dict_link[s]) {
+                int32_t pid = self->state_pattern[s];
+                Py_ssize_t len = AC_PATTERN_LEN(self, pid);
+                Py_ssize_t pos = i - len + 1;
+                if(best < 0 || pos < best || (pos == best && len > bestlen)) {
+                    best = pos;
+                    bestlen = len;
+                    *match_pid = pid;
+                }
+            }
+        }
+        /* later matches end after i, so they cannot start before this */
+        if(best >= 0 && i + 2 - self->maxlen > best)
+            break;
     }
-done:
-    return NULL;
+    return best;
 }
 
-PyDoc_STRVAR(find__doc__, "");
-PyObject *cstring_find(PyObject *self, PyObject *args) {
-    struct _substr_params params;
-
-    if(!_parse_substr_args(self, args, &params))
+PyDoc_STRVAR(multifinder_search__doc__, "");
+static PyObject *multifinder_search(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    Py_buffer view;
+    Py_ssize_t start, end;
+    if(_finder_parse_args("search", args, nargs, &view, &start, &end) < 0)
         return NULL;
 
-    const char *p = _substr_params_str(&params);
-    if(!p)
-        return PyLong_FromLong(-1);
+    Py_ssize_t pid = -1;
+    Py_ssize_t pos = _multifinder_search((struct multifinder *)self, view.buf, start, end, &pid);
+    PyBuffer_Release(&view);
 
-    return PyLong_FromSsize_t(p - CSTRING_VALUE(self));
+    if(pos < 0)
+        Py_RETURN_NONE;
+    return Py_BuildValue("(nn)", pos, pid);
 }
 
-PyDoc_STRVAR(index__doc__, "");
-PyObject *cstring_index(PyObject *self, PyObject *args) {
-    struct _substr_params params;
-
-    if(!_parse_substr_args(self, args, &params))
+PyDoc_STRVAR(multifinder_find_any__doc__, "");
+static PyObject *multifinder_find_any(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    Py_buffer view;
+    Py_ssize_t start, end;
+    if(_finder_parse_args("find_any", args, nargs, &view, &start, &end) < 0)
         return NULL;
 
-    const char *p = _substr_params_str(&params);
-    if(!p) {
-        PyErr_SetString(PyExc_ValueError, "substring not found");
-        return NULL;
-    }
+    Py_ssize_t pid = -1;
+    Py_ssize_t pos = _multifinder_search((struct multifinder *)self, view.buf, start, end, &pid);
+    PyBuffer_Release(&view);
 
-    return PyLong_FromSsize_t(p - CSTRING_VALUE(self));
+    return PyLong_FromSsize_t(pos);
 }
 
-PyDoc_STRVAR(isalnum__doc__, "");
-PyObject *cstring_isalnum(PyObject *self, PyObject *args) {
-    const char *p = CSTRING_VALUE(self);
-    while(*p) {
-        if(!isalnum(*p))
-            Py_RETURN_FALSE;
-        ++p;
-    }
-    Py_RETURN_TRUE;
-}
+PyDoc_STRVAR(multifinder_count_many__doc__, "");
+static PyObject *multifinder_count_many(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    struct multifinder *mf = (struct multifinder *)self;
+    Py_buffer view;
+    Py_ssize_t start, end;
+    if(_finder_parse_args("count_many", args, nargs, &view, &start, &end) < 0)
+        return NULL;
 
-PyDoc_STRVAR(isalpha__doc__, "");
-PyObject *cstring_isalpha(PyObject *self, PyObject *args) {
-    const char *p = CSTRING_VALUE(self);
-    while(*p) {
-        if(!isalpha(*p))
-            Py_RETURN_FALSE;
-        ++p;
+    Py_ssize_t npatterns = PyTuple_GET_SIZE(mf->patterns);
+    /* counts[pid], and the first position a new match of pid may start at
+     * (non-overlapping per pattern, as cstring.count) */
+    Py_ssize_t *counts = PyMem_New(Py_ssize_t, 2 * npatterns + 1);
+    if(!counts) {
+        PyBuffer_Release(&view);
+        return PyErr_NoMemory();
     }
-    Py_RETURN_TRUE;
-}
-
-PyDoc_STRVAR(isdigit__doc__, "");
-PyObject *cstring_isdigit(PyObject *self, PyObject *args) {
-    const char *p = CSTRING_VALUE(self);
-    while(*p) {
-        if(!isdigit(*p))
-            Py_RETURN_FALSE;
-        ++p;
+    Py_ssize_t *allowed = counts + npatterns;
+    STATS_SEARCH(MULTIFINDER);
+    for(Py_ssize_t pid = 0; pid < npatterns; ++pid) {
+        counts[pid] = 0;
+        allowed[pid] = 0;
     }
-    Py_RETURN_TRUE;
-}
 
-PyDoc_STRVAR(islower__doc__, "");
-PyObject *cstring_islower(PyObject *self, PyObject *args) {
-    const char *p = CSTRING_VALUE(self);
-    while(*p) {
-        if(isalpha(*p)) {
-            if(!islower(*p))
-                Py_RETURN_FALSE;
-            ++p;
-            while(*p) {
-                if(isalpha(*p) && !islower(*p))
-                    Py_RETURN_FALSE;
-                ++p;
+    const unsigned char *t = view.buf;
+    const uint32_t *delta = mf->delta;
+    int nc = mf->nclasses;
+    uint32_t row = 0;
+    for(Py_ssize_t i = start; i < end; ++i) {
+        uint32_t next = delta[row + mf->classes[t[i]]];
+        row = next & AC_ROW_MASK;
+        if(next & AC_OUTPUT) {
+            int32_t s = AC_FIRST_OUTPUT(mf, (int32_t)(row / nc));
+            for(; s >= 0; s = mf->dict_link[s]) {
+                for(int32_t pid = mf->state_pattern[s]; pid >= 0; pid = mf->pattern_next[pid]) {
+                    Py_ssize_t pos = i - AC_PATTERN_LEN(mf, pid) + 1;
+                    if(pos >= allowed[pid]) {
+                        ++counts[pid];
+                        allowed[pid] = i + 1;
+                    }
+                }
             }
-            /* at least one lc alpha and no uc alphas */
-            Py_RETURN_TRUE;
         }
-        ++p;
     }
-    Py_RETURN_FALSE;
+    PyBuffer_Release(&view);
+
+    PyObject *result = PyList_New(npatterns);
+    if(result) {
+        for(Py_ssize_t pid = 0; pid < npatterns; ++pid) {
+            PyObject *count = PyLong_FromSsize_t(counts[pid]);
+            if(!count) {
+                Py_CLEAR(result);
+                break;
+            }
+            PyList_SET_ITEM(result, pid, count);
+        }
+    }
+    PyMem_Free(counts);
+    return result;
 }
 
-PyDoc_STRVAR(isprintable__doc__, "");
-PyObject *cstring_isprintable(PyObject *self, PyObject *args) {
-    const char *p = CSTRING_VALUE(self);
-    while(*p) {
-        if(!isprint(*p))
-            Py_RETURN_FALSE;
-        ++p;
+struct multifinditer {
+    PyObject_HEAD
+    struct multifinder *finder;
+    Py_buffer view;
+    Py_ssize_t pos;
+    Py_ssize_t end;
+    uint32_t row;
+    int32_t state;      /* output state being reported, or -1 */
+    int32_t pid;        /* next pattern of state to report */
+};
+
+PyDoc_STRVAR(multifinder_finditer__doc__, "");
+static PyObject *multifinder_finditer(PyObject *self, PyObject *const *args, Py_ssize_t nargs) {
+    struct multifinditer *iter = PyObject_New(struct multifinditer, &multifinditer_type);
+    if(!iter)
+        return NULL;
+    if(_finder_parse_args("finditer", args, nargs, &iter->view, &iter->pos, &iter->end) < 0) {
+        iter->finder = NULL;
+        iter->view.obj = NULL;
+        Py_DECREF(iter);
+        return NULL;
     }
-    Py_RETURN_TRUE;
+    Py_INCREF(self);
+    iter->finder = (struct multifinder *)self;
+    iter->row = 0;
+    iter->state = -1;
+    iter->pid = -1;
+    return (PyObject *)iter;
 }
 
-PyDoc_STRVAR(isspace__doc__, "");
-PyObject *cstring_isspace(PyObject *self, PyObject *args) {
-    const char *p = CSTRING_VALUE(self);
-    while(*p) {
-        if(!isspace(*p))
-            Py_RETURN_FALSE;
-        ++p;
-    }
-    return PyBool_FromLong(p != CSTRING_VALUE(self));
+static void multifinditer_dealloc(PyObject *self) {
+    struct multifinditer *iter = (struct multifinditer *)self;
+    if(iter->view.obj)
+        PyBuffer_Release(&iter->view);
+    Py_XDECREF(iter->finder);
+    PyObject_Del(self);
 }
 
-PyDoc_STRVAR(isupper__doc__, "");
-PyObject *cstring_isupper(PyObject *self, PyObject *args) {
-    const char *p = CSTRING_VALUE(self);
-    while(*p) {
-        if(isalpha(*p)) {
-            if(!isupper(*p))
-                Py_RETURN_FALSE;
-            ++p;
-            while(*p) {
-                if(isalpha(*p) && !isupper(*p))
-                    Py_RETURN_FALSE;
-                ++p;
+static PyObject *_multifinditer_next(PyObject *self) {
+    struct multifinditer *iter = (struct multifinditer *)self;
+    struct multifinder *mf = iter->finder;
+    const unsigned char *t = iter->view.buf;
+
+    while(iter->pid < 0) {
+        if(iter->state >= 0)
+            iter->state = mf->dict_link[iter->state];
+        if(iter->state < 0) {
+            /* advance to the next position ending a match */
+            uint32_t next = 0;
+            STATS_SEARCH(MULTIFINDER);
+            while(iter->pos < iter->end) {
+                next = mf->delta[iter->row + mf->classes[t[iter->pos++]]];
+                iter->row = next & AC_ROW_MASK;
+                if(next & AC_OUTPUT)
+                    break;
             }
-            /* at least one uc alpha and no lc alphas */
-            Py_RETURN_TRUE;
+            if(!(next & AC_OUTPUT))
+                return NULL;
+            iter->state = AC_FIRST_OUTPUT(mf, (int32_t)(iter->row / mf->nclasses));
         }
-        ++p;
+        iter->pid = mf->state_pattern[iter->state];
     }
-    Py_RETURN_FALSE;
+
+    int32_t pid = iter->pid;
+    iter->pid = mf->pattern_next[pid];
+    return Py_BuildValue("(ni)", iter->pos - AC_PATTERN_LEN(mf, pid), pid);
 }
 
-PyDoc_STRVAR(join__doc__, "");
-PyObject *cstring_join(PyObject *self, PyObject *arg) {
-    PyObject *iter = PyObject_GetIter(arg);
-    if(!iter)
-        return NULL;
+static PyObject *multifinditer_next(PyObject *self) {
+    PyObject *result;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    result = _multifinditer_next(self);
+    Py_END_CRITICAL_SECTION();
+    return result;
+}
 
-    PyObject *result = NULL;
-    PyObject *item = NULL;
+static PyMethodDef multifinder_methods[] = {
+    {"count_many", (PyCFunction)multifinder_count_many, METH_FASTCALL, multifinder_count_many__doc__},
+    {"find_any", (PyCFunction)multifinder_find_any, METH_FASTCALL, multifinder_find_any__doc__},
+    {"finditer", (PyCFunction)multifinder_finditer, METH_FASTCALL, multifinder_finditer__doc__},
+    {"search", (PyCFunction)multifinder_search, METH_FASTCALL, multifinder_search__doc__},
+    {0},
+};
 
-    while((item = PyIter_Next(iter)) != NULL) {
-        if(result) {
-            PyObject *next = _concat_in_place(result, self);
-            if(!next)
-                goto fail;
-            result = next;
-        }
-        PyObject *next = _concat_in_place(result, item);
-        if(!next)
-            goto fail;
-        Py_DECREF(item);
-        result = next;
+static PyMemberDef multifinder_members[] = {
+    {"patterns", T_OBJECT_EX, offsetof(struct multifinder, patterns), READONLY, ""},
+    {0},
+};
+
+static PyTypeObject multifinder_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "cstring.MultiFinder",
+    .tp_doc = "",
+    .tp_basicsize = sizeof(struct multifinder),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = multifinder_new,
+    .tp_dealloc = multifinder_dealloc,
+    .tp_methods = multifinder_methods,
+    .tp_members = multifinder_members,
+};
+
+static PyTypeObject multifinditer_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "cstring.MultiFinder.finditer",
+    .tp_basicsize = sizeof(struct multifinditer),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = multifinditer_dealloc,
+    .tp_iter = PyObject_SelfIter,
+    .tp_iternext = multifinditer_next,
+};
+
+/*
+ * readlines: iterates over the lines of a binary file (ending with "\n",
+ * which is kept), read in chunks of chunk_size bytes. Lines are views into
+ * the current chunk. A line cut off by the end of a chunk is moved to the
+ * start of the next one; the chunk buffer is reused for that if no line
+ * of it is still alive, and grown if a line doesn't fit.
+ *
+ * Each chunk's complete lines are validated as a whole; only if that
+ * fails are lines validated one at a time.
+ */
+
+#define READLINES_CHUNK_SIZE    (1024 * 1024)
+
+struct lineiter {
+    PyObject_HEAD
+    PyObject *readinto;     /* bound method; NULL at end of file */
+    PyObject *chunk;        /* compact cstring, of Py_SIZE - 1 bytes capacity */
+    Py_ssize_t chunk_size;
+    Py_ssize_t pos;         /* start of the next line */
+    Py_ssize_t len;         /* bytes in chunk */
+    Py_ssize_t checked;     /* lines ending by here were validated together ... */
+    int meta;               /* ... with these flags (0 if invalid) */
+    const char *errors;
+};
+
+static PyTypeObject lineiter_type;
+
+PyDoc_STRVAR(readlines__doc__, "");
+static PyObject *cstring_readlines(PyObject *module, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    static const char *const kwlist[] = {"file", "chunk_size", "errors", NULL};
+    PyObject *argv[3];
+    Py_ssize_t chunk_size = READLINES_CHUNK_SIZE;
+    const char *errors = "strict";
+    if(_parse_args("readlines", args, nargs, kwnames, kwlist, 1, argv) < 0)
+        return NULL;
+    if(argv[1] && _arg_ssize(argv[1], &chunk_size) < 0)
+        return NULL;
+    if(argv[2] && _arg_str(argv[2], "errors", &errors) < 0)
+        return NULL;
+    PyObject *file = argv[0];
+    if(chunk_size <= 0) {
+        PyErr_SetString(PyExc_ValueError, "chunk_size must be positive");
+        return NULL;
     }
+    if(_check_errors(errors) < 0)
+        return NULL;
 
-    return result;
+    PyObject *readinto;
+    if(PyLong_Check(file)) {
+        /* a file descriptor, which stays open */
+        PyObject *io = PyImport_ImportModule("io");
+        if(!io)
+            return NULL;
+        PyObject *raw = PyObject_CallMethod(io, "FileIO", "OsO", file, "rb", Py_False);
+        Py_DECREF(io);
+        if(!raw)
+            return NULL;
+        readinto = PyObject_GetAttrString(raw, "readinto");
+        Py_DECREF(raw);
+    } else {
+        readinto = PyObject_GetAttrString(file, "readinto");
+        if(!readinto && PyErr_ExceptionMatches(PyExc_AttributeError)) {
+            PyErr_Format(PyExc_TypeError,
+                "expected a binary file or a file descriptor, not %s", Py_TYPE(file)->tp_name);
+        }
+    }
+    if(!readinto)
+        return NULL;
 
-fail:
-    Py_XDECREF(item);
-    Py_XDECREF(result);
-    return NULL;
+    struct lineiter *iter = PyObject_New(struct lineiter, &lineiter_type);
+    if(!iter) {
+        Py_DECREF(readinto);
+        return NULL;
+    }
+    iter->readinto = readinto;
+    iter->chunk = NULL;
+    iter->chunk_size = chunk_size;
+    iter->pos = iter->len = iter->checked = 0;
+    iter->meta = 0;
+    iter->errors = strcmp(errors, "trust") == 0 ? "trust"
+        : strcmp(errors, "replace") == 0 ? "replace" : "strict";
+    return (PyObject *)iter;
 }
 
-PyDoc_STRVAR(lower__doc__, "");
-PyObject *cstring_lower(PyObject *self, PyObject *args) {
-    struct cstring *new = CSTRING_ALLOC(Py_TYPE(self), Py_SIZE(self));
-    if(!new)
-        return NULL;
-    const char *s = CSTRING_VALUE(self);
-    char *d = CSTRING_VALUE(new);
+static void lineiter_dealloc(PyObject *self) {
+    struct lineiter *iter = (struct lineiter *)self;
+    Py_XDECREF(iter->readinto);
+    Py_XDECREF(iter->chunk);
+    PyObject_Del(self);
+}
 
-    while((*d++ = tolower(*s++)) != '\0')
-        ;
+/* Moves the partial line to the front of a chunk with room for more, and
+ * reads into the rest. Returns the number of bytes read (0 at the end of
+ * the file), or -1. */
+static Py_ssize_t _lineiter_fill(struct lineiter *iter) {
+    Py_ssize_t keep = iter->len - iter->pos;
+    Py_ssize_t capacity = iter->chunk ? cstring_len(iter->chunk) : 0;
+    Py_ssize_t needed = Py_MAX(iter->chunk_size, keep < PY_SSIZE_T_MAX / 2 ? keep * 2 : keep + 1);
+    if(keep < capacity && capacity >= iter->chunk_size)
+        needed = capacity;
+
+    if(iter->chunk && Py_REFCNT(iter->chunk) == 1) {
+        /* no line of it is alive */
+        memmove(CSTRING_VALUE(iter->chunk), CSTRING_VALUE_AT(iter->chunk, iter->pos), keep);
+        if(needed != capacity) {
+            PyObject *grown = _cstring_realloc(iter->chunk, needed);
+            if(!grown)
+                return -1;
+            iter->chunk = grown;
+        }
+    } else {
+        PyObject *chunk = (PyObject *)CSTRING_ALLOC(&cstring_type, needed + 1);
+        if(!chunk)
+            return -1;
+        if(keep)
+            memcpy(CSTRING_VALUE(chunk), CSTRING_VALUE_AT(iter->chunk, iter->pos), keep);
+        Py_XSETREF(iter->chunk, chunk);
+    }
+    iter->pos = 0;
+    iter->len = keep;
+    iter->checked = 0;
 
-    return (PyObject *)new;
+    PyObject *target = PyMemoryView_FromMemory(
+        CSTRING_VALUE_AT(iter->chunk, keep), needed - keep, PyBUF_WRITE);
+    if(!target)
+        return -1;
+    PyObject *result = PyObject_CallFunctionObjArgs(iter->readinto, target, NULL);
+    /* make sure the file can't write into the chunk later */
+    PyObject *released = PyObject_CallMethod(target, "release", NULL);
+    Py_XDECREF(released);
+    Py_DECREF(target);
+    if(!result || !released) {
+        Py_XDECREF(result);
+        return -1;
+    }
+    Py_ssize_t n = PyNumber_AsSsize_t(result, PyExc_OverflowError);
+    Py_DECREF(result);
+    if(n == -1 && PyErr_Occurred())
+        return -1;
+    if(n < 0 || n > needed - keep) {
+        PyErr_SetString(PyExc_ValueError, "readinto() returned an invalid size");
+        return -1;
+    }
+    iter->len += n;
+
+    /* validate the complete lines together */
+    const char *s = CSTRING_VALUE(iter->chunk);
+    const char *last = _memrchr(s, '\n', iter->len);
+    if(last && strcmp(iter->errors, "trust") != 0) {
+        int ascii;
+        Py_ssize_t length;
+        iter->checked = last + 1 - s;
+        CSTRING_BEGIN_ALLOW_THREADS(iter->checked)
+        length = _utf8_length_parallel(s, iter->checked, &ascii);
+        CSTRING_END_ALLOW_THREADS
+        iter->meta = length < 0 ? 0 : CSTRING_FLAG_VALID | (ascii ? CSTRING_FLAG_ASCII : 0);
+    }
+    return n;
 }
 
-static PyObject *_tuple_steal_refs(Py_ssize_t count, ...) {
-    PyObject *result = PyTuple_New(count);
-    if(!result)
+static PyObject *_lineiter_next(PyObject *self) {
+    struct lineiter *iter = (struct lineiter *)self;
+    const char *s, *nl;
+    for(;;) {
+        s = iter->chunk ? CSTRING_VALUE(iter->chunk) : NULL;
+        nl = s ? memchr(s + iter->pos, '\n', iter->len - iter->pos) : NULL;
+        if(nl || !iter->readinto)
+            break;
+        Py_ssize_t n = _lineiter_fill(iter);
+        if(n < 0)
+            return NULL;
+        if(n == 0)
+            Py_CLEAR(iter->readinto);
+    }
+
+    Py_ssize_t start = iter->pos;
+    Py_ssize_t end = nl ? nl + 1 - s : iter->len;
+    if(start == end)
         return NULL;
+    iter->pos = end;
 
-    va_list va;
-    va_start(va, count);
-    for(int i = 0; i < count; ++i) {
-        PyObject *o = va_arg(va, PyObject *);
-        if(!o)
-            goto fail;
-        PyTuple_SET_ITEM(result, i, o);
+    PyObject *line = end - start == 1
+        ? cstring_new_byte(s[start])
+        : _cstring_view_alloc(iter->chunk, s + start, end - start);
+    if(!line)
+        return NULL;
+    if(strcmp(iter->errors, "trust") == 0 || (end <= iter->checked && iter->meta)) {
+        if(end <= iter->checked && (iter->meta & CSTRING_FLAG_ASCII) && end - start > 1)
+            _cstring_set_ascii(line);
+        return line;
     }
-    va_end(va);
+    return _cstring_validated(line, iter->errors);
+}
 
+static PyObject *lineiter_next(PyObject *self) {
+    PyObject *result;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    result = _lineiter_next(self);
+    Py_END_CRITICAL_SECTION();
     return result;
-
-fail:
-    Py_DECREF(result);
-    return NULL;
 }
 
-PyDoc_STRVAR(partition__doc__, "");
-PyObject *cstring_partition(PyObject *self, PyObject *arg) {
-    if(!_ensure_cstring(arg))
-        return NULL;
+static PyTypeObject lineiter_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "cstring.line_iterator",
+    .tp_basicsize = sizeof(struct lineiter),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = lineiter_dealloc,
+    .tp_iter = PyObject_SelfIter,
+    .tp_iternext = lineiter_next,
+};
 
-    const char *search = CSTRING_VALUE(arg);
+/*
+ * Array: many strings stored end to end in one cstring, `data`, with an
+ * int64 offsets table: element i is data[offsets[i]:offsets[i + 1]].
+ * Elements are returned as views of data. The bulk methods loop over the
+ * table in C and return flat memoryviews of bools ('?') or int64s ('q').
+ */
+
+struct array {
+    PyObject_HEAD
+    PyObject *data;             /* cstring */
+    int64_t *offsets;           /* count + 1 entries, nondecreasing */
+    Py_ssize_t count;
+    PyObject *offsets_owner;    /* keeps offsets alive; NULL if they're ours to free */
+};
 
-    const char *left = CSTRING_VALUE(self);
-    const char *mid = strstr(left, search);
-    if(!mid) {
-        return _tuple_steal_refs(3,
-            (Py_INCREF(self), self),
-            cstring_new_empty(),
-            cstring_new_empty());
-    }
-    const char *right = mid + strlen(search);
+static PyTypeObject array_type;
 
-    return _tuple_steal_refs(3,
-        _cstring_new(Py_TYPE(self), left, mid - left),
-        _cstring_new(Py_TYPE(self), mid, right - mid),
-        _cstring_new(Py_TYPE(self), right, &CSTRING_LAST_BYTE(self) - right));
+#define ARRAY_VALUE(self, i)    (CSTRING_VALUE((self)->data) + (self)->offsets[i])
+#define ARRAY_LEN(self, i)      ((Py_ssize_t)((self)->offsets[(i) + 1] - (self)->offsets[i]))
+#define ARRAY_NBYTES(self)      ((Py_ssize_t)((self)->offsets[(self)->count] - (self)->offsets[0]))
+
+/* Takes a new reference to data. offsets are freed on failure, unless
+ * they belong to offsets_owner. */
+static PyObject *_array_new(PyTypeObject *type, PyObject *data, int64_t *offsets, Py_ssize_t count, PyObject *offsets_owner) {
+    struct array *self = (struct array *)type->tp_alloc(type, 0);
+    if(!self) {
+        if(!offsets_owner)
+            PyMem_Free(offsets);
+        return NULL;
+    }
+    Py_INCREF(data);
+    self->data = data;
+    self->offsets = offsets;
+    self->count = count;
+    Py_XINCREF(offsets_owner);
+    self->offsets_owner = offsets_owner;
+    return (PyObject *)self;
 }
 
-PyDoc_STRVAR(rpartition__doc__, "");
-PyObject *cstring_rpartition(PyObject *self, PyObject *arg) {
-    if(!_ensure_cstring(arg))
+static PyObject *_array_from_sequence(PyTypeObject *type, PyObject *arg) {
+    PyObject *seq = PySequence_Fast(arg, "Array() argument must be iterable");
+    if(!seq)
         return NULL;
 
-    const char *search = CSTRING_VALUE(arg);
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(seq);
+    PyObject *result = NULL;
+    PyObject *data = NULL;
+    Py_buffer *parts = NULL;
+    Py_ssize_t pinned = 0;
+    int64_t *offsets = PyMem_New(int64_t, count + 1);
+    if(!offsets || (count && !(parts = PyMem_New(Py_buffer, count)))) {
+        PyErr_NoMemory();
+        goto done;
+    }
 
-    const char *left = CSTRING_VALUE(self);
-    const char *mid = _strrstr(left, search);
-    if(!mid) {
-        return _tuple_steal_refs(3,
-            cstring_new_empty(),
-            cstring_new_empty(),
-            (Py_INCREF(self), self));
+    /* first pass: pin every item's bytes and size the data; the buffers
+     * are held until the copy, as in join */
+    int meta = CSTRING_FLAG_VALID | CSTRING_FLAG_ASCII;
+    Py_ssize_t length = 0;
+    offsets[0] = 0;
+    for(Py_ssize_t i = 0; i < count; ++i) {
+        if(count != PySequence_Fast_GET_SIZE(seq)) {
+            PyErr_SetString(PyExc_RuntimeError, "sequence changed size during Array()");
+            goto done;
+        }
+        PyObject *item = PySequence_Fast_GET_ITEM(seq, i);
+        if(_obj_get_buffer(item, &parts[i]) < 0)
+            goto done;
+        ++pinned;
+        Py_ssize_t len = parts[i].len;
+        if(len > PY_SSIZE_T_MAX - 1 - offsets[i]) {
+            PyErr_NoMemory();
+            goto done;
+        }
+        offsets[i + 1] = offsets[i] + len;
+
+        Py_ssize_t itemlength;
+        meta &= _obj_text_meta(item, &itemlength);
+        length += itemlength;
     }
-    const char *right = mid + strlen(search);
 
-    return _tuple_steal_refs(3,
-        _cstring_new(Py_TYPE(self), left, mid - left),
-        _cstring_new(Py_TYPE(self), mid, right - mid),
-        _cstring_new(Py_TYPE(self), right, &CSTRING_LAST_BYTE(self) - right));
-}
+    /* second pass: one allocation, then copy */
+    Py_ssize_t total = (Py_ssize_t)offsets[count];
+    if(total == 0) {
+        data = cstring_new_empty();
+    } else if((data = (PyObject *)CSTRING_ALLOC(&cstring_type, total + 1)) != NULL) {
+        for(Py_ssize_t i = 0; i < count; ++i)
+            memcpy(CSTRING_VALUE_AT(data, offsets[i]), parts[i].buf, parts[i].len);
+        STATS_ADD(bytes_copied, total);
+        if(meta & CSTRING_FLAG_VALID)
+            _cstring_set_meta(data, meta, length);
+    }
+    if(data) {
+        result = _array_new(type, data, offsets, count, NULL);
+        offsets = NULL;
+    }
 
-PyDoc_STRVAR(rfind__doc__, "");
-PyObject *cstring_rfind(PyObject *self, PyObject *args) {
-    struct _substr_params params;
+done:
+    for(Py_ssize_t i = 0; i < pinned; ++i)
+        PyBuffer_Release(&parts[i]);
+    PyMem_Free(offsets);
+    PyMem_Free(parts);
+    Py_XDECREF(data);
+    Py_DECREF(seq);
+    return result;
+}
 
-    if(!_parse_substr_args(self, args, &params))
+static PyObject *array_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    PyObject *items = NULL;
+    char *kwlist[] = {"items", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", kwlist, &items))
         return NULL;
+    if(!items) {
+        PyObject *empty = PyTuple_New(0);
+        if(!empty)
+            return NULL;
+        PyObject *result = _array_from_sequence(type, empty);
+        Py_DECREF(empty);
+        return result;
+    }
+    return _array_from_sequence(type, items);
+}
 
-    const char *p = _substr_params_rstr(&params);
-
-    if(!p)
-        return PyLong_FromLong(-1);
-
-    return PyLong_FromSsize_t(p - CSTRING_VALUE(self));
+static void array_dealloc(PyObject *self) {
+    struct array *array = (struct array *)self;
+    Py_XDECREF(array->data);
+    if(array->offsets_owner)
+        Py_DECREF(array->offsets_owner);
+    else
+        PyMem_Free(array->offsets);
+    Py_TYPE(self)->tp_free(self);
 }
 
-PyDoc_STRVAR(rindex__doc__, "");
-PyObject *cstring_rindex(PyObject *self, PyObject *args) {
-    struct _substr_params params;
+PyDoc_STRVAR(array_from_buffers__doc__, "");
+static PyObject *array_from_buffers(PyObject *cls, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    static const char *const kwlist[] = {"data", "offsets", NULL};
+    PyObject *argv[2];
+    if(_parse_args("from_buffers", args, nargs, kwnames, kwlist, 2, argv) < 0)
+        return NULL;
+    PyObject *dataobj = argv[0];
+    PyObject *offsetsobj = argv[1];
 
-    if(!_parse_substr_args(self, args, &params))
+    Py_buffer view;
+    if(PyObject_GetBuffer(offsetsobj, &view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) < 0)
+        return NULL;
+    const char *format = view.format ? view.format : "B";
+    if(view.itemsize != sizeof(int64_t) || !strchr("qQlLnN", format[strlen(format) - 1])) {
+        PyBuffer_Release(&view);
+        PyErr_Format(PyExc_TypeError, "offsets must be 64-bit integers, not format '%s'", format);
         return NULL;
+    }
+    if(view.len == 0) {
+        PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_ValueError, "offsets must have at least one entry");
+        return NULL;
+    }
+    Py_ssize_t count = view.len / sizeof(int64_t) - 1;
+    int64_t *offsets = PyMem_New(int64_t, count + 1);
+    if(offsets)
+        memcpy(offsets, view.buf, view.len);
+    PyBuffer_Release(&view);
+    if(!offsets)
+        return PyErr_NoMemory();
 
-    const char *p = _substr_params_rstr(&params);
-    if(!p) {
-        PyErr_SetString(PyExc_ValueError, "substring not found");
+    /* a cstring is shared; anything else is copied */
+    PyObject *data;
+    if(PyObject_TypeCheck(dataobj, &cstring_type)) {
+        data = dataobj;
+        Py_INCREF(data);
+    } else {
+        Py_ssize_t len;
+        const char *s = _obj_as_string_and_size(dataobj, &len);
+        data = s ? _cstring_new(&cstring_type, s, len) : NULL;
+        if(!data) {
+            PyMem_Free(offsets);
+            return NULL;
+        }
+    }
+
+    int ok = offsets[0] >= 0 && offsets[count] <= cstring_len(data);
+    for(Py_ssize_t i = 0; ok && i < count; ++i)
+        ok = offsets[i] <= offsets[i + 1];
+    if(!ok) {
+        PyErr_SetString(PyExc_ValueError, "offsets must be nondecreasing and within data");
+        PyMem_Free(offsets);
+        Py_DECREF(data);
         return NULL;
     }
 
-    return PyLong_FromSsize_t(p - CSTRING_VALUE(self));
+    PyObject *result = _array_new((PyTypeObject *)cls, data, offsets, count, NULL);
+    Py_DECREF(data);
+    return result;
 }
 
-PyObject *_cstring_split_on_chars(PyObject *self, const char seps[], Py_ssize_t maxsplit) {
-    if(maxsplit < 0)
-        maxsplit = PY_SSIZE_T_MAX;
+static Py_ssize_t array_len(PyObject *self) {
+    return ((struct array *)self)->count;
+}
 
-    const char *start = CSTRING_VALUE(self);
+static PyObject *_array_item(struct array *self, Py_ssize_t i) {
+    Py_ssize_t len = ARRAY_LEN(self, i);
+    if(len == 1)
+        return cstring_new_byte(*ARRAY_VALUE(self, i));
+    return _cstring_view_new(self->data, ARRAY_VALUE(self, i), len);
+}
 
-    PyObject *list = PyList_New(0);
-    if(!list)
+static PyObject *array_item(PyObject *self, Py_ssize_t i) {
+    struct array *array = (struct array *)self;
+    if(i < 0 || i >= array->count) {
+        PyErr_SetString(PyExc_IndexError, "Array index out of range");
         return NULL;
+    }
+    return _array_item(array, i);
+}
 
-    while(*start) {
-        const char *end = start;
-        while(*end && !strchr(seps, *end))
-            ++end;
-
-        PyObject *new = _cstring_new(Py_TYPE(self), start, end - start);
-        if(!new)
-            goto fail;
-        PyList_Append(list, new);
-        Py_DECREF(new);
+static PyObject *array_subscript(PyObject *self, PyObject *key) {
+    struct array *array = (struct array *)self;
+    if(PyIndex_Check(key)) {
+        Py_ssize_t i = PyNumber_AsSsize_t(key, PyExc_IndexError);
+        if(i == -1 && PyErr_Occurred())
+            return NULL;
+        return array_item(self, i < 0 ? i + array->count : i);
+    }
+    if(!PySlice_Check(key))
+        return _bad_argument_type(key);
 
-        const char *skip = end + 1;
-        while(*skip && strchr(seps, *skip))
-            ++skip;
-        start = skip;
+    Py_ssize_t start, stop, step;
+    if(PySlice_Unpack(key, &start, &stop, &step) < 0)
+        return NULL;
+    Py_ssize_t slicelen = PySlice_AdjustIndices(array->count, &start, &stop, step);
+    if(step == 1) {
+        /* shares data and offsets */
+        PyObject *owner = array->offsets_owner ? array->offsets_owner : self;
+        return _array_new(Py_TYPE(self), array->data, array->offsets + start, slicelen, owner);
+    }
 
-        if(PyList_GET_SIZE(list) + 1 > maxsplit) {
-            PyObject *new = _cstring_new(Py_TYPE(self), start, strlen(start));
-            if(!new)
-                goto fail;
-            PyList_Append(list, new);
-            Py_DECREF(new);
-            break;
+    PyObject *items = PyList_New(slicelen);
+    if(!items)
+        return NULL;
+    for(Py_ssize_t i = 0; i < slicelen; ++i) {
+        PyObject *item = _array_item(array, start + i * step);
+        if(!item) {
+            Py_DECREF(items);
+            return NULL;
         }
+        PyList_SET_ITEM(items, i, item);
     }
+    PyObject *result = _array_from_sequence(Py_TYPE(self), items);
+    Py_DECREF(items);
+    return result;
+}
 
-    return list;
-
-fail:
-    Py_DECREF(list);
-    return NULL;
+static PyObject *array_repr(PyObject *self) {
+    PyObject *items = PySequence_List(self);
+    if(!items)
+        return NULL;
+    PyObject *result = PyUnicode_FromFormat("%s(%R)", Py_TYPE(self)->tp_name, items);
+    Py_DECREF(items);
+    return result;
 }
 
-PyObject *_cstring_split_on_cstring(PyObject *self, PyObject *sepobj, Py_ssize_t maxsplit) {
-    if(!_ensure_cstring(sepobj))
+/* A read-only memoryview of bytes (a reference that is stolen) as items of `format`. */
+static PyObject *_array_result(PyObject *bytes, const char *format) {
+    if(!bytes)
         return NULL;
+    PyObject *view = PyMemoryView_FromObject(bytes);
+    Py_DECREF(bytes);
+    if(!view)
+        return NULL;
+    PyObject *result = PyObject_CallMethod(view, "cast", "s", format);
+    Py_DECREF(view);
+    return result;
+}
 
-    if(maxsplit < 0)
-        maxsplit = PY_SSIZE_T_MAX;
+#define ARRAY_RESULT_NEW(self, type) \
+    PyBytes_FromStringAndSize(NULL, (self)->count * sizeof(type))
+#define ARRAY_RESULT_ITEMS(bytes, type) \
+    ((type *)PyBytes_AS_STRING(bytes))
 
-    PyObject *list = PyList_New(0);
-    if(!list)
+PyDoc_STRVAR(array_find__doc__, "");
+static PyObject *array_find(PyObject *self, PyObject *arg) {
+    struct array *array = (struct array *)self;
+    Py_buffer sub;
+    if(_obj_get_buffer(arg, &sub) < 0)
         return NULL;
 
-    const char *sep = CSTRING_VALUE(sepobj);
-    const char *s = CSTRING_VALUE(self);
-    for(;;) {
-        const char *e = strstr(s, sep);
-        if(!e)
-            break;
-        PyObject *new = _cstring_new(Py_TYPE(self), s, e - s);
-        if(!new)
-            goto fail;
-        PyList_Append(list, new);
-        Py_DECREF(new);
-        s = e + strlen(sep);
-        if(PyList_GET_SIZE(list) + 1 > maxsplit)
-            break;
+    PyObject *result = ARRAY_RESULT_NEW(array, int64_t);
+    if(result) {
+        int64_t *found = ARRAY_RESULT_ITEMS(result, int64_t);
+        struct _search search;
+        _search_init(&search, sub.buf, sub.len);
+        STATS_ADD(searches[STATS_SEARCH_ARRAY], array->count);
+        CSTRING_BEGIN_ALLOW_THREADS(ARRAY_NBYTES(array))
+        for(Py_ssize_t i = 0; i < array->count; ++i) {
+            const char *s = ARRAY_VALUE(array, i);
+            const char *p = _search_find(&search, s, ARRAY_LEN(array, i));
+            found[i] = p ? p - s : -1;
+        }
+        CSTRING_END_ALLOW_THREADS
     }
-
-    PyObject *new = _cstring_new(Py_TYPE(self), s, strlen(s));
-    if(!new)
-        goto fail;
-    PyList_Append(list, new);
-
-    return list;
-
-fail:
-    Py_DECREF(list);
-    return NULL;
+    PyBuffer_Release(&sub);
+    return _array_result(result, "q");
 }
 
-PyDoc_STRVAR(split__doc__, "");
-PyObject *cstring_split(PyObject *self, PyObject *args, PyObject *kwargs) {
-    PyObject *sepobj = Py_None;
-    int maxsplit = -1;
-    char *kwlist[] = {"sep", "maxsplit", NULL};
-    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "|Oi", kwlist, &sepobj, &maxsplit))
+PyDoc_STRVAR(array_startswith__doc__, "");
+static PyObject *array_startswith(PyObject *self, PyObject *arg) {
+    struct array *array = (struct array *)self;
+    Py_buffer prefix;
+    if(_obj_get_buffer(arg, &prefix) < 0)
         return NULL;
 
-    return (sepobj == Py_None)
-        ? _cstring_split_on_chars(self, WHITESPACE_CHARS, maxsplit)
-        : _cstring_split_on_cstring(self, sepobj, maxsplit);
+    PyObject *result = ARRAY_RESULT_NEW(array, char);
+    if(result) {
+        char *matched = ARRAY_RESULT_ITEMS(result, char);
+        CSTRING_BEGIN_ALLOW_THREADS(ARRAY_NBYTES(array))
+        for(Py_ssize_t i = 0; i < array->count; ++i) {
+            matched[i] = ARRAY_LEN(array, i) >= prefix.len
+                && memcmp(ARRAY_VALUE(array, i), prefix.buf, prefix.len) == 0;
+        }
+        CSTRING_END_ALLOW_THREADS
+    }
+    PyBuffer_Release(&prefix);
+    return _array_result(result, "?");
 }
 
-PyDoc_STRVAR(startswith__doc__, "");
-PyObject *cstring_startswith(PyObject *self, PyObject *args) {
-    struct _substr_params params;
-    if(!_parse_substr_args(self, args, &params))
-        return NULL;
-    if(params.end - params.start < params.substr_len)
-        return PyBool_FromLong(0);
-    int cmp = memcmp(params.start, params.substr, params.substr_len);
-    return PyBool_FromLong(cmp == 0);
+PyDoc_STRVAR(array_lengths__doc__, "");
+static PyObject *array_lengths(PyObject *self, PyObject *args) {
+    struct array *array = (struct array *)self;
+    PyObject *result = ARRAY_RESULT_NEW(array, int64_t);
+    if(result) {
+        int64_t *lengths = ARRAY_RESULT_ITEMS(result, int64_t);
+        for(Py_ssize_t i = 0; i < array->count; ++i)
+            lengths[i] = ARRAY_LEN(array, i);
+    }
+    return _array_result(result, "q");
 }
 
-const char *_strip_chars_from_args(PyObject *args) {
-    PyObject *charsobj = NULL;
-    if(!PyArg_ParseTuple(args, "|O", &charsobj))
-        return NULL;
+PyDoc_STRVAR(array_lower__doc__, "");
+static PyObject *array_lower(PyObject *self, PyObject *args) {
+    struct array *array = (struct array *)self;
+    const char *s = ARRAY_VALUE(array, 0);
+    Py_ssize_t n = ARRAY_NBYTES(array);
+
+    int ascii = CSTRING_KNOWN_ASCII(array->data);
+    if(!ascii) {
+        CSTRING_BEGIN_ALLOW_THREADS(n)
+        ascii = _find_non_ascii(s, n) == n;
+        CSTRING_END_ALLOW_THREADS
+    }
 
-    const char *chars = WHITESPACE_CHARS;
+    if(!ascii) {
+        /* lengths can change: map each element, then pack them again */
+        PyObject *items = PyList_New(array->count);
+        if(!items)
+            return NULL;
+        for(Py_ssize_t i = 0; i < array->count; ++i) {
+            PyObject *item = _array_item(array, i);
+            PyObject *mapped = item ? _cstring_case_map(item, CASE_LOWER, "lower") : NULL;
+            Py_XDECREF(item);
+            if(!mapped) {
+                Py_DECREF(items);
+                return NULL;
+            }
+            PyList_SET_ITEM(items, i, mapped);
+        }
+        PyObject *result = _array_from_sequence(Py_TYPE(self), items);
+        Py_DECREF(items);
+        return result;
+    }
 
-    if(charsobj && charsobj != Py_None) {
-        if(!PyUnicode_Check(charsobj))
-            return _bad_argument_type(charsobj);
-        chars = PyUnicode_AsUTF8(charsobj);
+    /* same offsets (rebased to 0), one pass over the data */
+    int64_t *offsets = PyMem_New(int64_t, array->count + 1);
+    if(!offsets)
+        return PyErr_NoMemory();
+    for(Py_ssize_t i = 0; i <= array->count; ++i)
+        offsets[i] = array->offsets[i] - array->offsets[0];
+
+    PyObject *data = n ? (PyObject *)CSTRING_ALLOC(&cstring_type, n + 1) : cstring_new_empty();
+    if(!data) {
+        PyMem_Free(offsets);
+        return NULL;
+    }
+    if(n) {
+        CSTRING_BEGIN_ALLOW_THREADS(n)
+        _ascii_case_parallel(CSTRING_VALUE(data), s, n, CASE_LOWER);
+        CSTRING_END_ALLOW_THREADS
+        _cstring_set_ascii(data);
     }
+    PyObject *result = _array_new(Py_TYPE(self), data, offsets, array->count, NULL);
+    Py_DECREF(data);
+    return result;
+}
 
-    return chars;
+/* Elementwise == and != against a string-like object or an Array of the
+ * same length, as a bool memoryview. */
+static PyObject *array_richcompare(PyObject *self, PyObject *other, int op) {
+    struct array *array = (struct array *)self;
+    if(op != Py_EQ && op != Py_NE)
+        Py_RETURN_NOTIMPLEMENTED;
+
+    struct array *others = NULL;
+    Py_buffer view;
+    if(PyObject_TypeCheck(other, &array_type)) {
+        others = (struct array *)other;
+        if(others->count != array->count) {
+            PyErr_Format(PyExc_ValueError, "cannot compare Arrays of lengths %zd and %zd",
+                array->count, others->count);
+            return NULL;
+        }
+    } else if(PyUnicode_Check(other) || PyObject_CheckBuffer(other)) {
+        if(_obj_get_buffer(other, &view) < 0)
+            return NULL;
+    } else {
+        Py_RETURN_NOTIMPLEMENTED;
+    }
+
+    PyObject *result = ARRAY_RESULT_NEW(array, char);
+    if(result) {
+        char *equal = ARRAY_RESULT_ITEMS(result, char);
+        CSTRING_BEGIN_ALLOW_THREADS(ARRAY_NBYTES(array))
+        for(Py_ssize_t i = 0; i < array->count; ++i) {
+            Py_ssize_t len = ARRAY_LEN(array, i);
+            const void *s = others ? ARRAY_VALUE(others, i) : view.buf;
+            Py_ssize_t slen = others ? ARRAY_LEN(others, i) : view.len;
+            int eq = len == slen && memcmp(ARRAY_VALUE(array, i), s, len) == 0;
+            equal[i] = eq == (op == Py_EQ);
+        }
+        CSTRING_END_ALLOW_THREADS
+    }
+    if(!others)
+        PyBuffer_Release(&view);
+    return _array_result(result, "?");
 }
 
-PyDoc_STRVAR(strip__doc__, "");
-PyObject *cstring_strip(PyObject *self, PyObject *args) {
-    const char *chars = _strip_chars_from_args(args);
+static PyObject *array_get_offsets(PyObject *self, void *closure) {
+    struct array *array = (struct array *)self;
+    return _array_result(PyBytes_FromStringAndSize(
+        (const char *)array->offsets, (array->count + 1) * sizeof(int64_t)), "q");
+}
 
-    const char *start = CSTRING_VALUE(self);
-    while(strchr(chars, *start))
-        ++start;
+/*
+ * Arrow C Data Interface (https://arrow.apache.org/docs/format/CDataInterface.html)
+ * for string columns. An Array's data and offsets are exported as they
+ * are, as a large_utf8 ("U") array with no validity bitmap, that keeps the
+ * Array alive until it is released. Imported large_utf8 and large_binary
+ * arrays are used in place; utf8 and binary ones ("u", "z"), with int32
+ * offsets, get a converted copy of the offsets.
+ */
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+    const char *format;
+    const char *name;
+    const char *metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema **children;
+    struct ArrowSchema *dictionary;
+    void (*release)(struct ArrowSchema *);
+    void *private_data;
+};
 
-    const char *end = &CSTRING_LAST_BYTE(self) - 1;
-    while(strchr(chars, *end))
-        --end;
+struct ArrowArray {
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void **buffers;
+    struct ArrowArray **children;
+    struct ArrowArray *dictionary;
+    void (*release)(struct ArrowArray *);
+    void *private_data;
+};
 
-    Py_ssize_t newsize = end - start + 1;
-    return _cstring_new(Py_TYPE(self), start, newsize);
-}
+#endif
 
-PyDoc_STRVAR(lstrip__doc__, "");
-PyObject *cstring_lstrip(PyObject *self, PyObject *args) {
-    const char *chars = _strip_chars_from_args(args);
+struct _arrow_export {
+    PyObject *owner;        /* the exported Array */
+    const void *buffers[3];
+    int32_t *offsets32;     /* for format "u", or NULL */
+};
 
-    const char *start = CSTRING_VALUE(self);
-    while(strchr(chars, *start))
-        ++start;
-    const char *end = &CSTRING_LAST_BYTE(self) - 1;
+static void _arrow_schema_release(struct ArrowSchema *schema) {
+    schema->release = NULL;
+}
 
-    Py_ssize_t newsize = end - start + 1;
-    return _cstring_new(Py_TYPE(self), start, newsize);
+/* May be called from any thread, with or without the GIL. */
+static void _arrow_array_release(struct ArrowArray *array) {
+    struct _arrow_export *export = array->private_data;
+    PyGILState_STATE state = PyGILState_Ensure();
+    Py_DECREF(export->owner);
+    PyGILState_Release(state);
+    PyMem_RawFree(export->offsets32);
+    PyMem_RawFree(export);
+    array->release = NULL;
 }
 
-PyDoc_STRVAR(rstrip__doc__, "");
-PyObject *cstring_rstrip(PyObject *self, PyObject *args) {
-    const char *chars = _strip_chars_from_args(args);
+static void _arrow_schema_capsule_free(PyObject *capsule) {
+    struct ArrowSchema *schema = PyCapsule_GetPointer(capsule, "arrow_schema");
+    if(schema->release)
+        schema->release(schema);
+    PyMem_Free(schema);
+}
 
-    const char *start = CSTRING_VALUE(self);
-    const char *end = &CSTRING_LAST_BYTE(self) - 1;
-    while(strchr(chars, *end))
-        --end;
+static void _arrow_array_capsule_free(PyObject *capsule) {
+    struct ArrowArray *array = PyCapsule_GetPointer(capsule, PyCapsule_GetName(capsule));
+    if(array->release)
+        array->release(array);
+    PyMem_Free(array);
+}
 
-    Py_ssize_t newsize = end - start + 1;
-    return _cstring_new(Py_TYPE(self), start, newsize);
+static PyObject *_arrow_schema_new(const char *format) {
+    struct ArrowSchema *schema = PyMem_Malloc(sizeof(*schema));
+    if(!schema)
+        return PyErr_NoMemory();
+    *schema = (struct ArrowSchema){
+        .format = format,
+        .name = "",
+        .release = _arrow_schema_release,
+    };
+    PyObject *capsule = PyCapsule_New(schema, "arrow_schema", _arrow_schema_capsule_free);
+    if(!capsule)
+        PyMem_Free(schema);
+    return capsule;
 }
 
-PyDoc_STRVAR(endswith__doc__, "");
-PyObject *cstring_endswith(PyObject *self, PyObject *args) {
-    struct _substr_params params;
-    if(!_parse_substr_args(self, args, &params))
-        return NULL;
-    if(params.end - params.start < params.substr_len)
-        return PyBool_FromLong(0);
-    int cmp = memcmp(params.end - params.substr_len, params.substr, params.substr_len);
-    return PyBool_FromLong(cmp == 0);
+PyDoc_STRVAR(array_arrow_c_schema__doc__, "");
+static PyObject *array_arrow_c_schema(PyObject *self, PyObject *args) {
+    return _arrow_schema_new("U");
 }
 
-PyDoc_STRVAR(swapcase__doc__, "");
-PyObject *cstring_swapcase(PyObject *self, PyObject *args) {
-    struct cstring *new = CSTRING_ALLOC(Py_TYPE(self), Py_SIZE(self));
-    if(!new)
+PyDoc_STRVAR(array_arrow_c_array__doc__, "");
+static PyObject *array_arrow_c_array(PyObject *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    static const char *const kwlist[] = {"requested_schema", NULL};
+    PyObject *argv[1];
+    if(_parse_args("__arrow_c_array__", args, nargs, kwnames, kwlist, 0, argv) < 0)
         return NULL;
-    const char *s = CSTRING_VALUE(self);
-    char *d = CSTRING_VALUE(new);
+    PyObject *requested = argv[0] ? argv[0] : Py_None;
 
-    for(;*s; ++s, ++d) {
-        if(islower(*s)) {
-            *d = toupper(*s);
-        } else if(isupper(*s)) {
-            *d = tolower(*s);
-        } else {
-            *d = *s;
+    struct array *array = (struct array *)self;
+    const char *format = "U";
+    if(requested != Py_None) {
+        struct ArrowSchema *schema = PyCapsule_GetPointer(requested, "arrow_schema");
+        if(!schema)
+            return NULL;
+        if(strcmp(schema->format, "u") == 0) {
+            if(ARRAY_NBYTES(array) > INT32_MAX) {
+                PyErr_SetString(PyExc_ValueError, "Array data is too large for 32-bit offsets");
+                return NULL;
+            }
+            format = "u";
+        } else if(strcmp(schema->format, "U") != 0) {
+            PyErr_Format(PyExc_ValueError, "cannot export an Array as Arrow format '%s'", schema->format);
+            return NULL;
         }
     }
 
-    return (PyObject *)new;
+    struct _arrow_export *export = PyMem_RawCalloc(1, sizeof(*export));
+    struct ArrowArray *out = PyMem_Malloc(sizeof(*out));
+    if(!export || !out)
+        goto nomemory;
+    export->buffers[0] = NULL;
+    export->buffers[1] = array->offsets;
+    export->buffers[2] = CSTRING_VALUE(array->data);
+    if(*format == 'u') {
+        export->offsets32 = PyMem_RawMalloc((array->count + 1) * sizeof(int32_t));
+        if(!export->offsets32)
+            goto nomemory;
+        for(Py_ssize_t i = 0; i <= array->count; ++i)
+            export->offsets32[i] = (int32_t)(array->offsets[i] - array->offsets[0]);
+        export->buffers[1] = export->offsets32;
+        export->buffers[2] = ARRAY_VALUE(array, 0);
+    }
+    Py_INCREF(self);
+    export->owner = self;
+    *out = (struct ArrowArray){
+        .length = array->count,
+        .null_count = 0,
+        .offset = 0,
+        .n_buffers = 3,
+        .buffers = export->buffers,
+        .release = _arrow_array_release,
+        .private_data = export,
+    };
+
+    PyObject *array_capsule = PyCapsule_New(out, "arrow_array", _arrow_array_capsule_free);
+    if(!array_capsule) {
+        out->release(out);
+        PyMem_Free(out);
+        return NULL;
+    }
+    PyObject *schema_capsule = _arrow_schema_new(format);
+    if(!schema_capsule) {
+        Py_DECREF(array_capsule);
+        return NULL;
+    }
+    return _tuple_steal_refs(2, schema_capsule, array_capsule);
+
+nomemory:
+    if(export)
+        PyMem_RawFree(export->offsets32);
+    PyMem_RawFree(export);
+    PyMem_Free(out);
+    return PyErr_NoMemory();
 }
 
-PyDoc_STRVAR(upper__doc__, "");
-PyObject *cstring_upper(PyObject *self, PyObject *args) {
-    struct cstring *new = CSTRING_ALLOC(Py_TYPE(self), Py_SIZE(self));
-    if(!new)
+/* Whether items [offset, offset + length) of an Arrow array are all valid. */
+static int _arrow_no_nulls(const struct ArrowArray *array) {
+    const uint8_t *bitmap = array->buffers[0];
+    if(array->null_count == 0 || !bitmap)
+        return 1;
+    for(int64_t i = array->offset; i < array->offset + array->length; ++i) {
+        if(!(bitmap[i / 8] & (1 << (i % 8))))
+            return 0;
+    }
+    return 1;
+}
+
+PyDoc_STRVAR(array_from_arrow__doc__, "");
+static PyObject *array_from_arrow(PyObject *cls, PyObject *arg) {
+    PyObject *capsules = PyObject_CallMethod(arg, "__arrow_c_array__", NULL);
+    if(!capsules)
         return NULL;
-    const char *s = CSTRING_VALUE(self);
-    char *d = CSTRING_VALUE(new);
+    if(!PyTuple_Check(capsules) || PyTuple_GET_SIZE(capsules) != 2) {
+        Py_DECREF(capsules);
+        PyErr_SetString(PyExc_TypeError, "__arrow_c_array__ must return a (schema, array) tuple of capsules");
+        return NULL;
+    }
 
-    while((*d++ = toupper(*s++)) != '\0')
-        ;
+    PyObject *result = NULL;
+    PyObject *owner = NULL;
+    struct ArrowArray *moved = NULL;
+    struct ArrowSchema *schema = PyCapsule_GetPointer(PyTuple_GET_ITEM(capsules, 0), "arrow_schema");
+    struct ArrowArray *array = PyCapsule_GetPointer(PyTuple_GET_ITEM(capsules, 1), "arrow_array");
+    if(!schema || !array)
+        goto done;
+
+    int wide = strcmp(schema->format, "U") == 0 || strcmp(schema->format, "Z") == 0;
+    if(!wide && strcmp(schema->format, "u") != 0 && strcmp(schema->format, "z") != 0) {
+        PyErr_Format(PyExc_TypeError, "expected an Arrow string or binary array, not format '%s'", schema->format);
+        goto done;
+    }
+    if(!array->release) {
+        PyErr_SetString(PyExc_ValueError, "Arrow array was already released");
+        goto done;
+    }
+    if(array->n_buffers != 3 || array->length < 0 || array->offset < 0
+            || array->length > PY_SSIZE_T_MAX / (Py_ssize_t)sizeof(int64_t) - 1) {
+        PyErr_SetString(PyExc_ValueError, "malformed Arrow string array");
+        goto done;
+    }
+    if(!_arrow_no_nulls(array)) {
+        PyErr_SetString(PyExc_ValueError, "Arrow array has nulls, which an Array cannot hold");
+        goto done;
+    }
 
-    return (PyObject *)new;
+    /* take ownership: the buffers are released when the last user of them
+     * (the Array, its slices and views of its data) is gone */
+    if(!(moved = PyMem_Malloc(sizeof(*moved)))) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    *moved = *array;
+    array->release = NULL;
+    owner = PyCapsule_New(moved, "cstring.arrow_array", _arrow_array_capsule_free);
+    if(!owner) {
+        moved->release(moved);
+        PyMem_Free(moved);
+        goto done;
+    }
+
+    Py_ssize_t count = (Py_ssize_t)moved->length;
+    const void *offsetbuf = moved->buffers[1];
+    const char *databuf = moved->buffers[2];
+    int64_t *offsets;
+    int shared = 0;
+    if(count == 0 && !offsetbuf) {
+        offsets = PyMem_Calloc(1, sizeof(int64_t));
+    } else if(!offsetbuf) {
+        PyErr_SetString(PyExc_ValueError, "malformed Arrow string array");
+        goto done;
+    } else if(wide && (uintptr_t)offsetbuf % sizeof(int64_t) == 0) {
+        offsets = (int64_t *)offsetbuf + moved->offset;
+        shared = 1;
+    } else if(wide) {
+        if((offsets = PyMem_New(int64_t, count + 1)) != NULL)
+            memcpy(offsets, (const int64_t *)offsetbuf + moved->offset, (count + 1) * sizeof(int64_t));
+    } else {
+        if((offsets = PyMem_New(int64_t, count + 1)) != NULL) {
+            const char *p = (const char *)offsetbuf + moved->offset * sizeof(int32_t);
+            for(Py_ssize_t i = 0; i <= count; ++i) {
+                int32_t offset;
+                memcpy(&offset, p + i * sizeof(int32_t), sizeof(int32_t));
+                offsets[i] = offset;
+            }
+        }
+    }
+    if(!offsets) {
+        PyErr_NoMemory();
+        goto done;
+    }
+
+    int ok = offsets[0] >= 0 && (databuf || offsets[count] == 0);
+    for(Py_ssize_t i = 0; ok && i < count; ++i)
+        ok = offsets[i] <= offsets[i + 1];
+    PyObject *data = NULL;
+    if(!ok)
+        PyErr_SetString(PyExc_ValueError, "malformed Arrow string array");
+    else if(offsets[count] > PY_SSIZE_T_MAX - 1)
+        PyErr_NoMemory();
+    else
+        data = _cstring_view_alloc(owner, databuf, (Py_ssize_t)offsets[count]);
+    if(!data) {
+        if(!shared)
+            PyMem_Free(offsets);
+        goto done;
+    }
+    result = _array_new((PyTypeObject *)cls, data, offsets, count, shared ? owner : NULL);
+    Py_DECREF(data);
+
+done:
+    if(owner) {
+        /* releasing may call back into Python */
+        PyObject *type, *value, *traceback;
+        PyErr_Fetch(&type, &value, &traceback);
+        Py_DECREF(owner);
+        PyErr_Restore(type, value, traceback);
+    }
+    Py_DECREF(capsules);
+    return result;
 }
 
-static PySequenceMethods cstring_as_sequence = {
-    .sq_length = cstring_len,
-    .sq_concat = cstring_concat,
-    .sq_repeat = cstring_repeat,
-    .sq_item = cstring_item,
-    .sq_contains = cstring_contains,
+static PySequenceMethods array_as_sequence = {
+    .sq_length = array_len,
+    .sq_item = array_item,
 };
 
-static PyMappingMethods cstring_as_mapping = {
-    .mp_length = cstring_len,
-    .mp_subscript = cstring_subscript,
+static PyMappingMethods array_as_mapping = {
+    .mp_length = array_len,
+    .mp_subscript = array_subscript,
 };
 
-static PyMethodDef cstring_methods[] = {
-    /* TODO: capitalize */
-    /* TODO: casefold */
-    /* TODO: center */
-    {"count", cstring_count, METH_VARARGS, count__doc__},
-    /* TODO: encode (decode???) */
-    {"endswith", cstring_endswith, METH_VARARGS, endswith__doc__},
-    /* TODO: expandtabs */
-    {"find", cstring_find, METH_VARARGS, find__doc__},
-    /* TODO: format */
-    /* TODO: format_map */
-    {"index", cstring_index, METH_VARARGS, index__doc__},
-    {"isalnum", cstring_isalnum, METH_NOARGS, isalnum__doc__},
-    {"isalpha", cstring_isalpha, METH_NOARGS, isalpha__doc__},
-    /* TODO: isascii */
-    /* TODO: isdecimal */
-    {"isdigit", cstring_isdigit, METH_NOARGS, isdigit__doc__},
-    /* TODO: isidentifier */
-    {"islower", cstring_islower, METH_NOARGS, islower__doc__},
-    /* TODO: isnumeric */
-    {"isprintable", cstring_isprintable, METH_NOARGS, isprintable__doc__},
-    {"isspace", cstring_isspace, METH_NOARGS, isspace__doc__},
-    /* TODO: istitle */
-    {"isupper", cstring_isupper, METH_NOARGS, isupper__doc__},
-    {"join", cstring_join, METH_O, join__doc__},
-    /* TODO: ljust */
-    {"lower", cstring_lower, METH_NOARGS, lower__doc__},
-    {"lstrip", cstring_lstrip, METH_VARARGS, lstrip__doc__},
-    /* TODO: maketrans */
-    {"partition", cstring_partition, METH_O, partition__doc__},
-    /* TODO: removeprefix */
-    /* TODO: replace */
-    {"rfind", cstring_rfind, METH_VARARGS, rfind__doc__},
-    {"rindex", cstring_rindex, METH_VARARGS, rindex__doc__},
-    /* TODO: rjust */
-    {"rpartition", cstring_rpartition, METH_O, rpartition__doc__},
-    /* TODO: rsplit */
-    {"rstrip", cstring_rstrip, METH_VARARGS, rstrip__doc__},
-    {"split", (PyCFunction)cstring_split, METH_VARARGS | METH_KEYWORDS, split__doc__},
-    /* TODO: splitlines */
-    {"startswith", cstring_startswith, METH_VARARGS, startswith__doc__},
-    {"strip", cstring_strip, METH_VARARGS, strip__doc__},
-    {"swapcase", cstring_swapcase, METH_NOARGS, swapcase__doc__},
-    /* TODO: title */
-    /* TODO: translate */
-    {"upper", cstring_upper, METH_NOARGS, upper__doc__},
-    /* TODO: zfill */
+static PyMethodDef array_methods[] = {
+    {"__arrow_c_array__", (PyCFunction)array_arrow_c_array, METH_FASTCALL | METH_KEYWORDS, array_arrow_c_array__doc__},
+    {"__arrow_c_schema__", array_arrow_c_schema, METH_NOARGS, array_arrow_c_schema__doc__},
+    {"find", array_find, METH_O, array_find__doc__},
+    {"from_arrow", array_from_arrow, METH_CLASS | METH_O, array_from_arrow__doc__},
+    {"from_buffers", (PyCFunction)array_from_buffers, METH_CLASS | METH_FASTCALL | METH_KEYWORDS, array_from_buffers__doc__},
+    {"lengths", array_lengths, METH_NOARGS, array_lengths__doc__},
+    {"lower", array_lower, METH_NOARGS, array_lower__doc__},
+    {"startswith", array_startswith, METH_O, array_startswith__doc__},
     {0},
 };
 
-static PyTypeObject cstring_type = {
+static PyMemberDef array_members[] = {
+    {"data", T_OBJECT_EX, offsetof(struct array, data), READONLY, ""},
+    {0},
+};
+
+static PyGetSetDef array_getset[] = {
+    {"offsets", array_get_offsets, NULL, "", NULL},
+    {0},
+};
+
+static PyTypeObject array_type = {
     PyVarObject_HEAD_INIT(NULL, 0)
-    .tp_name = "cstring.cstring",
+    .tp_name = "cstring.Array",
     .tp_doc = "",
-    .tp_basicsize = sizeof(struct cstring),
-    .tp_itemsize = sizeof(char),
+    .tp_basicsize = sizeof(struct array),
     .tp_flags = Py_TPFLAGS_DEFAULT,
-    .tp_new = cstring_new,
-    .tp_dealloc = cstring_dealloc,
-    .tp_richcompare = cstring_richcompare,
-    .tp_str = cstring_str,
-    .tp_repr = cstring_repr,
-    .tp_hash = cstring_hash,
-    .tp_as_sequence = &cstring_as_sequence,
-    .tp_as_mapping = &cstring_as_mapping,
-    .tp_methods = cstring_methods,
+    .tp_new = array_new,
+    .tp_dealloc = array_dealloc,
+    .tp_repr = array_repr,
+    .tp_richcompare = array_richcompare,
+    .tp_as_sequence = &array_as_sequence,
+    .tp_as_mapping = &array_as_mapping,
+    .tp_methods = array_methods,
+    .tp_members = array_members,
+    .tp_getset = array_getset,
+};
+
+static PyMethodDef module_methods[] = {
+    {"_reset_stats", cstring__reset_stats, METH_NOARGS, _reset_stats__doc__},
+    {"_stats", cstring__stats, METH_NOARGS, _stats__doc__},
+    {"freelist_lengths", cstring_freelist_lengths, METH_NOARGS, freelist_lengths__doc__},
+    {"readlines", (PyCFunction)cstring_readlines, METH_FASTCALL | METH_KEYWORDS, readlines__doc__},
+    {"set_threads", (PyCFunction)cstring_set_threads, METH_FASTCALL, set_threads__doc__},
+    {"use_str_hash", (PyCFunction)cstring_use_str_hash, METH_FASTCALL, use_str_hash__doc__},
+    {0},
 };
 
 static struct PyModuleDef module = {
@@ -951,14 +6501,62 @@ static struct PyModuleDef module = {
     .m_name = "cstring",
     .m_doc = "",
     .m_size = 0,
-    .m_methods = NULL,
+    .m_methods = module_methods,
 };
 
 PyMODINIT_FUNC PyInit_cstring(void) {
+    _cpu_init_dispatch();
+    if(_pool_init() < 0)
+        return NULL;
     if(PyType_Ready(&cstring_type) < 0)
         return NULL;
+    if(PyType_Ready(&cstring_iter_type) < 0)
+        return NULL;
+    if(PyType_Ready(&splititer_type) < 0)
+        return NULL;
+    if(PyType_Ready(&builder_type) < 0)
+        return NULL;
+    if(PyType_Ready(&finder_type) < 0)
+        return NULL;
+    if(PyType_Ready(&finditer_type) < 0)
+        return NULL;
+    if(PyType_Ready(&multifinder_type) < 0)
+        return NULL;
+    if(PyType_Ready(&multifinditer_type) < 0)
+        return NULL;
+    if(PyType_Ready(&lineiter_type) < 0)
+        return NULL;
+    if(PyType_Ready(&array_type) < 0)
+        return NULL;
+    if(PyType_Ready(&translation_type) < 0)
+        return NULL;
+
+    /* shared state is created up front, so threads never race to create it */
+    if(!(cstring_CHAR_INDEXES = PyDict_New()) || !(cstring_INTERNED = PyDict_New()))
+        return NULL;
+    PyObject *singleton = cstring_new_empty();
+    if(!singleton)
+        return NULL;
+    Py_DECREF(singleton);
+    for(int c = 0; c < 256; ++c) {
+        if(!(singleton = cstring_new_byte((char)c)))
+            return NULL;
+        Py_DECREF(singleton);
+    }
+
     Py_INCREF(&cstring_type);
+    Py_INCREF(&builder_type);
+    Py_INCREF(&finder_type);
+    Py_INCREF(&multifinder_type);
+    Py_INCREF(&array_type);
     PyObject *m = PyModule_Create(&module);
     PyModule_AddObject(m, "cstring", (PyObject *)&cstring_type);
+    PyModule_AddObject(m, "Builder", (PyObject *)&builder_type);
+    PyModule_AddObject(m, "Finder", (PyObject *)&finder_type);
+    PyModule_AddObject(m, "MultiFinder", (PyObject *)&multifinder_type);
+    PyModule_AddObject(m, "Array", (PyObject *)&array_type);
+#ifdef Py_GIL_DISABLED
+    PyUnstable_Module_SetGIL(m, Py_MOD_GIL_NOT_USED);
+#endif
     return m;
 }
@@ -0,0 +1,139 @@
+import array
+import gc
+import pytest
+from cstring import cstring, Array
+
+WORDS = ['Hello', 'wörld', '', 'x', 'ABC', 'hello there']
+
+
+def test_array():
+    target = Array(WORDS)
+    assert len(target) == len(WORDS)
+    assert list(target) == [cstring(w) for w in WORDS]
+    assert all(isinstance(item, cstring) for item in target)
+    assert target[1] == cstring('wörld')
+    assert target[-1] == cstring('hello there')
+    with pytest.raises(IndexError):
+        target[len(WORDS)]
+
+
+def test_array_mixed_items():
+    target = Array([cstring('a'), 'b', b'c', bytearray(b'dd'), memoryview(b'eee')])
+    assert list(target) == [cstring(s) for s in ('a', 'b', 'c', 'dd', 'eee')]
+    with pytest.raises(TypeError):
+        Array(['a', 1])
+
+
+def test_array_bytearray_items():
+    items = [bytearray(b'ab'), bytearray(b'c')]
+    assert list(Array(items)) == [cstring('ab'), cstring('c')]
+    # the buffers are released, so the items can be resized again
+    items[0].extend(b'yz')
+    with pytest.raises(TypeError):
+        Array([items[1], 1])
+    items[1].extend(b'd')
+    assert items == [b'abyz', b'cd']
+
+
+def test_array_empty():
+    target = Array()
+    assert len(target) == 0
+    assert list(target) == []
+    assert target.lengths().tolist() == []
+    assert list(Array(['', ''])) == [cstring(''), cstring('')]
+
+
+def test_array_layout():
+    target = Array(['ab', '', 'cde'])
+    assert target.data == cstring('abcde')
+    assert target.offsets.tolist() == [0, 2, 2, 5]
+
+
+def test_array_items_are_views():
+    target = Array(['first', 'second'])
+    item = target[1]
+    del target
+    gc.collect()
+    assert item == cstring('second')
+    assert item.materialize() == cstring('second')
+
+
+def test_array_slice():
+    target = Array(WORDS)
+    assert list(target[1:4]) == [cstring(w) for w in WORDS[1:4]]
+    assert list(target[::2]) == [cstring(w) for w in WORDS[::2]]
+    assert list(target[::-1]) == [cstring(w) for w in WORDS[::-1]]
+    part = target[2:]
+    del target
+    gc.collect()
+    assert list(part) == [cstring(w) for w in WORDS[2:]]
+    assert list(part[1:3]) == [cstring(w) for w in WORDS[3:5]]
+
+
+def test_array_from_buffers():
+    target = Array.from_buffers(b'abcdef', array.array('q', [0, 2, 2, 6]))
+    assert list(target) == [cstring('ab'), cstring(''), cstring('cdef')]
+    data = cstring('abcdef')
+    assert Array.from_buffers(data, array.array('q', [1, 3])).data is data
+    assert list(Array.from_buffers(b'', array.array('q', [0]))) == []
+
+
+def test_array_from_buffers_invalid():
+    with pytest.raises(ValueError):
+        Array.from_buffers(b'abc', array.array('q', [0, 4]))
+    with pytest.raises(ValueError):
+        Array.from_buffers(b'abc', array.array('q', [2, 1]))
+    with pytest.raises(ValueError):
+        Array.from_buffers(b'abc', array.array('q', []))
+    with pytest.raises(TypeError):
+        Array.from_buffers(b'abc', array.array('i', [0, 1]))
+
+
+def test_array_find():
+    target = Array(WORDS)
+    assert target.find('l').tolist() == [w.encode().find(b'l') for w in WORDS]
+    assert target.find('llo').tolist() == [w.encode().find(b'llo') for w in WORDS]
+    assert target.find('').tolist() == [0] * len(WORDS)
+    assert target.find('ö').tolist() == [-1, 1, -1, -1, -1, -1]  # byte indexes
+
+
+def test_array_startswith():
+    target = Array(WORDS)
+    assert target.startswith('he').tolist() == [w.startswith('he') for w in WORDS]
+    assert target.startswith(b'').tolist() == [True] * len(WORDS)
+
+
+def test_array_lengths():
+    target = Array(WORDS)
+    assert target.lengths().tolist() == [len(w.encode()) for w in WORDS]
+    assert target.lengths().format == 'q'
+
+
+def test_array_lower():
+    assert list(Array(WORDS).lower()) == [cstring(w.lower()) for w in WORDS]
+    words = ['ABC', 'DEF', 'GHI']
+    assert list(Array(words)[1:].lower()) == [cstring('def'), cstring('ghi')]
+    words = ['ΣΑΣ', 'İx', 'Straße']
+    assert list(Array(words).lower()) == [cstring(w.lower()) for w in words]
+
+
+def test_array_compare():
+    target = Array(WORDS)
+    assert (target == 'x').tolist() == [w == 'x' for w in WORDS]
+    assert (target != b'x').tolist() == [w != 'x' for w in WORDS]
+    assert (target == cstring('ABC')).tolist() == [w == 'ABC' for w in WORDS]
+    assert (target == target.lower()).tolist() == [w == w.lower() for w in WORDS]
+    assert (target == 'x').format == '?'
+    with pytest.raises(ValueError):
+        target == target[1:]
+    assert (target == None) is False
+    with pytest.raises(TypeError):
+        hash(target)
+
+
+def test_array_large():
+    words = ['word%d' % i for i in range(100000)]
+    target = Array(words)
+    assert target.find('99').tolist() == [w.find('99') for w in words]
+    assert sum(target.startswith('word1')) == sum(w.startswith('word1') for w in words)
+    assert list(target.lower()) == [cstring(w) for w in words]
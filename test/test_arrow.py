@@ -0,0 +1,182 @@
+import ctypes
+import gc
+import pytest
+from cstring import cstring, Array
+
+
+class ArrowSchema(ctypes.Structure):
+    pass
+
+
+class ArrowArray(ctypes.Structure):
+    pass
+
+
+ArrowSchema._fields_ = [
+    ('format', ctypes.c_char_p),
+    ('name', ctypes.c_char_p),
+    ('metadata', ctypes.c_char_p),
+    ('flags', ctypes.c_int64),
+    ('n_children', ctypes.c_int64),
+    ('children', ctypes.c_void_p),
+    ('dictionary', ctypes.c_void_p),
+    ('release', ctypes.CFUNCTYPE(None, ctypes.POINTER(ArrowSchema))),
+    ('private_data', ctypes.c_void_p),
+]
+
+ReleaseArray = ctypes.CFUNCTYPE(None, ctypes.POINTER(ArrowArray))
+
+ArrowArray._fields_ = [
+    ('length', ctypes.c_int64),
+    ('null_count', ctypes.c_int64),
+    ('offset', ctypes.c_int64),
+    ('n_buffers', ctypes.c_int64),
+    ('n_children', ctypes.c_int64),
+    ('buffers', ctypes.POINTER(ctypes.c_void_p)),
+    ('children', ctypes.c_void_p),
+    ('dictionary', ctypes.c_void_p),
+    ('release', ReleaseArray),
+    ('private_data', ctypes.c_void_p),
+]
+
+PyCapsule_New = ctypes.pythonapi.PyCapsule_New
+PyCapsule_New.restype = ctypes.py_object
+PyCapsule_New.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_void_p]
+PyCapsule_GetPointer = ctypes.pythonapi.PyCapsule_GetPointer
+PyCapsule_GetPointer.restype = ctypes.c_void_p
+PyCapsule_GetPointer.argtypes = [ctypes.py_object, ctypes.c_char_p]
+
+SCHEMA_NAME = b'arrow_schema'
+ARRAY_NAME = b'arrow_array'
+
+
+class Column:
+    """A hand-built Arrow string array over ctypes buffers."""
+
+    def __init__(self, values, format=b'U', offset=0, validity=None):
+        encoded = [v.encode() for v in values]
+        ends = [0]
+        for v in encoded:
+            ends.append(ends[-1] + len(v))
+        offset_type = ctypes.c_int64 if format in (b'U', b'Z') else ctypes.c_int32
+        self.offsets = (offset_type * len(ends))(*ends)
+        self.data = ctypes.create_string_buffer(b''.join(encoded), ends[-1] or 1)
+        self.validity = validity
+        self.buffers = (ctypes.c_void_p * 3)(
+            ctypes.cast(validity, ctypes.c_void_p) if validity else None,
+            ctypes.addressof(self.offsets), ctypes.addressof(self.data))
+        self.released = 0
+        self.release = ReleaseArray(self._release)
+        self.array = ArrowArray(
+            length=len(values) - offset, null_count=-1 if validity else 0, offset=offset, n_buffers=3,
+            buffers=self.buffers, release=self.release)
+        self.schema = ArrowSchema(format=format, name=b'', release=ArrowSchema._fields_[7][1](lambda s: None))
+
+    def _release(self, array):
+        self.released += 1
+        array.contents.release = ReleaseArray()
+
+    def __arrow_c_array__(self, requested_schema=None):
+        return (PyCapsule_New(ctypes.addressof(self.schema), SCHEMA_NAME, None),
+                PyCapsule_New(ctypes.addressof(self.array), ARRAY_NAME, None))
+
+
+def exported(target, requested_schema=None):
+    schema_capsule, array_capsule = target.__arrow_c_array__(requested_schema)
+    schema = ArrowSchema.from_address(PyCapsule_GetPointer(schema_capsule, SCHEMA_NAME))
+    array = ArrowArray.from_address(PyCapsule_GetPointer(array_capsule, ARRAY_NAME))
+    return schema_capsule, array_capsule, schema, array
+
+
+def test_export():
+    target = Array(['ab', '', 'cde'])
+    capsules = exported(target)
+    schema, array = capsules[2], capsules[3]
+    assert schema.format == b'U'
+    assert (array.length, array.null_count, array.offset, array.n_buffers) == (3, 0, 0, 3)
+    assert array.buffers[0] is None
+    offsets = (ctypes.c_int64 * 4).from_address(array.buffers[1])
+    assert list(offsets) == [0, 2, 2, 5]
+    assert ctypes.string_at(array.buffers[2], 5) == b'abcde'
+    # zero-copy: the buffers are the Array's own
+    assert ctypes.string_at(array.buffers[2], 5) == bytes(target.data)
+
+
+def test_export_keeps_array_alive():
+    capsules = exported(Array(['first', 'second'])[1:])
+    gc.collect()
+    schema, array = capsules[2], capsules[3]
+    offsets = (ctypes.c_int64 * 2).from_address(array.buffers[1])
+    assert ctypes.string_at(array.buffers[2] + offsets[0], offsets[1] - offsets[0]) == b'second'
+    array.release(ctypes.byref(array))
+    assert not array.release
+
+
+def test_export_schema():
+    capsule = Array().__arrow_c_schema__()
+    assert ArrowSchema.from_address(PyCapsule_GetPointer(capsule, SCHEMA_NAME)).format == b'U'
+
+
+def test_export_requested_utf8():
+    target = Array(['x', 'ab', 'cde'])[1:]
+    request = Column([], format=b'u').__arrow_c_array__()[0]
+    capsules = exported(target, request)
+    schema, array = capsules[2], capsules[3]
+    assert schema.format == b'u'
+    assert list((ctypes.c_int32 * 3).from_address(array.buffers[1])) == [0, 2, 5]
+    assert ctypes.string_at(array.buffers[2], 5) == b'abcde'
+    with pytest.raises(ValueError):
+        target.__arrow_c_array__(Column([], format=b'i').__arrow_c_array__()[0])
+
+
+def test_import():
+    column = Column(['héllo', '', 'world'])
+    target = Array.from_arrow(column)
+    assert list(target) == [cstring('héllo'), cstring(''), cstring('world')]
+    assert target.offsets.tolist() == [0, 6, 6, 11]
+    # zero-copy: the data is read in place
+    column.data[6] = b'W'
+    assert target[2] == cstring('World')
+    assert column.released == 0
+    item = target[0]
+    del target
+    gc.collect()
+    assert column.released == 0
+    del item
+    gc.collect()
+    assert column.released == 1
+
+
+def test_import_utf8_and_offset():
+    column = Column(['skip', 'ab', 'cd'], format=b'u', offset=1)
+    target = Array.from_arrow(column)
+    assert list(target) == [cstring('ab'), cstring('cd')]
+    del target
+    gc.collect()
+    assert column.released == 1
+
+
+def test_import_roundtrip():
+    source = Array(['a', 'bb', 'ccc'])
+    target = Array.from_arrow(source)
+    assert list(target) == list(source)
+    assert (target == source).tolist() == [True] * 3
+
+
+def test_import_nulls():
+    valid = (ctypes.c_uint8 * 1)(0b011)
+    with pytest.raises(ValueError):
+        Array.from_arrow(Column(['a', 'b', 'c'], validity=valid))
+    valid = (ctypes.c_uint8 * 1)(0b111)
+    assert list(Array.from_arrow(Column(['a', 'b', 'c'], validity=valid))) == [cstring(c) for c in 'abc']
+
+
+def test_import_invalid():
+    with pytest.raises(TypeError):
+        Array.from_arrow(Column(['a'], format=b'i'))
+    with pytest.raises(AttributeError):
+        Array.from_arrow(['a'])
+    column = Column(['a'])
+    column.offsets[1] = -1
+    with pytest.raises(ValueError):
+        Array.from_arrow(column)
@@ -0,0 +1,32 @@
+import hashlib
+import pytest
+from cstring import cstring
+
+
+def test_memoryview():
+    target = cstring('hello, world')
+    view = memoryview(target)
+    assert view.readonly
+    assert view.nbytes == 12
+    assert view.tobytes() == b'hello, world'
+
+
+def test_memoryview_readonly():
+    view = memoryview(cstring('hello'))
+    with pytest.raises(TypeError):
+        view[0] = ord('j')
+
+
+def test_memoryview_keeps_object_alive():
+    view = memoryview(cstring('hello') * 2)
+    assert view.tobytes() == b'hellohello'
+    assert isinstance(view.obj, cstring)
+
+
+def test_bytes():
+    assert bytes(cstring('🙂 hello')) == '🙂 hello'.encode('utf8')
+
+
+def test_hashlib():
+    target = cstring('hello, world')
+    assert hashlib.sha256(target).digest() == hashlib.sha256(b'hello, world').digest()
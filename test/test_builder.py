@@ -0,0 +1,75 @@
+import pytest
+from cstring import cstring, Builder
+
+
+def test_append():
+    builder = Builder()
+    builder.append('hello')
+    builder.append(b', ')
+    builder.append(cstring('world'))
+    assert builder.freeze() == cstring('hello, world')
+
+
+def test_extend():
+    builder = Builder()
+    builder.extend(['a', bytearray(b'b'), memoryview(b'c')])
+    assert builder.freeze() == cstring('abc')
+
+
+def test_write():
+    builder = Builder()
+    assert builder.write('héllo') == 6
+    assert len(builder) == 6
+
+
+def test_len():
+    builder = Builder(capacity=100)
+    assert len(builder) == 0
+    builder.append('abc')
+    assert len(builder) == 3
+
+
+def test_reserve():
+    builder = Builder()
+    builder.reserve(1000)
+    builder.append('abc')
+    assert builder.freeze() == cstring('abc')
+
+
+def test_reserve_negative():
+    with pytest.raises(ValueError):
+        Builder().reserve(-1)
+
+
+def test_grow():
+    builder = Builder()
+    for i in range(10000):
+        builder.append(str(i))
+    assert builder.freeze() == cstring(''.join(str(i) for i in range(10000)))
+
+
+def test_freeze_resets():
+    builder = Builder()
+    builder.append('abc')
+    first = builder.freeze()
+    assert len(builder) == 0
+    builder.append('def')
+    assert builder.freeze() == cstring('def')
+    assert first == cstring('abc')
+
+
+def test_freeze_empty():
+    assert Builder().freeze() == cstring('')
+
+
+def test_freeze_metadata():
+    builder = Builder()
+    builder.extend(['abc', cstring('déf')])
+    result = builder.freeze()
+    assert not result.isascii()
+    assert result.char_len() == 6
+
+
+def test_bad_type():
+    with pytest.raises(TypeError):
+        Builder().append(1)
@@ -0,0 +1,62 @@
+import pytest
+from cstring import cstring
+
+
+def test_iter():
+    target = cstring('héllo, 世界')
+    assert [str(c) for c in target] == list('héllo, 世界')
+
+
+def test_iter_items_are_cstrings():
+    assert list(cstring('aé')) == [cstring('a'), cstring('é')]
+
+
+def test_iter_ascii_cached():
+    first, second = cstring('aa')
+    assert first is second
+
+
+def test_iter_invalid():
+    with pytest.raises(UnicodeDecodeError):
+        iter(cstring(b'a\xffb', errors='trust'))
+
+
+def test_char_len():
+    assert cstring('héllo').char_len() == 5
+    assert cstring('').char_len() == 0
+
+
+def test_char_at():
+    target = cstring('héllo, 世界')
+    assert target.char_at(1) == cstring('é')
+    assert target.char_at(-1) == cstring('界')
+
+
+def test_char_at_out_of_range():
+    with pytest.raises(IndexError):
+        cstring('héllo').char_at(5)
+
+
+def test_char_at_long():
+    text = ''.join(chr(0x400 + i % 200) for i in range(5000))
+    target = cstring(text)
+    for i in (0, 63, 64, 65, 1000, 4999):
+        assert str(target.char_at(i)) == text[i]
+
+
+def test_char_slice():
+    target = cstring('héllo, 世界')
+    assert target.char_slice(1, 4) == cstring('éll')
+    assert target.char_slice(-2) == cstring('世界')
+    assert target.char_slice(4, 1) == cstring('')
+
+
+def test_char_slice_long():
+    text = 'aé世😀' * 1000
+    target = cstring(text)
+    assert str(target.char_slice(1234, 3210)) == text[1234:3210]
+
+
+def test_char_slice_of_view():
+    target = cstring('xxhéllo').view(2)
+    assert target.char_slice(1, 3) == cstring('él')
@@ -1,6 +1,17 @@
 from cstring import cstring
 
 
+def _run_fresh(code):
+    # use_str_hash can only change before text is hashed, so tests of it
+    # run in a fresh interpreter
+    import os
+    import subprocess
+    import sys
+    import cstring as module
+    env = dict(os.environ, PYTHONPATH=os.path.dirname(module.__file__))
+    subprocess.run([sys.executable, '-c', code], env=env, check=True)
+
+
 def test_eq():
     a = cstring('hello')
     b = cstring('hello')
@@ -35,3 +46,109 @@ def test_ge():
     assert cstring('a') >= cstring('a')
     assert cstring('b') >= cstring('a')
 
+
+
+def test_eq_same_object():
+    a = cstring('hello')
+    assert a == a
+    assert not a != a
+
+
+def test_eq_cached_hashes():
+    a = cstring('hello')
+    b = cstring('hellp')
+    hash(a), hash(b)
+    assert a != b
+    assert a == cstring('hello')
+
+
+def test_intern():
+    a = cstring('example.com').intern()
+    b = cstring('example.com').intern()
+    assert a is b
+    assert a == cstring('example.com')
+    assert a != cstring('example.org').intern()
+
+
+def test_intern_hash_mode():
+    # interning doesn't hash with cstring_hash, so the mode can still change
+    _run_fresh(
+        'import cstring as module\n'
+        'a = module.cstring("h\u00e9llo w\u00f6rld").intern()\n'
+        'module.use_str_hash(True)\n'
+        'b = module.cstring("h\u00e9llo w\u00f6rld").intern()\n'
+        'assert a is b and a == b\n'
+    )
+
+
+def test_intern_returns_self():
+    a = cstring('interned-once')
+    assert a.intern() is a
+    assert a.intern() is a
+
+
+def test_intern_view():
+    v = cstring('xxhostxx').view(2, 6)
+    interned = v.intern()
+    assert interned == cstring('host')
+    assert interned is cstring('host').intern()
+    assert interned.materialize() is interned
+
+
+def test_compare_str():
+    assert cstring('hello') == 'hello'
+    assert 'hello' == cstring('hello')
+    assert cstring('hello') != 'world'
+    assert cstring('héllo') == 'héllo'
+    assert cstring('中文') != '中字'
+    assert cstring('a') < 'b'
+    assert cstring('é') > 'z'
+    assert cstring('😀') > '￿'
+
+
+def test_compare_bytes():
+    assert cstring('hello') == b'hello'
+    assert cstring('hello') == bytearray(b'hello')
+    assert cstring('hello') != b'hell'
+    assert cstring('a') < b'b'
+
+
+def test_compare_other():
+    assert cstring('1') != 1
+    assert not cstring('1') == 1
+
+
+def test_str_hash():
+    _run_fresh(
+        'import cstring as module\n'
+        'from cstring import cstring\n'
+        'keys = {"abc": 1, "h\u00e9llo": 2, "\U0001f600": 3}\n'
+        'assert module.use_str_hash(True) is False\n'
+        'for key, value in keys.items():\n'
+        '    assert hash(cstring(key)) == hash(key)\n'
+        '    assert keys[cstring(key)] == value\n'
+        'assert module.use_str_hash(True) is True\n'
+    )
+
+
+def test_str_hash_locked():
+    _run_fresh(
+        'import cstring as module\n'
+        'from cstring import cstring\n'
+        'module.use_str_hash(False)\n'
+        'hash(cstring("abc"))\n'
+        'assert module.use_str_hash(True) is False\n'
+        'assert module.use_str_hash(False) is True\n'
+        'd = {cstring("h\u00e9llo"): 1}\n'
+        'try:\n'
+        '    module.use_str_hash(True)\n'
+        'except RuntimeError:\n'
+        '    pass\n'
+        'else:\n'
+        '    raise AssertionError("mode changed after hashing")\n'
+        'assert cstring("h\u00e9llo") in d\n'
+    )
+
+
+def test_str_hash_ascii_default():
+    assert hash(cstring('abc')) == hash('abc')
@@ -0,0 +1,64 @@
+import pytest
+from cstring import cstring, Finder
+
+
+def test_pattern():
+    assert Finder('lo').pattern == cstring('lo')
+
+
+def test_find():
+    finder = Finder('lo')
+    assert finder.find(cstring('hello')) == 3
+    assert finder.find('hello') == 3
+    assert finder.find(b'hello') == 3
+    assert finder.find(bytearray(b'hello')) == 3
+    assert finder.find(cstring('world')) == -1
+
+
+def test_find_start_end():
+    finder = Finder(cstring('lo'))
+    assert finder.find(cstring('hello, hello'), 4) == 10
+    assert finder.find(cstring('hello, hello'), 0, 4) == -1
+
+
+def test_rfind():
+    finder = Finder('lo')
+    assert finder.rfind(cstring('hello, hello')) == 10
+    assert finder.rfind(cstring('hello, hello'), 0, 9) == 3
+
+
+def test_count():
+    finder = Finder('🙂')
+    assert finder.count(cstring('🙂 🙃 🙂 🙂 🙃 🙂 🙂')) == 5
+    assert finder.count(b'') == 0
+
+
+def test_finditer():
+    finder = Finder('ab')
+    assert list(finder.finditer(cstring('abxabab'))) == [0, 3, 5]
+    assert list(finder.finditer(cstring('abxabab'), 1)) == [3, 5]
+    assert list(finder.finditer('xyz')) == []
+
+
+def test_finditer_empty_pattern():
+    assert list(Finder('').finditer('abc')) == [0, 1, 2, 3]
+
+
+def test_split():
+    finder = Finder(', ')
+    assert finder.split(cstring('a, b, c')) == [cstring('a'), cstring('b'), cstring('c')]
+    assert finder.split(b'a, b, c', maxsplit=1) == [cstring('a'), cstring('b, c')]
+
+
+def test_split_empty_pattern():
+    with pytest.raises(ValueError):
+        Finder('').split('abc')
+
+
+def test_long_pattern():
+    pattern = 'abcdefghij' * 10
+    finder = Finder(pattern)
+    text = cstring('x' * 1000 + pattern + 'x' * 1000 + pattern)
+    assert finder.find(text) == 1000
+    assert finder.rfind(text) == 2100
+    assert finder.count(text) == 2
@@ -144,6 +144,41 @@ def test_join():
     assert sep.join(items) == cstring('hello, world')
 
 
+def test_join_mixed_types():
+    sep = cstring('-')
+    items = ['a', b'b', bytearray(b'c'), memoryview(b'd'), cstring('e')]
+    assert sep.join(items) == cstring('a-b-c-d-e')
+
+
+def test_join_iterator():
+    sep = cstring(', ')
+    assert sep.join(str(i) for i in range(3)) == cstring('0, 1, 2')
+
+
+def test_join_empty():
+    assert cstring(', ').join([]) == cstring('')
+    assert cstring(', ').join(iter([])) == cstring('')
+
+
+def test_join_bad_item():
+    import pytest
+    with pytest.raises(TypeError):
+        cstring(', ').join(['a', 1])
+
+
+def test_join_bytearray():
+    import pytest
+    items = [bytearray(b'x%d' % i) for i in range(20)]
+    assert cstring(',').join(items) == cstring(','.join('x%d' % i for i in range(20)))
+    # the buffers are released, so the items can be resized again
+    items[0].extend(b'yz')
+    item = bytearray(b'b')
+    with pytest.raises(TypeError):
+        cstring(', ').join(['a', item, 1])
+    item.extend(b'c')
+    assert item == b'bc'
+
+
 def test_lower():
     target = cstring('HELLO123')
     assert target.lower() == cstring('hello123')
@@ -300,3 +335,262 @@ def test_swapcase():
     target = cstring('hElLo, WoRlD 123')
     assert target.swapcase() == cstring('HeLlO, wOrLd 123')
 
+
+
+def test_count_empty():
+    assert cstring('hello').count('') == 6
+
+
+def test_split_leading_whitespace():
+    assert cstring('  a b  ').split() == [cstring('a'), cstring('b')]
+    assert cstring(' 1 ').split(maxsplit=1) == [cstring('1')]
+    assert cstring('   ').split() == []
+
+
+def test_split_empty_separator():
+    with pytest.raises(ValueError):
+        cstring('hello').split(cstring(''))
+
+
+def test_strip_all():
+    assert cstring('   ').strip() == cstring('')
+
+
+def test_find_long():
+    target = cstring('x' * 1000 + 'needle' + 'x' * 1000)
+    assert target.find('needle') == 1000
+    assert target.find('needle', 0, 1005) == -1
+    assert target.rfind('needle') == 1000
+    assert target.rfind('needle', 1001) == -1
+
+
+def test_find_start_past_end():
+    target = cstring('hello')
+    assert target.find('', 6) == -1
+    assert target.count('', 6) == 0
+    assert target.startswith('', 6) is False
+
+
+def test_count_end_bound():
+    target = cstring('ab' * 1000)
+    assert target.count('ab', 0, 101) == 50
+    assert target.count('b', 0, 101) == 50
+
+
+def test_search_periodic():
+    target = cstring('a' * 100000 + 'b')
+    needle = 'a' * 100 + 'b'
+    assert target.find(needle) == 99900
+    assert target.rfind(needle) == 99900
+    assert target.count(needle) == 1
+    assert target.find('a' * 99 + 'c') == -1
+    assert cstring('b' + 'a' * 100000).rfind('b' + 'a' * 100) == 0
+
+
+def test_capitalize():
+    target = cstring('hELLO wORLD')
+    assert target.capitalize() == cstring('Hello world')
+
+
+def test_casefold():
+    target = cstring('HeLLo Straße')
+    assert target.casefold() == cstring('hello strasse')
+
+
+def test_title():
+    target = cstring("hello wORLD they're 3rd")
+    assert target.title() == cstring("Hello World They'Re 3Rd")
+
+
+def test_case_long_ascii():
+    target = cstring('Hello, World! ' * 100)
+    assert target.lower() == cstring('hello, world! ' * 100)
+    assert target.upper() == cstring('HELLO, WORLD! ' * 100)
+    assert target.swapcase() == cstring('hELLO, wORLD! ' * 100)
+
+
+def test_case_non_ascii():
+    assert cstring('àbçΣ').upper() == cstring('ÀBÇΣ')
+    assert cstring('ÀBÇ').lower() == cstring('àbç')
+    assert cstring('straße').upper() == cstring('STRASSE')
+    assert cstring('ÉCOLE').capitalize() == cstring('École')
+
+
+def test_lower_final_sigma():
+    assert cstring('ΟΔΟΣ ΟΔΟΣ').lower() == cstring('οδος οδος')
+
+
+def test_isascii():
+    assert cstring('hello').isascii()
+    assert cstring('').isascii()
+    assert not cstring('héllo').isascii()
+    assert cstring('héllo')[3:].isascii()
+    assert not cstring('héllo')[2:].isascii()
+    assert cstring('a' * 100 + 'é')[:100].isascii()
+    assert cstring(b'hello', errors='trust').isascii()
+
+
+def test_is_non_ascii():
+    assert cstring('héllo').isalpha()
+    assert cstring('Ωmega').isupper() is False
+    assert cstring('ωmega').islower()
+    assert cstring('٣').isdigit()
+    assert not cstring('a é').isalpha()
+
+
+def test_split_str_separator():
+    assert cstring('a, b, c').split(', ') == [cstring('a'), cstring('b'), cstring('c')]
+    assert cstring('a-b').split(b'-') == [cstring('a'), cstring('b')]
+
+
+def test_rsplit():
+    assert cstring('a,b,c').rsplit(',') == [cstring('a'), cstring('b'), cstring('c')]
+    assert cstring('a,b,c').rsplit(',', 1) == [cstring('a,b'), cstring('c')]
+    assert cstring('  a b c  ').rsplit(maxsplit=1) == [cstring('  a b'), cstring('c')]
+    assert cstring('').rsplit() == []
+
+
+def test_rsplit_empty_separator():
+    with pytest.raises(ValueError):
+        cstring('hello').rsplit('')
+
+
+def test_splitlines():
+    target = cstring('one\ntwo\r\nthree\rfour five')
+    assert target.splitlines() == [
+        cstring('one'), cstring('two'), cstring('three'), cstring('four'), cstring('five')]
+    assert target.splitlines(keepends=True) == [
+        cstring('one\n'), cstring('two\r\n'), cstring('three\r'), cstring('four '), cstring('five')]
+    assert cstring('').splitlines() == []
+    assert cstring('a\n\nb\n').splitlines() == [cstring('a'), cstring(''), cstring('b')]
+
+
+def test_itersplit():
+    target = cstring(','.join(str(i) for i in range(200)))
+    pieces = target.itersplit(',')
+    assert next(pieces) == cstring('0')
+    assert next(pieces) == cstring('1')
+    assert list(cstring('a b  c').itersplit()) == [cstring('a'), cstring('b'), cstring('c')]
+    assert list(cstring('a,b,c').itersplit(',', 1)) == [cstring('a'), cstring('b,c')]
+
+
+def test_itersplit_empty_separator():
+    with pytest.raises(ValueError):
+        cstring('hello').itersplit('')
+
+
+def test_itersplitlines():
+    assert list(cstring('a\nb\r\n').itersplitlines()) == [cstring('a'), cstring('b')]
+    assert list(cstring('a\nb\r\n').itersplitlines(True)) == [cstring('a\n'), cstring('b\r\n')]
+
+
+def test_partition_str():
+    assert cstring('a=b=c').partition('=') == (cstring('a'), cstring('='), cstring('b=c'))
+    assert cstring('a=b=c').rpartition(b'=') == (cstring('a=b'), cstring('='), cstring('c'))
+
+
+def test_partition_empty_separator():
+    with pytest.raises(ValueError):
+        cstring('abc').partition('')
+
+
+def test_replace():
+    target = cstring('hello, world')
+    assert target.replace('o', '0') == cstring('hell0, w0rld')
+    assert target.replace('l', 'L', 2) == cstring('heLLo, world')
+    assert target.replace(', ', ' -- ') == cstring('hello -- world')
+    assert target.replace('l', '') == cstring('heo, word')
+    assert target.replace(cstring('world'), b'there') == cstring('hello, there')
+    assert target.replace('o', 'ö', count=1) == cstring('hellö, world')
+
+
+def test_replace_not_found():
+    target = cstring('hello, world')
+    assert target.replace('x', 'y') is target
+    assert target.replace('o', 'o') is target
+    assert target.replace('o', '0', 0) is target
+
+
+def test_replace_empty_old():
+    assert cstring('héllo').replace('', '-') == cstring('héllo'.replace('', '-'))
+    assert cstring('héllo').replace('', '-', 2) == cstring('-h-éllo')
+    assert cstring('').replace('', 'x') == cstring('x')
+
+
+def test_translate():
+    table = cstring.maketrans(',;', '  ', '\t')
+    assert cstring('a,b;c\td').translate(table) == cstring('a b cd')
+    assert cstring('héllo,wörld').translate(table) == cstring('héllo wörld')
+    assert cstring('\t\t').translate(table) == cstring('')
+    target = cstring('hello')
+    assert target.translate(table) is target
+
+
+def test_translate_dict():
+    assert cstring('a,b').translate({ord(','): ' ', ord('a'): None}) == cstring(' b')
+    assert cstring('a,b').translate(cstring.maketrans({',': ord('.'), 'b': ''})) == cstring('a.')
+
+
+def test_translate_dict_keys():
+    # as str.translate, only code points are looked up
+    for text, table in [('abc', {'a': 'x'}), ('abc', {'a': 'x', ord('b'): 'y'}), ('héllo', {'é': 'e', ord('l'): 'L'})]:
+        assert cstring(text).translate(table) == cstring(text.translate(table))
+    assert cstring('abc').translate({'a': 'x'}) == cstring('abc')
+
+
+def test_translate_multibyte():
+    assert cstring('héllo').translate(cstring.maketrans('é', 'e')) == cstring('hello')
+    assert cstring('hello').translate(cstring.maketrans({'l': 'ł'})) == cstring('hełło')
+    assert cstring('a-b').translate({ord('-'): '--'}) == cstring('a--b')
+
+
+def test_translate_bytes():
+    table = bytes.maketrans(b'ab', b'AB')
+    assert cstring('abc').translate(table) == cstring('ABc')
+    assert cstring('abc').translate(cstring.maketrans(b'a', b'\xff')) == b'\xffbc'
+    with pytest.raises(ValueError):
+        cstring('abc').translate(b'short')
+
+
+def test_maketrans_errors():
+    with pytest.raises(ValueError):
+        cstring.maketrans('ab', 'c')
+    with pytest.raises(TypeError):
+        cstring.maketrans('ab')
+
+
+def test_method_arguments():
+    target = cstring('a b c')
+    assert target.split(maxsplit=1) == [cstring('a'), cstring('b c')]
+    assert target.split(sep=' ', maxsplit=1) == [cstring('a'), cstring('b c')]
+    assert target.rsplit(None, 1) == [cstring('a b'), cstring('c')]
+    assert cstring('a\nb').splitlines(keepends=True) == [cstring('a\n'), cstring('b')]
+    assert cstring('aaa').replace('a', 'b', count=2) == cstring('bba')
+    with pytest.raises(TypeError):
+        target.find()
+    with pytest.raises(TypeError):
+        target.find('a', 0, 1, 2)
+    with pytest.raises(TypeError):
+        target.find('a', 1.0)
+    with pytest.raises(TypeError):
+        target.split(' ', sep=' ')
+    with pytest.raises(TypeError):
+        target.split(separator=' ')
+    with pytest.raises(TypeError):
+        target.replace('a')
+    with pytest.raises(TypeError):
+        target.replace(old='a', new='b')
+    with pytest.raises(TypeError):
+        target.strip(' ', ' ')
+
+
+def test_maketrans_bytearray():
+    x = bytearray(b'ab')
+    table = cstring.maketrans(x, bytearray(b'AB'), bytearray(b'c'))
+    assert cstring('abcd').translate(table) == cstring('ABd')
+    # the buffers are released, so the arguments can be resized again
+    x.extend(b'z')
+    with pytest.raises(TypeError):
+        cstring.maketrans(x, 1)
+    x.extend(b'q')
+    assert x == b'abzq'
@@ -0,0 +1,80 @@
+import gc
+import mmap
+import pytest
+from cstring import cstring
+
+
+@pytest.fixture
+def path(tmp_path):
+    p = tmp_path / 'text.txt'
+    p.write_bytes('héllo\nwörld\n'.encode() * 100)
+    return p
+
+
+def test_from_file(path):
+    target = cstring.from_file(path)
+    assert target == path.read_bytes()
+    assert len(target) == 1400
+    assert target.char_len() == 1200
+    assert target.count('\n') == 200
+    assert target.splitlines()[:2] == [cstring('héllo'), cstring('wörld')]
+    assert target.find('wörld') == 7
+    assert hash(target) == hash(cstring(path.read_bytes()))
+
+
+def test_from_file_str_path(path):
+    assert cstring.from_file(str(path)) == path.read_bytes()
+
+
+def test_from_file_empty(tmp_path):
+    p = tmp_path / 'empty'
+    p.write_bytes(b'')
+    assert cstring.from_file(p) == cstring('')
+
+
+def test_from_file_errors(tmp_path):
+    p = tmp_path / 'bad'
+    p.write_bytes(b'abc\xff')
+    with pytest.raises(UnicodeDecodeError):
+        cstring.from_file(p)
+    assert cstring.from_file(p, errors='replace') == cstring('abc�')
+    assert len(cstring.from_file(p, errors='trust')) == 4
+    with pytest.raises(ValueError):
+        cstring.from_file(p, errors='bogus')
+
+
+def test_from_file_missing(tmp_path):
+    with pytest.raises(FileNotFoundError):
+        cstring.from_file(tmp_path / 'missing')
+
+
+def test_from_mmap(path):
+    with open(path, 'rb') as f:
+        mapping = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    target = cstring.from_mmap(mapping)
+    assert target == path.read_bytes()
+    part = target[1:5]
+    del target
+    gc.collect()
+    # views keep the mapping open
+    with pytest.raises(BufferError):
+        mapping.close()
+    assert part == cstring('éll')
+    del part
+    gc.collect()
+    mapping.close()
+
+
+def test_from_mmap_writable():
+    mapping = mmap.mmap(-1, 16)
+    with pytest.raises(ValueError):
+        cstring.from_mmap(mapping)
+    mapping.close()
+
+
+def test_from_mmap_other_buffer():
+    data = bytearray(b'hello')
+    with pytest.raises(TypeError):
+        cstring.from_mmap(memoryview(data).toreadonly())
+    with pytest.raises(TypeError):
+        cstring.from_mmap(b'hello')
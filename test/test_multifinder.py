@@ -0,0 +1,57 @@
+import pytest
+from cstring import cstring, MultiFinder
+
+
+def test_patterns():
+    finder = MultiFinder(['he', cstring('she'), b'his'])
+    assert finder.patterns == (cstring('he'), cstring('she'), cstring('his'))
+
+
+def test_empty_pattern():
+    with pytest.raises(ValueError):
+        MultiFinder(['a', ''])
+
+
+def test_search():
+    finder = MultiFinder(['he', 'she', 'his', 'hers'])
+    assert finder.search(cstring('ushers')) == (1, 1)
+    assert finder.search(cstring('this')) == (1, 2)
+    assert finder.search(cstring('xyz')) is None
+
+
+def test_search_leftmost_longest():
+    finder = MultiFinder(['bc', 'abcd', 'ab'])
+    assert finder.search('abcd') == (0, 1)
+
+
+def test_search_start_end():
+    finder = MultiFinder(['he', 'she'])
+    assert finder.search(cstring('ushers'), 2) == (2, 0)
+    assert finder.search(cstring('ushers'), 0, 2) is None
+
+
+def test_find_any():
+    finder = MultiFinder(['lo', 'wor'])
+    assert finder.find_any(cstring('hello, world')) == 3
+    assert finder.find_any(cstring('hello, world'), 5) == 7
+    assert finder.find_any(cstring('hi')) == -1
+
+
+def test_finditer():
+    finder = MultiFinder(['he', 'she', 'his', 'hers'])
+    assert list(finder.finditer(cstring('ushers'))) == [(1, 1), (2, 0), (2, 3)]
+
+
+def test_finditer_duplicates():
+    finder = MultiFinder(['a', 'a'])
+    assert list(finder.finditer('aa')) == [(0, 0), (0, 1), (1, 0), (1, 1)]
+
+
+def test_count_many():
+    finder = MultiFinder(['l', 'lo', 'o', 'xyz', '🙂'])
+    assert finder.count_many(cstring('hello, world 🙂')) == [3, 1, 2, 0, 1]
+
+
+def test_count_many_non_overlapping():
+    finder = MultiFinder(['aa', 'a'])
+    assert finder.count_many(b'aaaaa') == [2, 5]
@@ -0,0 +1,42 @@
+import copy
+import pickle
+from cstring import cstring
+
+
+def test_pickle():
+    for target in (cstring('hello'), cstring('héllo wörld'), cstring(''), cstring('x' * 10000)):
+        for protocol in range(pickle.HIGHEST_PROTOCOL + 1):
+            result = pickle.loads(pickle.dumps(target, protocol=protocol))
+            assert type(result) is cstring
+            assert result == target
+            assert hash(result) == hash(target)
+
+
+def test_pickle_view():
+    target = cstring('hello world').view(6)
+    for protocol in range(pickle.HIGHEST_PROTOCOL + 1):
+        assert pickle.loads(pickle.dumps(target, protocol=protocol)) == cstring('world')
+
+
+def test_pickle_trusted_bytes():
+    target = cstring(b'abc\xff', errors='trust')
+    for protocol in range(pickle.HIGHEST_PROTOCOL + 1):
+        assert pickle.loads(pickle.dumps(target, protocol=protocol)) == b'abc\xff'
+
+
+def test_pickle_out_of_band():
+    target = cstring('héllo' * 1000)
+    buffers = []
+    data = pickle.dumps(target, protocol=5, buffer_callback=buffers.append)
+    assert len(buffers) == 1
+    assert buffers[0].raw() == bytes(target)
+    assert len(data) < 100
+    result = pickle.loads(data, buffers=buffers)
+    assert result == target
+    assert result.char_len() == 5000
+
+
+def test_copy():
+    target = cstring('hello')
+    assert copy.copy(target) == target
+    assert copy.deepcopy([target]) == [target]
@@ -0,0 +1,57 @@
+import io
+import os
+import pytest
+import cstring as module
+from cstring import cstring
+
+
+def test_readlines():
+    data = b'first\nsecond line\n\nlast'
+    lines = list(module.readlines(io.BytesIO(data)))
+    assert lines == [cstring('first\n'), cstring('second line\n'), cstring('\n'), cstring('last')]
+    assert all(isinstance(line, cstring) for line in lines)
+
+
+def test_readlines_empty():
+    assert list(module.readlines(io.BytesIO(b''))) == []
+
+
+def test_readlines_small_chunks():
+    data = b'a\nbb\nccc\n' + b'x' * 100 + b'\ny'
+    for chunk_size in (1, 2, 3, 10):
+        lines = list(module.readlines(io.BytesIO(data), chunk_size=chunk_size))
+        assert lines == io.BytesIO(data).readlines()
+
+
+def test_readlines_kept_lines():
+    # lines stay valid while later chunks are read
+    data = b''.join(b'line %d\n' % i for i in range(1000))
+    lines = list(module.readlines(io.BytesIO(data), chunk_size=64))
+    assert lines == io.BytesIO(data).readlines()
+
+
+def test_readlines_fd(tmp_path):
+    path = tmp_path / 'lines.txt'
+    path.write_bytes('héllo\nwörld\n'.encode())
+    fd = os.open(path, os.O_RDONLY)
+    try:
+        assert list(module.readlines(fd)) == [cstring('héllo\n'), cstring('wörld\n')]
+        # the descriptor is left open
+        os.fstat(fd)
+    finally:
+        os.close(fd)
+
+
+def test_readlines_errors():
+    data = b'ok\nbad \xff\n'
+    with pytest.raises(UnicodeDecodeError):
+        list(module.readlines(io.BytesIO(data)))
+    assert list(module.readlines(io.BytesIO(data), errors='replace')) == [cstring('ok\n'), cstring('bad �\n')]
+    assert len(list(module.readlines(io.BytesIO(data), errors='trust'))) == 2
+
+
+def test_readlines_text_file():
+    with pytest.raises(TypeError):
+        module.readlines(io.StringIO('text'))
+    with pytest.raises(ValueError):
+        module.readlines(io.BytesIO(b''), chunk_size=0)
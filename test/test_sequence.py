@@ -56,3 +56,25 @@ def test_contains_True():
 def test_contains_False():
     assert cstring('hello') not in cstring('world')
 
+
+
+def test_contains_str():
+    assert 'ell' in cstring('hello')
+    assert b'ell' in cstring('hello')
+    assert 'xyz' not in cstring('hello')
+
+
+def test_item_cached():
+    target = cstring('abca')
+    assert target[0] is target[3]
+    assert target[1] == cstring('b')
+    assert cstring(b'\xff\xfe', errors='trust')[0] == b'\xff'
+
+
+def test_freelist_lengths():
+    import cstring as module
+    for i in range(100):
+        cstring('x%d' % i)
+    lengths = module.freelist_lengths()
+    assert len(lengths) == 8
+    assert all(0 <= n <= 256 for n in lengths)
@@ -22,6 +22,46 @@ def test_new_from_cstring():
     assert cstring(cstring('hello, world')) == cstring('hello, world')
 
 
+def test_new_invalid_utf8():
+    import pytest
+    with pytest.raises(UnicodeDecodeError):
+        cstring(b'abc\xff')
+    with pytest.raises(UnicodeDecodeError):
+        cstring(b'\xe2\x82', errors='strict')
+
+
+def test_new_errors_replace():
+    assert cstring(b'a\xffb', errors='replace') == cstring('a\ufffdb')
+    assert cstring(b'caf\xc3\xa9', errors='replace') == cstring('café')
+
+
+def test_new_errors_trust():
+    target = cstring(b'a\xffb', errors='trust')
+    assert bytes(target) == b'a\xffb'
+    assert not target.isascii()
+
+
+def test_new_errors_unknown():
+    import pytest
+    with pytest.raises(ValueError):
+        cstring(b'abc', errors='ignore')
+
+
+def test_new_arguments():
+    import pytest
+    assert cstring(b'a\xffb', 'replace') == cstring('a\ufffdb')
+    with pytest.raises(TypeError):
+        cstring()
+    with pytest.raises(TypeError):
+        cstring('abc', 'strict', 'extra')
+    with pytest.raises(TypeError):
+        cstring('abc', errors=1)
+    with pytest.raises(TypeError):
+        cstring('abc', encoding='utf8')
+    with pytest.raises(TypeError):
+        cstring('abc', 'strict', errors='strict')
+
+
 def test_str():
     result = cstring('hello, world')
     assert str(result) == 'hello, world'
@@ -37,3 +77,7 @@ def test_hash():
     assert a is not b
     assert set((a, b)) == set((a,)) == set((b,))
 
+
+
+def test_hash_concat():
+    assert hash(cstring('hel') + cstring('lo')) == hash(cstring('hello'))
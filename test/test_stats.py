@@ -0,0 +1,91 @@
+import pytest
+import cstring as module
+from cstring import cstring
+
+
+def _has_stats():
+    try:
+        module._stats()
+    except RuntimeError:
+        return False
+    return True
+
+
+stats = pytest.mark.skipif(not _has_stats(), reason='built without CSTRING_STATS')
+
+
+def test_stats_disabled():
+    if _has_stats():
+        pytest.skip('built with CSTRING_STATS')
+    with pytest.raises(RuntimeError):
+        module._stats()
+    with pytest.raises(RuntimeError):
+        module._reset_stats()
+
+
+@stats
+def test_stats_reset():
+    cstring('hello world').find('o')
+    module._reset_stats()
+    result = module._stats()
+    assert result['searches']['find'] == 0
+    assert result['bytes_copied'] == 0
+    assert all(n == 0 for n in result['allocs'].values())
+
+
+@stats
+def test_stats_allocs():
+    module._reset_stats()
+    cstring('x' * 100)
+    cstring('y' * 100000)
+    result = module._stats()
+    assert result['allocs']['512'] == 1
+    assert result['allocs']['1M'] == 1
+    assert result['bytes_copied'] == 100100
+
+
+@stats
+def test_stats_freelists():
+    module._reset_stats()
+    for i in range(100):
+        cstring('x%d' % i)
+    result = module._stats()
+    assert result['freelist_hits'] + result['freelist_misses'] == 100
+
+
+@stats
+def test_stats_hash():
+    s = cstring('hello world')
+    module._reset_stats()
+    hash(s)
+    hash(s)
+    result = module._stats()
+    assert result['hash_computed'] == 1
+    assert result['hash_cached'] == 1
+
+
+@stats
+def test_stats_searches():
+    s = cstring('a,b,c')
+    module._reset_stats()
+    s.find(',')
+    s.rfind(',')
+    s.count(',')
+    assert ',' in s
+    s.partition(',')
+    s.replace(',', ';')
+    result = module._stats()['searches']
+    assert result['find'] == 1
+    assert result['rfind'] == 1
+    assert result['count'] == 1
+    assert result['contains'] == 1
+    assert result['partition'] == 1
+    assert result['replace'] == 1
+
+
+@stats
+def test_stats_views():
+    array = module.Array(['hello', 'world'])
+    module._reset_stats()
+    array[1]
+    assert module._stats()['views'] == 1
@@ -0,0 +1,87 @@
+import threading
+import pytest
+import cstring as module
+from cstring import cstring, Finder
+
+MB = 1 << 20
+
+
+@pytest.fixture
+def threads():
+    previous = module.set_threads(4)
+    yield
+    module.set_threads(previous)
+
+
+def test_set_threads():
+    previous = module.set_threads(2)
+    try:
+        assert module.set_threads(3) == 2
+        with pytest.raises(ValueError):
+            module.set_threads(0)
+    finally:
+        module.set_threads(previous)
+
+
+def test_count_seams(threads):
+    # matches run across chunk boundaries wherever those fall
+    for n in (8 * MB, 9 * MB + 1, 9 * MB + 3):
+        text = b'a' * n
+        for sub in (b'a', b'aa', b'aaa', b'a' * 100):
+            assert cstring(text).count(sub) == text.count(sub)
+            assert Finder(sub).count(text) == text.count(sub)
+
+
+def test_count_periodic(threads):
+    text = b'ab' * (5 * MB) + b'a'
+    for sub in (b'aba', b'abab', b'bab'):
+        assert cstring(text).count(sub) == text.count(sub)
+
+
+def test_find_large(threads):
+    base = bytearray(b'x' * (10 * MB))
+    for pos in (0, 2 * MB - 2, 5 * MB, len(base) - 5):
+        text = bytearray(base)
+        text[pos:pos + 5] = b'hello'
+        s = cstring(bytes(text))
+        assert s.find('hello') == pos
+        assert s.rfind('hello') == pos
+        assert 'hello' in s
+    assert cstring(bytes(base)).find('hello') == -1
+
+
+def test_rfind_large(threads):
+    text = b'hello' + b'x' * (10 * MB) + b'hello'
+    assert cstring(text).rfind('hello') == len(text) - 5
+    assert cstring(text).find('hello') == 0
+
+
+def test_validate_large(threads):
+    text = ('héllo wörld ☃ 𝄞 ' * 600000).encode()
+    assert cstring(text).char_len() == len(text.decode())
+    bad = bytearray(text)
+    bad[len(bad) // 2] = 0xff
+    with pytest.raises(UnicodeDecodeError):
+        cstring(bytes(bad))
+    assert cstring(text[2:], errors='trust').isascii() is False
+
+
+def test_case_large(threads):
+    text = b'Hello, World! ' * (MB // 2)
+    s = cstring(text)
+    assert s.lower() == text.lower()
+    assert s.upper() == text.upper()
+    assert s.swapcase() == text.swapcase()
+
+
+def test_concurrent_calls():
+    s = cstring(b'abc' * MB)
+    results = []
+    def count():
+        results.append(s.count('ca'))
+    workers = [threading.Thread(target=count) for _ in range(4)]
+    for t in workers:
+        t.start()
+    for t in workers:
+        t.join()
+    assert results == [MB - 1] * 4
@@ -0,0 +1,96 @@
+import sys
+from cstring import cstring
+
+
+def test_view():
+    target = cstring('hello, world')
+    view = target.view(7)
+    assert isinstance(view, cstring)
+    assert view == cstring('world')
+    assert len(view) == 5
+    assert str(view) == 'world'
+
+
+def test_view_start_end():
+    target = cstring('hello, world')
+    assert target.view(1, 4) == cstring('ell')
+    assert target.view(-5, -1) == cstring('worl')
+    assert target.view(4, 1) == cstring('')
+
+
+def test_view_hash():
+    target = cstring('hello, world')
+    assert hash(target.view(0, 5)) == hash(cstring('hello'))
+    assert {target.view(0, 5): 1}[cstring('hello')] == 1
+
+
+def test_view_shares_storage():
+    target = cstring('x' * 1000)
+    view = target.view(10, 20)
+    assert sys.getsizeof(view) < 100
+    assert memoryview(view).tobytes() == b'x' * 10
+
+
+def test_view_outlives_parent():
+    view = (cstring('hello') * 3).view(5, 10)
+    assert view == cstring('hello')
+
+
+def test_view_slice():
+    view = cstring('hello, world').view(0, 5)
+    assert view[1:3] == cstring('el')
+    assert view[::-1] == cstring('olleh')
+    assert view[-1] == cstring('o')
+
+
+def test_view_split():
+    view = cstring('a,b,c;trailing').view(0, 5)
+    assert view.split(cstring(',')) == [cstring('a'), cstring('b'), cstring('c')]
+    assert view.view(0, 3).split() == [cstring('a,b')]
+
+
+def test_view_partition():
+    view = cstring('key=value&rest').view(0, 9)
+    assert view.partition(cstring('=')) == (cstring('key'), cstring('='), cstring('value'))
+    assert view.rpartition(cstring('=')) == (cstring('key'), cstring('='), cstring('value'))
+
+
+def test_view_strip():
+    view = cstring('  hello  world').view(0, 9)
+    assert view.strip() == cstring('hello')
+    assert view.lstrip() == cstring('hello  ')
+    assert view.rstrip() == cstring('  hello')
+
+
+def test_view_search():
+    view = cstring('hello, world').view(0, 5)
+    assert view.find('lo') == 3
+    assert view.find('wor') == -1
+    assert view.rfind('l') == 3
+    assert view.count('l') == 2
+    assert view.endswith('lo')
+    assert cstring('ell') in view
+    assert cstring('world') not in view
+
+
+def test_view_case():
+    view = cstring('Hello, World').view(0, 5)
+    assert view.upper() == cstring('HELLO')
+    assert view.lower() == cstring('hello')
+    assert view.swapcase() == cstring('hELLO')
+
+
+def test_view_compare():
+    view = cstring('abcdef').view(0, 3)
+    assert view == cstring('abc')
+    assert view < cstring('abcd')
+    assert view > cstring('abb')
+
+
+def test_materialize():
+    target = cstring('hello, world')
+    assert target.materialize() is target
+    view = target.view(0, 5)
+    result = view.materialize()
+    assert result == cstring('hello')
+    assert sys.getsizeof(result) < sys.getsizeof(target)